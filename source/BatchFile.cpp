@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "BatchFile.hpp"
+#include "error.hpp"
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+BatchFile::BatchFile(const CmdArgs &args) {
+    std::ifstream in(args.batchFilename());
+    stop_if(!in.is_open(), "failed to open batch file (%s).",
+            args.batchFilename().c_str());
+
+    BatchFrame inputFrame;
+    std::string scene = readScene(args.inputFilename(), inputFrame);
+
+    std::string line;
+    for(int lineNumber = 1; getline(in, line); ++lineNumber) {
+        std::stringstream ss{line};
+        BatchFrame frame;
+        std::string input;
+
+        if(!(ss >> frame.output) || frame.output[0] == '#')
+            continue;
+
+        if(ss >> frame.position.x) {
+            ss >> frame.position.y >> frame.position.z;
+            ss >> frame.target.x >> frame.target.y >> frame.target.z;
+            ss >> frame.up.x >> frame.up.y >> frame.up.z;
+            ss >> frame.fovy;
+            stop_if(!ss, "invalid camera at line %d of the batch file.",
+                    lineNumber);
+        }
+        else {
+            ss.clear();
+            stop_if(!(ss >> input),
+                    "missing camera at line %d of the batch file.",
+                    lineNumber);
+            stop_if(readScene(input, frame) != scene,
+                    "the scene of %s is different from the scene of %s. "
+                    "Only the camera can change in a batch.", input.c_str(),
+                    args.inputFilename().c_str());
+        }
+
+        _frames.push_back(frame);
+    }
+
+    stop_if(_frames.empty(), "the batch file has no frames.");
+}
+
+std::string BatchFile::readScene(const std::string &filename,
+        BatchFrame &frame) {
+    std::ifstream in(filename);
+    stop_if(!in.is_open(), "failed to open input file (%s).",
+            filename.c_str());
+
+    Screen::readCamera(in, frame.position, frame.target, frame.up,
+            frame.fovy);
+    return std::string{std::istreambuf_iterator<char>{in},
+        std::istreambuf_iterator<char>{}};
+}
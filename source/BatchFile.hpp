@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BATCHFILE_HPP
+#define BATCHFILE_HPP
+
+#include "CmdArgs.hpp"
+#include "Sampler.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * Reads the frames of a batch render. Each line of the file is a frame,
+ * given by the output filename followed by either the camera
+ * (position target up fovy, as in the scene files) or a scene file whose
+ * camera is used. Lines starting with # are ignored.
+ * The scene of every frame must be the scene of the input file, as only the
+ * camera can change without rebuilding the sampler.
+ */
+class BatchFile {
+    std::vector<BatchFrame> _frames;
+
+    /// Reads the camera of the scene file and returns the rest of the file.
+    static std::string readScene(const std::string &filename,
+            BatchFrame &frame);
+
+public:
+    /**
+     * Reads the batch file given in the arguments.
+     * This constructor may finish the program in case the file is invalid.
+     */
+    BatchFile(const CmdArgs &args);
+
+    /// Returns the frames, in order.
+    inline const std::vector<BatchFrame> &frames() const {
+        return _frames;
+    }
+};
+
+#endif // !BATCHFILE_HPP
@@ -39,6 +39,15 @@ bool CmdArgs::optionExists(char **begin, char **end, const std::string &option)
     return std::find(begin, end, option) != end;
 }
 
+std::string CmdArgs::aovFilename() const {
+    size_t dot = _output.rfind('.');
+    size_t slash = _output.rfind('/');
+    if(dot == std::string::npos
+            || (slash != std::string::npos && dot < slash))
+        return _output + ".exr";
+    return _output.substr(0, dot) + ".exr";
+}
+
 void CmdArgs::printErrorAndQuit(int argc, char **argv) {
     std::cerr << argv[0] << ": invalid command line arguments\n"
         << "Try '" << argv[0] << " --help' for more information."
@@ -57,7 +66,56 @@ void CmdArgs::printHelpAndQuit(int argc, char **argv) {
         << "--help\t\tShow help information\n"
         << "-w <arg>\t\tSet the width of the image to <arg>\n"
         << "-h <arg>\t\tSet the height of the image to <arg>\n"
-        << "-ls <arg>\t\tChange the number of samples per light to <arg>";
+        << "-ls <arg>\t\tChange the number of samples per light to <arg>\n"
+        << "-aa <arg>\t\tSet the anti aliasing level to <arg>\n"
+        << "-packet\t\tTrace primary rays in packets of 2x2 pixels\n"
+        << "-primary\t\tOnly trace primary rays (outputs the albedo)\n"
+        << "-sort\t\tSort the paths by material between bounces\n"
+        << "-mindepth <arg>\t\tBounces before the Russian roulette (3)\n"
+        << "-maxdepth <arg>\t\tMaximum number of bounces of a path (64)\n"
+        << "-roulette <arg>\t\tContinue the paths with probability <arg> "
+        << "instead of by the luminance of their throughput\n"
+        << "-guide <arg>\t\tLearn the incident light on the first <arg> "
+        << "passes and guide the diffuse bounces of the next ones\n"
+        << "-lights <arg>\t\tSample the emitters at the diffuse bounces: "
+        << "none, uniform or tree (none)\n"
+        << "-bdpt\t\tConnect the paths to light subpaths from the emitters "
+        << "(bidirectional path tracing, at most 8 bounces)\n"
+        << "-spectral\t\tTrace 4 wavelengths per path instead of RGB, so "
+        << "that glass with an Abbe number disperses the light\n"
+        << "-sppm <arg>\t\tGather <arg> photons per pass at the first diffuse "
+        << "bounces (stochastic progressive photon mapping)\n"
+        << "-aperture <arg>\t\tSample the camera rays from a thin lens of "
+        << "radius <arg> (depth of field)\n"
+        << "-focus <arg>\t\tDistance of the focal plane of the -aperture "
+        << "lens (the distance to the center of the camera)\n"
+        << "-shutter <arg>\t\tMove the objects by their velocity during a "
+        << "shutter of <arg> time units (motion blur)\n"
+        << "-trace <arg>\t\tWrite a Chrome trace of the execution to <arg>\n"
+        << "-passes <arg>\t\tAverage <arg> progressive passes of numSamples\n"
+        << "-preview <arg>\t\tServe a preview of each pass on localhost:<arg>\n"
+        << "-batch <arg>\t\tRender the frames of batch file <arg> (output is "
+        << "ignored)\n"
+        << "-tonemap <arg>\t\tTonemapping operator: clamp, reinhard, aces or "
+        << "filmic (clamp)\n"
+        << "-exposure <arg>\t\tScale the colors by 2^<arg> before tonemapping\n"
+        << "-denoise\t\tDenoise the image guided by the albedo and normals\n"
+        << "-aov <arg>\t\tWrite the comma separated AOVs <arg> (albedo, "
+        << "normal, depth, id, spp, variance) to output.exr\n"
+        << "-accum <arg>\t\tFormat of the radiance accumulator: float, "
+        << "float3, half or rgb9e5 (float)\n"
+        << "-aovaccum <arg>\t\tFormat of the AOV framebuffer: float or half "
+        << "(float). Half IDs are exact up to 2048\n"
+        << "-checkpoint <arg>\t\tPeriodically save the accumulated passes to "
+        << "<arg>\n"
+        << "-checkpointinterval <arg>\tSeconds between checkpoints (60)\n"
+        << "-resume\t\tResume from the -checkpoint file, if it exists\n"
+        << "-timebudget <arg>\t\tStop the passes before <arg> seconds of "
+        << "rendering, at most -passes passes\n"
+        << "-targetrmse <arg>\t\tStop the passes when the estimated RMSE "
+        << "relative to the mean luminance falls below <arg>\n"
+        << "-fastmath\t\tUse native and polynomial approximations of the "
+        << "math functions when sampling directions";
 
     std::cerr << std::endl;
     exit(1);
@@ -80,6 +138,36 @@ CmdArgs::CmdArgs(int argc, char **argv) {
     _width = 800;
     _height = 600;
     _aaLevel = 1; // No AA.
+    _numPasses = 1;
+    _previewPort = 0; // No preview.
+    _tonemap = ClampTonemap;
+    _exposure = 0.0f;
+    _aovs = 0;
+    _accumFormat = _aovFormat = FloatAccum;
+    _checkpointInterval = 60.0f;
+    _timeBudget = _targetRmse = 0.0f;
+    _minDepth = 3;
+    _maxDepth = 64;
+    _roulette = 0.0f; // From the throughput.
+    _guidePasses = 0;
+    _sppmPhotons = 0; // No photon mapping.
+    _aperture = _focus = _shutter = 0.0f; // Pinhole camera, no motion.
+    _lightSampling = NoLightSampling;
+    _resume = optionExists(argv, argv + argc, "-resume");
+    _packetTracing = optionExists(argv, argv + argc, "-packet");
+    _primaryRaysOnly = optionExists(argv, argv + argc, "-primary");
+    _raySorting = optionExists(argv, argv + argc, "-sort");
+    _denoise = optionExists(argv, argv + argc, "-denoise");
+    _fastMath = optionExists(argv, argv + argc, "-fastmath");
+    _bidirectional = optionExists(argv, argv + argc, "-bdpt");
+    _spectral = optionExists(argv, argv + argc, "-spectral");
+    stop_if(_packetTracing && _raySorting,
+            "-packet and -sort can't be used together.");
+    stop_if(_bidirectional && (_packetTracing || _raySorting
+                || _primaryRaysOnly),
+            "-bdpt can't be used with -packet, -sort or -primary.");
+    stop_if(_spectral && (_packetTracing || _raySorting || _bidirectional),
+            "-spectral can't be used with -packet, -sort or -bdpt.");
 
     // Parse options.
     if(optionExists(argv, argv + argc, "-w")) {
@@ -103,4 +191,238 @@ CmdArgs::CmdArgs(int argc, char **argv) {
         stop_if(_aaLevel <= 0,
                 "Invalid anti aliasing level: must be > 0.");
     }
+    if(optionExists(argv, argv + argc, "-mindepth")) {
+        char *opt = getOption(argv, argv + argc, "-mindepth");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _minDepth = (int) strtol(opt, NULL, 10);
+        stop_if(_minDepth < 0, "Minimum depth must be >= 0.");
+    }
+    if(optionExists(argv, argv + argc, "-maxdepth")) {
+        char *opt = getOption(argv, argv + argc, "-maxdepth");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _maxDepth = (int) strtol(opt, NULL, 10);
+        stop_if(_maxDepth <= 0 || _maxDepth > MaxPathDepth,
+                "Maximum depth must be > 0 and <= %d.", MaxPathDepth);
+    }
+    stop_if(_minDepth > _maxDepth,
+            "Minimum depth must be <= the maximum depth.");
+    if(optionExists(argv, argv + argc, "-roulette")) {
+        char *opt = getOption(argv, argv + argc, "-roulette");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _roulette = strtof(opt, NULL);
+        stop_if(_roulette <= 0.0f || _roulette > 1.0f,
+                "Roulette probability must be > 0 and <= 1.");
+    }
+    if(optionExists(argv, argv + argc, "-guide")) {
+        char *opt = getOption(argv, argv + argc, "-guide");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _guidePasses = (int) strtol(opt, NULL, 10);
+        stop_if(_guidePasses <= 0, "Guide passes must be > 0.");
+        stop_if(_raySorting, "-guide and -sort can't be used together.");
+    }
+    if(optionExists(argv, argv + argc, "-lights")) {
+        char *opt = getOption(argv, argv + argc, "-lights");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        std::string name = opt;
+        if(name == "none")
+            _lightSampling = NoLightSampling;
+        else if(name == "uniform")
+            _lightSampling = UniformLights;
+        else if(name == "tree")
+            _lightSampling = TreeLights;
+        else
+            stop_if(true, "Invalid light sampling: %s.", opt);
+        stop_if(_raySorting && _lightSampling != NoLightSampling,
+                "-lights and -sort can't be used together.");
+    }
+    stop_if(_bidirectional && (_guidePasses
+                || _lightSampling != NoLightSampling),
+            "-bdpt can't be used with -guide or -lights.");
+    if(optionExists(argv, argv + argc, "-sppm")) {
+        char *opt = getOption(argv, argv + argc, "-sppm");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _sppmPhotons = (int) strtol(opt, NULL, 10);
+        stop_if(_sppmPhotons <= 0, "Photons per pass must be > 0.");
+        stop_if(_packetTracing || _raySorting || _primaryRaysOnly
+                || _bidirectional || _spectral, "-sppm can't be used with "
+                "-packet, -sort, -primary, -bdpt or -spectral.");
+        stop_if(_guidePasses || _lightSampling != NoLightSampling,
+                "-sppm can't be used with -guide or -lights.");
+    }
+    if(optionExists(argv, argv + argc, "-aperture")) {
+        char *opt = getOption(argv, argv + argc, "-aperture");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _aperture = strtof(opt, NULL);
+        stop_if(_aperture < 0.0f, "Aperture must be >= 0.");
+    }
+    if(optionExists(argv, argv + argc, "-focus")) {
+        char *opt = getOption(argv, argv + argc, "-focus");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _focus = strtof(opt, NULL);
+        stop_if(_focus <= 0.0f, "Focus distance must be > 0.");
+        stop_if(_aperture <= 0.0f, "-focus needs -aperture.");
+    }
+    if(optionExists(argv, argv + argc, "-shutter")) {
+        char *opt = getOption(argv, argv + argc, "-shutter");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _shutter = strtof(opt, NULL);
+        stop_if(_shutter < 0.0f, "Shutter must be >= 0.");
+    }
+    // Only the paths of the sample kernel leave from the lens and at a time
+    // of the shutter.
+    stop_if((_aperture > 0.0f || _shutter > 0.0f) && (_packetTracing
+                || _raySorting || _bidirectional || _sppmPhotons),
+            "-aperture and -shutter can't be used with -packet, -sort, -bdpt "
+            "or -sppm.");
+    if(optionExists(argv, argv + argc, "-trace")) {
+        char *opt = getOption(argv, argv + argc, "-trace");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _trace = opt;
+    }
+    if(optionExists(argv, argv + argc, "-passes")) {
+        char *opt = getOption(argv, argv + argc, "-passes");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _numPasses = (int) strtol(opt, NULL, 10);
+        stop_if(_numPasses <= 0, "Number of passes must be > 0.");
+    }
+    if(optionExists(argv, argv + argc, "-preview")) {
+        char *opt = getOption(argv, argv + argc, "-preview");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _previewPort = (int) strtol(opt, NULL, 10);
+        stop_if(_previewPort <= 0 || _previewPort > 65535,
+                "Invalid preview port.");
+    }
+    if(optionExists(argv, argv + argc, "-batch")) {
+        char *opt = getOption(argv, argv + argc, "-batch");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _batch = opt;
+    }
+    if(optionExists(argv, argv + argc, "-checkpoint")) {
+        char *opt = getOption(argv, argv + argc, "-checkpoint");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _checkpoint = opt;
+    }
+    if(optionExists(argv, argv + argc, "-checkpointinterval")) {
+        char *opt = getOption(argv, argv + argc, "-checkpointinterval");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _checkpointInterval = strtof(opt, NULL);
+        stop_if(_checkpointInterval < 0.0f,
+                "Checkpoint interval must be >= 0.");
+    }
+    if(optionExists(argv, argv + argc, "-timebudget")) {
+        char *opt = getOption(argv, argv + argc, "-timebudget");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _timeBudget = strtof(opt, NULL);
+        stop_if(_timeBudget <= 0.0f, "Time budget must be > 0.");
+    }
+    if(optionExists(argv, argv + argc, "-targetrmse")) {
+        char *opt = getOption(argv, argv + argc, "-targetrmse");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _targetRmse = strtof(opt, NULL);
+        stop_if(_targetRmse <= 0.0f, "Target RMSE must be > 0.");
+    }
+    // Budgeted renders run until the budget is met, unless limited.
+    if(budgeted() && !optionExists(argv, argv + argc, "-passes"))
+        _numPasses = MaxBudgetPasses;
+    stop_if(budgeted() && !_batch.empty(),
+            "-timebudget and -targetrmse can't be used in batch mode.");
+    stop_if(_resume && _checkpoint.empty(), "-resume needs -checkpoint.");
+    stop_if(!_checkpoint.empty() && !_batch.empty(),
+            "-checkpoint can't be used in batch mode.");
+    // The state of the photon mapping pixels isn't in the checkpoints, and
+    // its passes are correlated, so they don't estimate the noise.
+    stop_if(_sppmPhotons && (!_checkpoint.empty() || _targetRmse > 0.0f),
+            "-sppm can't be used with -checkpoint or -targetrmse.");
+    // Nor is the path guiding training, which a resumed render would redo.
+    stop_if(_guidePasses && !_checkpoint.empty(),
+            "-guide can't be used with -checkpoint.");
+    if(optionExists(argv, argv + argc, "-tonemap")) {
+        char *opt = getOption(argv, argv + argc, "-tonemap");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        std::string name = opt;
+        if(name == "clamp")
+            _tonemap = ClampTonemap;
+        else if(name == "reinhard")
+            _tonemap = ReinhardTonemap;
+        else if(name == "aces")
+            _tonemap = ACESTonemap;
+        else if(name == "filmic")
+            _tonemap = FilmicTonemap;
+        else
+            stop_if(true, "Invalid tonemapping operator: %s.", opt);
+    }
+    if(optionExists(argv, argv + argc, "-exposure")) {
+        char *opt = getOption(argv, argv + argc, "-exposure");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        _exposure = strtof(opt, NULL);
+    }
+    if(optionExists(argv, argv + argc, "-accum")) {
+        char *opt = getOption(argv, argv + argc, "-accum");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        std::string name = opt;
+        if(name == "float")
+            _accumFormat = FloatAccum;
+        else if(name == "float3")
+            _accumFormat = Float3Accum;
+        else if(name == "half")
+            _accumFormat = HalfAccum;
+        else if(name == "rgb9e5")
+            _accumFormat = RGB9E5Accum;
+        else
+            stop_if(true, "Invalid accumulator format: %s.", opt);
+    }
+    if(optionExists(argv, argv + argc, "-aovaccum")) {
+        char *opt = getOption(argv, argv + argc, "-aovaccum");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        std::string name = opt;
+        if(name == "float")
+            _aovFormat = FloatAccum;
+        else if(name == "half")
+            _aovFormat = HalfAccum;
+        else
+            stop_if(true, "Invalid AOV framebuffer format: %s.", opt);
+    }
+    if(optionExists(argv, argv + argc, "-aov")) {
+        char *opt = getOption(argv, argv + argc, "-aov");
+        if(!opt) printErrorAndQuit(argc, argv);
+
+        const char *names[NumAovs] = {"albedo", "normal", "depth", "id", "spp",
+            "variance"};
+        std::string list = opt;
+        size_t begin = 0;
+        while(begin <= list.size()) {
+            size_t end = std::min(list.find(',', begin), list.size());
+            std::string name = list.substr(begin, end - begin);
+
+            int aov = 0;
+            for(int i = 0; i < NumAovs; ++i)
+                if(name == names[i])
+                    aov = 1 << i;
+            stop_if(!aov, "Invalid AOV: %s.", name.c_str());
+
+            _aovs |= aov;
+            begin = end + 1;
+        }
+    }
 }
@@ -29,8 +29,70 @@
  * Represents the command line arguments.
  */
 class CmdArgs {
-    std::string _input, _output, _programName;
-    int _width, _height, _numSamples, _aaLevel;
+public:
+    /// Operators that map the HDR colors to the output image.
+    enum Tonemap {
+        ClampTonemap,       /// Clamps the linear color, without sRGB.
+        ReinhardTonemap,
+        ACESTonemap,
+        FilmicTonemap
+    };
+
+    /// Storage formats of the accumulation buffers.
+    enum AccumFormat {
+        FloatAccum,         /// float4 sums (16 bytes per pixel).
+        Float3Accum,        /// float3 sums (12 bytes per pixel).
+        HalfAccum,          /// half4 running means (8 bytes per pixel).
+        RGB9E5Accum         /// Shared exponent running means (4 bytes).
+    };
+
+    /// How the emitters are sampled at the diffuse bounces.
+    enum LightSampling {
+        NoLightSampling,    /// Emitters are only found by the bounces.
+        UniformLights,      /// All emitters have the same probability.
+        TreeLights          /// Traverses the light tree by importance.
+    };
+
+    /// Arbitrary output variables, as flags.
+    enum Aov {
+        AlbedoAov = 1 << 0,     /// Albedo of the first hit.
+        NormalAov = 1 << 1,     /// Normal of the first hit.
+        DepthAov = 1 << 2,      /// Distance to the first hit.
+        IDAov = 1 << 3,         /// Object and material of the first hit.
+        SamplesAov = 1 << 4,    /// Number of samples of the pixel.
+        VarianceAov = 1 << 5    /// Variance of the luminance of the pixel.
+    };
+
+    /// Maximum number of passes of a budgeted render without -passes.
+    static const int MaxBudgetPasses = 1 << 16;
+
+    /// Largest -maxdepth, which sizes the recursion stack of the kernel.
+    static const int MaxPathDepth = 256;
+
+    /// Largest number of bounces of the paths of -bdpt, which keeps its
+    /// subpaths in private memory.
+    static const int MaxBidirectionalDepth = 8;
+
+    /// Number of AOVs of the Aov enum.
+    static const int NumAovs = 6;
+
+private:
+    std::string _input, _output, _programName, _trace, _batch, _checkpoint;
+    int _width, _height, _numSamples, _aaLevel, _numPasses, _previewPort;
+    bool _packetTracing, _primaryRaysOnly, _raySorting, _denoise, _resume;
+    bool _fastMath, _bidirectional, _spectral;
+    float _checkpointInterval;
+    float _timeBudget, _targetRmse;
+    int _minDepth, _maxDepth;
+    float _roulette;
+    int _guidePasses;
+    int _sppmPhotons;
+    float _aperture, _focus, _shutter;
+    LightSampling _lightSampling;
+    Tonemap _tonemap;
+    float _exposure;
+    int _aovs;
+    AccumFormat _accumFormat, _aovFormat;
 
     /// Returns the given option or NULL if it wasn't found.
     char *getOption(char **begin, char **end, const std::string &option);
@@ -85,6 +147,185 @@ public:
     inline int aaLevel() const {
         return _aaLevel;
     }
+
+    /// Returns if primary rays are traced in packets of 2x2 pixels.
+    inline bool packetTracing() const {
+        return _packetTracing;
+    }
+
+    /// Returns if only the primary rays are traced (no bounces).
+    inline bool primaryRaysOnly() const {
+        return _primaryRaysOnly;
+    }
+
+    /// Returns if the paths are sorted by material between bounces.
+    inline bool raySorting() const {
+        return _raySorting;
+    }
+
+    /// Returns if the paths are sampled by bidirectional path tracing.
+    inline bool bidirectional() const {
+        return _bidirectional;
+    }
+
+    /// Returns if the paths carry 4 wavelengths instead of RGB.
+    inline bool spectral() const {
+        return _spectral;
+    }
+
+    /// Returns the photons of a pass of -sppm, or 0 without photon mapping.
+    inline int sppmPhotons() const {
+        return _sppmPhotons;
+    }
+
+    /// Returns the radius of the lens, or 0 for a pinhole camera.
+    inline float aperture() const {
+        return _aperture;
+    }
+
+    /// Returns the distance of the focal plane, or 0 to focus at the center
+    /// of the camera description.
+    inline float focus() const {
+        return _focus;
+    }
+
+    /// Returns the duration of the shutter interval, or 0 without motion
+    /// blur.
+    inline float shutter() const {
+        return _shutter;
+    }
+
+    /// Returns the number of bounces of a path before the Russian roulette.
+    inline int minDepth() const {
+        return _minDepth;
+    }
+
+    /// Returns the maximum number of bounces of a path.
+    inline int maxDepth() const {
+        return _maxDepth;
+    }
+
+    /**
+     * Returns the fixed probability of continuing a path in the Russian
+     * roulette, or 0 if it is given by the luminance of the path throughput.
+     */
+    inline float roulette() const {
+        return _roulette;
+    }
+
+    /**
+     * Returns the number of passes the path guiding is trained on before it
+     * guides the diffuse bounces, or 0 if path guiding is disabled.
+     */
+    inline int guidePasses() const {
+        return _guidePasses;
+    }
+
+    /// Returns the trace output filename or an empty string if not tracing.
+    inline const std::string &traceFilename() const {
+        return _trace;
+    }
+
+    /// Returns if the execution is being traced.
+    inline bool tracing() const {
+        return !_trace.empty();
+    }
+
+    /// Returns the number of progressive passes.
+    inline int numPasses() const {
+        return _numPasses;
+    }
+
+    /// Returns the port of the preview server or 0 if there's no preview.
+    inline int previewPort() const {
+        return _previewPort;
+    }
+
+    /// Returns the batch filename or an empty string if not in batch mode.
+    inline const std::string &batchFilename() const {
+        return _batch;
+    }
+
+    /// Returns if a batch of frames is rendered.
+    inline bool batch() const {
+        return !_batch.empty();
+    }
+
+    /// Returns the checkpoint filename or an empty string if not enabled.
+    inline const std::string &checkpointFilename() const {
+        return _checkpoint;
+    }
+
+    /// Returns the minimum time between two checkpoints, in seconds.
+    inline float checkpointInterval() const {
+        return _checkpointInterval;
+    }
+
+    /// Returns if the render resumes from the checkpoint file.
+    inline bool resume() const {
+        return _resume;
+    }
+
+    /// Returns the time available for the passes, in seconds, or 0.
+    inline float timeBudget() const {
+        return _timeBudget;
+    }
+
+    /// Returns the relative RMSE where the passes stop, or 0.
+    inline float targetRmse() const {
+        return _targetRmse;
+    }
+
+    /// Returns if the passes stop at a time budget or a noise target.
+    inline bool budgeted() const {
+        return _timeBudget > 0.0f || _targetRmse > 0.0f;
+    }
+
+    /// Returns how the emitters are sampled at the diffuse bounces.
+    inline LightSampling lightSampling() const {
+        return _lightSampling;
+    }
+
+    /// Returns the tonemapping operator.
+    inline Tonemap tonemap() const {
+        return _tonemap;
+    }
+
+    /// Returns the exposure, in stops.
+    inline float exposure() const {
+        return _exposure;
+    }
+
+    /// Returns if the image is denoised before tonemapping.
+    inline bool denoise() const {
+        return _denoise;
+    }
+
+    /**
+     * Returns if the sampling code uses the native and polynomial
+     * approximations of fastmath.cl instead of the full precision builtins.
+     */
+    inline bool fastMath() const {
+        return _fastMath;
+    }
+
+    /// Returns the AOVs written to aovFilename(), as Aov flags.
+    inline int aovs() const {
+        return _aovs;
+    }
+
+    /// Returns the format of the radiance accumulator.
+    inline AccumFormat accumFormat() const {
+        return _accumFormat;
+    }
+
+    /// Returns the format of the AOV framebuffer, FloatAccum or HalfAccum.
+    inline AccumFormat aovFormat() const {
+        return _aovFormat;
+    }
+
+    /// Returns the output filename with the extension replaced by ".exr".
+    std::string aovFilename() const;
 };
 
 #endif // !CMDARGS_HPP
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ExrImage.hpp"
+#include "Profiler.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
+namespace {
+
+/// Appends the value to out in little endian.
+template<typename T>
+void put(std::string &out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::copy((const uint8_t *) &value, (const uint8_t *) &value + sizeof(T),
+            bytes);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(bytes, bytes + sizeof(T));
+#endif
+    out.append((const char *) bytes, sizeof(T));
+}
+
+/// Appends a header attribute to out.
+void putAttribute(std::string &out, const std::string &name,
+        const std::string &type, const std::string &value) {
+    out.append(name).push_back('\0');
+    out.append(type).push_back('\0');
+    put<int32_t>(out, value.size());
+    out.append(value);
+}
+
+} // namespace
+
+ExrImage::ExrImage(int width, int height)
+        : _width{width}, _height{height} {
+}
+
+void ExrImage::addChannel(const std::string &name,
+        std::vector<float> pixels) {
+    stop_if(pixels.size() != (size_t) _width * _height,
+            "invalid size of the %s channel.", name.c_str());
+    _channels.emplace_back(name, std::move(pixels));
+}
+
+void ExrImage::writeTo(const std::string &filename) {
+    ScopedTimer timer{"ExrImage::writeTo"};
+
+    // The channels must be sorted by name.
+    std::sort(_channels.begin(), _channels.end(),
+            [](const std::pair<std::string, std::vector<float>> &a,
+                const std::pair<std::string, std::vector<float>> &b) {
+                return a.first < b.first;
+            });
+
+    std::string header;
+    put<uint32_t>(header, 20000630);    // Magic number.
+    put<uint32_t>(header, 2);           // Version 2, single part scanline.
+
+    std::string channels;
+    for(const auto &channel : _channels) {
+        channels.append(channel.first).push_back('\0');
+        put<int32_t>(channels, 2);      // FLOAT.
+        put<uint32_t>(channels, 0);     // pLinear and reserved.
+        put<int32_t>(channels, 1);      // x sampling.
+        put<int32_t>(channels, 1);      // y sampling.
+    }
+    channels.push_back('\0');
+
+    std::string window;
+    put<int32_t>(window, 0);
+    put<int32_t>(window, 0);
+    put<int32_t>(window, _width - 1);
+    put<int32_t>(window, _height - 1);
+
+    std::string one, center;
+    put<float>(one, 1.0f);
+    put<float>(center, 0.0f);
+    put<float>(center, 0.0f);
+
+    putAttribute(header, "channels", "chlist", channels);
+    putAttribute(header, "compression", "compression", std::string(1, '\0'));
+    putAttribute(header, "dataWindow", "box2i", window);
+    putAttribute(header, "displayWindow", "box2i", window);
+    putAttribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+    putAttribute(header, "pixelAspectRatio", "float", one);
+    putAttribute(header, "screenWindowCenter", "v2f", center);
+    putAttribute(header, "screenWindowWidth", "float", one);
+    header.push_back('\0');
+
+    // Every scanline is a block, preceded by its y and its size, and the
+    // offset table of the blocks follows the header.
+    uint32_t lineSize = _channels.size() * _width * sizeof(float);
+    uint64_t offset = header.size() + (uint64_t) _height * sizeof(uint64_t);
+    for(int y = 0; y < _height; ++y) {
+        put<uint64_t>(header, offset);
+        offset += 2 * sizeof(int32_t) + lineSize;
+    }
+
+    std::ofstream out(filename.c_str(), std::ofstream::binary);
+    stop_if(!out.is_open(), "failed to open output file (%s).",
+            filename.c_str());
+    out.write(header.data(), header.size());
+
+    std::string line;
+    for(int y = 0; y < _height; ++y) {
+        line.clear();
+        put<int32_t>(line, y);
+        put<uint32_t>(line, lineSize);
+        for(const auto &channel : _channels)
+            for(int x = 0; x < _width; ++x)
+                put<float>(line, channel.second[(size_t) y * _width + x]);
+        out.write(line.data(), line.size());
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EXRIMAGE_HPP
+#define EXRIMAGE_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Multi-layer float image written as an uncompressed scanline OpenEXR file.
+ * Layers are stored as channels named "layer.channel" (e.g. "albedo.R"), as
+ * compositing tools expect.
+ */
+class ExrImage {
+    int _width, _height;
+
+    /// Name and pixels of each channel, row by row.
+    std::vector<std::pair<std::string, std::vector<float>>> _channels;
+
+public:
+    /// Creates an image without channels.
+    ExrImage(int width, int height);
+
+    /**
+     * Adds a channel to the image.
+     * @param pixels width * height values, row by row.
+     */
+    void addChannel(const std::string &name, std::vector<float> pixels);
+
+    /**
+     * Writes the image to the file with the given filename.
+     */
+    void writeTo(const std::string &filename);
+};
+
+#endif // !EXRIMAGE_HPP
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "FrameWriter.hpp"
+#include "PPMImage.hpp"
+#include "Profiler.hpp"
+
+FrameWriter::FrameWriter(int width, int height)
+        : _width{width}, _height{height}, _stopping{false},
+        _thread{&FrameWriter::writeLoop, this} {
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _changed.notify_all();
+    _thread.join();
+}
+
+void FrameWriter::write(const std::string &filename,
+        std::vector<uint8_t> &rgb) {
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _changed.wait(lock, [this] {
+            return _jobs.size() < MaxPending;
+        });
+
+        _jobs.push_back(Job{filename, std::vector<uint8_t>{}});
+        _jobs.back().rgb.swap(rgb);
+    }
+    _changed.notify_all();
+}
+
+void FrameWriter::writeLoop() {
+    while(true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _changed.wait(lock, [this] {
+                return !_jobs.empty() || _stopping;
+            });
+            if(_jobs.empty())
+                return;
+
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        _changed.notify_all();
+
+        ScopedTimer timer{"FrameWriter", "host", Profiler::IOThread};
+        PPMImage::write(job.filename, job.rgb.data(), _width, _height);
+    }
+}
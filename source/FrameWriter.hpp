@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FRAMEWRITER_HPP
+#define FRAMEWRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Converts and writes images on a separate thread, so the render doesn't
+ * wait for the disk.
+ */
+class FrameWriter {
+    /// Image waiting to be written.
+    struct Job {
+        std::string filename;
+        std::vector<uint8_t> rgb;
+    };
+
+    /// Maximum number of images waiting to be written.
+    static const size_t MaxPending = 4;
+
+    int _width, _height;
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::deque<Job> _jobs;
+    bool _stopping;
+
+    std::thread _thread;
+
+    /// Writes the images until stopped.
+    void writeLoop();
+
+public:
+    FrameWriter() = delete;
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    /// Starts the writer for images of the given size.
+    FrameWriter(int width, int height);
+
+    /// Writes all the pending images and stops the writer.
+    ~FrameWriter();
+
+    /**
+     * Queues the image to be written to filename. Takes the contents of rgb.
+     * Waits if there are too many images pending.
+     * @param rgb Image with 3 bytes per pixel and no padding between rows.
+     */
+    void write(const std::string &filename, std::vector<uint8_t> &rgb);
+};
+
+#endif // !FRAMEWRITER_HPP
@@ -21,13 +21,14 @@
  */
 
 #include "PPMImage.hpp"
+#include "Profiler.hpp"
 #include "error.hpp"
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <cstdint>
 
-PPMImage::PPMImage(uint8_t *aImage, int aWidth, int aHeight)
+PPMImage::PPMImage(const uint8_t *aImage, int aWidth, int aHeight)
         : _height(aHeight), _width(aWidth) {
 
     data.resize(_height);
@@ -35,7 +36,7 @@ PPMImage::PPMImage(uint8_t *aImage, int aWidth, int aHeight)
         data[i].resize(_width);
 
         for(int j = 0; j < _width; ++j) {
-            size_t pos = 4 * (_width * i + j);
+            size_t pos = 3 * (_width * i + j);
             data[i][j].fromRGB(aImage[pos], aImage[pos + 1], aImage[pos + 2]);
         }
     }
@@ -80,20 +81,29 @@ PPMImage::PPMImage(const std::string &filename) {
 }
 
 void PPMImage::writeTo(const std::string &filename) {
+    std::vector<uint8_t> rgb(3 * _width * _height);
+    for(int i = 0; i < _height; ++i) {
+        for(int j = 0; j < _width; ++j) {
+            size_t pos = 3 * (_width * i + j);
+            data[i][j].toRGB(&rgb[pos], &rgb[pos + 1], &rgb[pos + 2]);
+        }
+    }
+
+    write(filename, rgb.data(), _width, _height);
+}
+
+void PPMImage::write(const std::string &filename, const uint8_t *rgb,
+        int width, int height) {
+    ScopedTimer timer{"PPMImage::write"};
+
     std::ofstream out(filename.c_str(), std::ofstream::binary);
     stop_if(!out.is_open(), "failed to open output file (%s).", filename.c_str());
 
     // PPM header.
     out << "P6\n";
     out << "# clTracer by RenatoUtsch <renatoutsch@gmail.com>\n";
-    out << _width << " " << _height << "\n";
+    out << width << " " << height << "\n";
     out << "255\n";
 
-    unsigned char color[3];
-    for(int i = 0; i < _height; ++i) {
-        for(int j = 0; j < _width; ++j) {
-            data[i][j].toRGB(&color[0], &color[1], &color[2]);
-            out.write((char *) color, 3);
-        }
-    }
+    out.write((const char *) rgb, 3 * (size_t) width * height);
 }
@@ -45,10 +45,9 @@ public:
     std::vector< std::vector<Color> > data;
 
     /**
-     * Constructs the PPM image from the given input in 32bit RGBA format.
-     * Please note that the 4th component (the alpha channel) will be ignored.
+     * Constructs the PPM image from the given input in 24bit RGB format.
      */
-    PPMImage(uint8_t *aImage, int aWidth, int aHeight);
+    PPMImage(const uint8_t *aImage, int aWidth, int aHeight);
 
     /**
      * Constructs the PPM image from the given PPM file.
@@ -60,6 +59,13 @@ public:
      */
     void writeTo(const std::string &filename);
 
+    /**
+     * Writes an image in 24bit RGB format, with no padding between rows, to
+     * the file with the given filename without converting it.
+     */
+    static void write(const std::string &filename, const uint8_t *rgb,
+            int width, int height);
+
     /**
      * Width of the image.
      */
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Profiler.hpp"
+#include "error.hpp"
+#include <cstdio>
+#include <fstream>
+
+namespace {
+
+/// Escapes the quotes, backslashes and control characters of a JSON string.
+std::string escapeJSON(const std::string &str) {
+    std::string out;
+    for(char c : str) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if((unsigned char) c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char) c);
+            out += code;
+        }
+        else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+Profiler::Profiler() : _enabled{false}, _origin{getTime()} {
+}
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::addEvent(const std::string &name, const std::string &category,
+        Time start, Time duration, Thread thread) {
+    if(_enabled) {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _events.push_back(Event{name, category, start, duration, thread, false,
+                0.0});
+    }
+}
+
+void Profiler::addCounter(const std::string &name, double value) {
+    if(_enabled) {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _events.push_back(Event{name, "counter", getTime(), 0.0, HostThread,
+                true, value});
+    }
+}
+
+void Profiler::writeTo(const std::string &filename) const {
+    std::ofstream out(filename);
+    stop_if(!out.is_open(), "failed to open trace file (%s).",
+            filename.c_str());
+
+    // The trace timestamps are in microseconds.
+    out.precision(15);
+    out << "{\"traceEvents\":[\n"
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << HostThread << ",\"args\":{\"name\":\"host\"}},\n"
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << DeviceThread << ",\"args\":{\"name\":\"OpenCL device\"}},\n"
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << IOThread << ",\"args\":{\"name\":\"I/O\"}}";
+
+    for(const Event &event : _events) {
+        out << ",\n{\"name\":\"" << escapeJSON(event.name) << "\",\"cat\":\""
+            << escapeJSON(event.category) << "\",\"pid\":1,\"tid\":"
+            << event.thread
+            << ",\"ts\":" << (event.start - _origin) * 1000.0;
+
+        if(event.counter)
+            out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+        else
+            out << ",\"ph\":\"X\",\"dur\":" << event.duration * 1000.0 << "}";
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
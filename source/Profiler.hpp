@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "utils.hpp"
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Collects the time spent on each step of the program and exports it as a
+ * Chrome trace_event JSON file (open it in chrome://tracing).
+ * The profiler is disabled by default, in which case nothing is recorded.
+ * Events can be added from any thread.
+ */
+class Profiler {
+public:
+    /// Timelines of the trace.
+    enum Thread {
+        HostThread,
+        DeviceThread,
+        IOThread
+    };
+
+private:
+    /// A span of time or a counter sample.
+    struct Event {
+        std::string name, category;
+        Time start, duration;
+        Thread thread;
+        bool counter;
+        double value;
+    };
+
+    bool _enabled;
+    Time _origin; /// Time at which the profiler was created.
+    std::vector<Event> _events;
+    std::mutex _mutex;
+
+    Profiler();
+
+public:
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    /// Returns the profiler of the program.
+    static Profiler &instance();
+
+    /// Starts recording events.
+    inline void enable() {
+        _enabled = true;
+    }
+
+    /// Returns if events are being recorded.
+    inline bool enabled() const {
+        return _enabled;
+    }
+
+    /**
+     * Records a span of time.
+     * @param start Start of the span, as returned by getTime().
+     * @param duration Duration of the span in milliseconds.
+     */
+    void addEvent(const std::string &name, const std::string &category,
+            Time start, Time duration, Thread thread = HostThread);
+
+    /// Records the value of a counter at the current time.
+    void addCounter(const std::string &name, double value);
+
+    /// Writes the recorded events to the given file.
+    void writeTo(const std::string &filename) const;
+};
+
+/**
+ * Records the time between its construction and destruction as an event of
+ * the given timeline.
+ */
+class ScopedTimer {
+    const char *_name, *_category;
+    Profiler::Thread _thread;
+    Time _start;
+
+public:
+    ScopedTimer(const char *name, const char *category = "host",
+            Profiler::Thread thread = Profiler::HostThread)
+            : _name{name}, _category{category}, _thread{thread},
+            _start{getTime()} {
+    }
+
+    ~ScopedTimer() {
+        Profiler &profiler = Profiler::instance();
+        if(profiler.enabled())
+            profiler.addEvent(_name, _category, _start, getTime() - _start,
+                    _thread);
+    }
+};
+
+#endif // !PROFILER_HPP
@@ -29,7 +29,59 @@
 #include "PPMImage.hpp"
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Time spent by the sampler on each step, in milliseconds.
+ */
+struct SamplerTimes {
+    double compile;     /// Generating and building the OpenCL program.
+    double upload;      /// Creating and uploading the buffers.
+    double kernel;      /// Executing the kernel in the last sample().
+    double denoise;     /// Denoising the image in the last sample().
+    double readback;    /// Reading back the image in the last sample().
+};
+
+/**
+ * Accuracy and cost of a function of the math layer of the kernels
+ * (fastmath.cl), with or without args.fastMath().
+ */
+struct MathBenchmark {
+    std::string function;   /// Name of the function.
+    bool fastMath;          /// If built with the approximations.
+    double time;            /// Time per evaluation, in ns.
+    double maxAbsError;     /// Largest error against double precision.
+    double maxRelError;     /// Largest relative error, for results > 1e-3.
+};
+
+/**
+ * Function called after each progressive pass with the image accumulated so
+ * far (3 bytes per pixel, no padding between rows) and the number of passes.
+ * The image is only valid during the call.
+ */
+typedef std::function<void(const uint8_t *rgb, int pass)> PassCallback;
+
+/**
+ * Frame of a batch render.
+ */
+struct BatchFrame {
+    Point position;     /// Position of the camera.
+    Point target;       /// Point at the center of the screen.
+    Vector up;          /// Direction to the top of the camera.
+    float fovy;         /// Vertical field of view, in degrees.
+    std::string output; /// Output image filename.
+};
+
+/**
+ * Function called with the image of each frame of a batch, in the order of
+ * the frames (3 bytes per pixel, no padding between rows). The function may
+ * take the contents of the image vector.
+ */
+typedef std::function<void(const BatchFrame &frame,
+        std::vector<uint8_t> &rgb)> FrameCallback;
 
 /**
  * Class that actually samples each pixel by tracing the ray from the camera
@@ -56,10 +108,84 @@ public:
 
     /**
      * Samples all the pixels from the screen used when creating this class.
-     * Returns the sampled image.
-     * This is the actual path tracing call.
+     * Returns the sampled image, with 3 bytes per pixel and no padding between
+     * rows, tonemapped with args.tonemap() and args.exposure().
+     * This is the actual path tracing call. Each call adds args.numPasses()
+     * passes of numSamples samples each to the accumulated image.
      */
-    std::unique_ptr<PPMImage> sample();
+    std::vector<uint8_t> sample();
+
+    /**
+     * Moves the camera, reusing the compiled program and the scene. The next
+     * sample() restarts the accumulation; otherwise the passes of each call
+     * are added to the passes of the previous calls.
+     * @param position Position of the camera.
+     * @param target Point at the center of the screen.
+     * @param up Direction to the top of the camera.
+     * @param fovy Vertical field of view, in degrees.
+     */
+    void setCamera(const Point &position, const Point &target,
+            const Vector &up, float fovy);
+
+    /**
+     * Renders a sequence of frames of the scene, each with args.numPasses()
+     * passes, keeping the program and the scene of this sampler. The kernel
+     * of a frame is enqueued while the previous frame is still rendering, and
+     * its image is read back on a second command queue while the next frame
+     * renders. The accumulation is restarted by the next sample().
+     * @param onFrame Called with the image of each frame.
+     */
+    void renderBatch(const std::vector<BatchFrame> &frames,
+            FrameCallback onFrame);
+
+    /**
+     * Loads the passes saved to the checkpoint file by a previous render with
+     * the same scene, camera and options (see args.checkpointFilename()).
+     * The next sample() only renders the remaining passes of
+     * args.numPasses(), and its image is identical to the one of a render
+     * that wasn't interrupted.
+     * @return False if the file doesn't exist.
+     */
+    bool resume(const std::string &filename);
+
+    /**
+     * Returns the HDR average of the passes accumulated by sample() since the
+     * last camera change, with 3 floats per pixel, decoded from the
+     * args.accumFormat() of the accumulator.
+     */
+    std::vector<float> radiance();
+
+    /**
+     * Returns the estimated RMSE of the pixel luminances of radiance()
+     * relative to their mean, from the variance AOV, which args.aovs() must
+     * include.
+     */
+    double noise();
+
+    /**
+     * Writes the AOVs of args.aovs() accumulated by sample() since the last
+     * camera change as a multi-layer OpenEXR file, next to the averaged
+     * radiance. The AOVs of renderBatch() frames aren't kept.
+     */
+    void writeAovs(const std::string &filename);
+
+    /**
+     * Runs the microbenchmark of the math functions of the kernels on the
+     * device of the sampler, both with and without the approximations of
+     * args.fastMath(), and compares their results to double precision ones
+     * computed on the host.
+     * @param iterations Evaluations of each function per work item.
+     */
+    std::vector<MathBenchmark> benchmarkMath(int iterations);
+
+    /**
+     * Sets the function called by sample() after each pass. Intermediate
+     * passes are only read back from the device if a callback is set.
+     */
+    void setPassCallback(PassCallback callback);
+
+    /// Returns the time spent on each step.
+    const SamplerTimes &times() const;
 };
 
 #endif // !SAMPLER_HPP
@@ -22,12 +22,12 @@
 
 #include "Screen.hpp"
 #include "error.hpp"
-#include "math/math.hpp"
 #include <fstream>
 #include <limits>
 
 Screen::Screen(const CmdArgs &args)
-        : _width(args.width()), _height(args.height()) {
+        : _width(args.width()), _height(args.height()),
+        _lensRadius(args.aperture()), _focusDistance(args.focus()) {
 
     // Read the input file.
     std::string input = args.inputFilename();
@@ -35,12 +35,25 @@ Screen::Screen(const CmdArgs &args)
     stop_if(!in.is_open(), "failed to open input file (%s).", input.c_str());
 
     Point camera, center;
-    Vector up, right;
+    Vector up;
     float fovy;
+    readCamera(in, camera, center, up, fovy);
+
+    lookAt(camera, center, up, fovy);
+}
+
+void Screen::readCamera(std::istream &in, Point &camera, Point &center,
+        Vector &up, float &fovy) {
     in >> camera.x >> camera.y >> camera.z;
     in >> center.x >> center.y >> center.z;
     in >> up.x >> up.y >> up.z;
     in >> fovy;
+    stop_if(!in, "invalid camera description.");
+}
+
+void Screen::lookAt(const Point &camera, const Point &center, Vector up,
+        float fovy) {
+    Vector right;
 
     // Camera direction to the center of the screen..
     Vector dir = (center - camera).normalize();
@@ -54,6 +67,7 @@ Screen::Screen(const CmdArgs &args)
 
     // Calculate the width and height of the screen.
     float d = Point::distance(center, camera);
+    _centerDistance = d;
     _heightSize = 2 * tan(toRads(fovy / 2.0f)) * d;
     _widthSize = (_heightSize * _width) / _height;
 
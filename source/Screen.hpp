@@ -24,7 +24,9 @@
 #define SCREEN_HPP
 
 #include "CmdArgs.hpp"
+#include "math/math.hpp"
 #include <cstdlib>
+#include <istream>
 #include <string>
 
 /*
@@ -42,6 +44,9 @@ class Screen {
     float _cameraPos[4];        /// Position of the camera.
     float _upVector[4];         /// Direction to the top of the camera.
     float _rightVector[4];      /// Direction to the right of the camera.
+    float _lensRadius;          /// Radius of the lens, or 0 for a pinhole.
+    float _focusDistance;       /// Distance of the focal plane, or 0.
+    float _centerDistance;      /// Distance of the camera to the center.
 
 public:
     /**
@@ -49,6 +54,23 @@ public:
      */
     Screen(const CmdArgs &args);
 
+    /**
+     * Reads the camera description (the first 4 lines of a scene file).
+     * @param fovy Set to the vertical field of view, in degrees.
+     */
+    static void readCamera(std::istream &in, Point &camera, Point &center,
+            Vector &up, float &fovy);
+
+    /**
+     * Moves the viewpoint.
+     * @param camera Position of the camera.
+     * @param center Point at the center of the screen.
+     * @param up Direction to the top of the camera.
+     * @param fovy Vertical field of view, in degrees.
+     */
+    void lookAt(const Point &camera, const Point &center, Vector up,
+            float fovy);
+
     /**
      * Returns the width of the screen in world coordinates.
      */
@@ -91,6 +113,24 @@ public:
         return _height;
     }
 
+    /**
+     * Returns the radius of the thin lens, or 0 for a pinhole camera.
+     */
+    inline float lensRadius() const {
+        return _lensRadius;
+    }
+
+    /**
+     * Returns the factor that moves the points of the screen to the focal
+     * plane along the rays from the camera. The focal plane is the screen
+     * itself, at the center of the camera description, without -focus.
+     */
+    inline float focusScale() const {
+        if(_focusDistance <= 0.0f)
+            return 1.0f;
+        return _focusDistance / _centerDistance;
+    }
+
     /// Size of an array from this class.
     const size_t ArraySize = 4 * sizeof(float);
 
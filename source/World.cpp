@@ -21,12 +21,17 @@
  */
 
 #include "World.hpp"
+#include "Profiler.hpp"
 #include "error.hpp"
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <limits>
+#include <algorithm>
+#include <cfloat>
 
 World::World(const CmdArgs &args) {
+    ScopedTimer timer{"World"};
     std::string aInput = args.inputFilename();
     std::ifstream in(aInput);
     stop_if(!in.is_open(), "failed to open input file.");
@@ -107,6 +112,15 @@ void World::readMaterialDescription(std::ifstream &in) {
             >> material.specularExp >> material.reflectionCoef
             >> material.transmissionCoef >> material.refractionRate;
 
+        // The Abbe number is optional, at the end of the line.
+        std::string rest;
+        std::getline(in, rest);
+        std::istringstream extra(rest);
+        if(!(extra >> material.abbeNumber))
+            material.abbeNumber = 0.0f;
+        stop_if(material.abbeNumber < 0.0f,
+                "material %d has a negative Abbe number.", i);
+
         materials.push_back(material);
     }
 }
@@ -132,6 +146,15 @@ void World::readObjectDescription(std::ifstream &in) {
 
             in >> obj.emission.r >> obj.emission.g >> obj.emission.b;
 
+            // The velocity is optional, at the end of the line. The emitters
+            // can't move, so the light sampling sees them where they are.
+            std::string rest;
+            std::getline(in, rest);
+            readVelocity(rest, obj.velocity);
+            stop_if(obj.velocity.magnitude() > 0.0f && (obj.emission.r > 0.0f
+                        || obj.emission.g > 0.0f || obj.emission.b > 0.0f),
+                    "sphere %d emits light and can't move.", i);
+
             spheres.push_back(obj);
         }
         else if(type == "polyhedron") {
@@ -144,15 +167,151 @@ void World::readObjectDescription(std::ifstream &in) {
             obj.materialID = materialID;
 
             in >> numFaces;
+
+            // The velocity is optional, after the number of faces.
+            std::string rest;
+            std::getline(in, rest);
+            readVelocity(rest, obj.velocity);
+
             for(int j = 0; j < numFaces; ++j) {
                 in >> plane.a >> plane.b >> plane.c >> plane.d;
                 obj.faces.push_back(plane);
             }
 
+            computePolyhedronBounds(obj);
             polyhedrons.push_back(obj);
         }
+        else if(type == "plane") {
+            InfinitePlane obj;
+            obj.textureType = _textureInfos[rawTextureID].type;
+            obj.textureID = _textureInfos[rawTextureID].id;
+            obj.materialID = materialID;
+
+            // ax + by + cz + d = 0, as the faces of the polyhedrons.
+            Plane &plane = obj.plane;
+            in >> plane.a >> plane.b >> plane.c >> plane.d;
+            float length = plane.normal().magnitude();
+            stop_if(length <= FLT_EPSILON, "plane %d has no normal.", i);
+            plane = Plane(plane.a / length, plane.b / length,
+                    plane.c / length, plane.d / length);
+
+            planes.push_back(obj);
+        }
+        else if(type == "quad") {
+            Quad obj;
+            obj.textureType = _textureInfos[rawTextureID].type;
+            obj.textureID = _textureInfos[rawTextureID].id;
+            obj.materialID = materialID;
+
+            in >> obj.corner.x >> obj.corner.y >> obj.corner.z;
+            in >> obj.u.x >> obj.u.y >> obj.u.z;
+            in >> obj.v.x >> obj.v.y >> obj.v.z;
+            stop_if(Vector::cross(obj.u, obj.v).magnitude() <= FLT_EPSILON,
+                    "quad %d has parallel edges.", i);
+
+            quads.push_back(obj);
+        }
         else {
             stop_if(true, "invalid object (%s).", type.c_str());
         }
     }
 }
+
+void World::readVelocity(const std::string &rest, Vector &velocity) {
+    std::istringstream extra(rest);
+    if(!(extra >> velocity.x >> velocity.y >> velocity.z))
+        velocity = Vector();
+}
+
+void World::computePolyhedronBounds(Polyhedron &obj) {
+    const float eps = 1e-4f;
+    const auto &faces = obj.faces;
+
+    obj.bounded = false;
+    obj.boundsMin = Point(FLT_MAX, FLT_MAX, FLT_MAX);
+    obj.boundsMax = Point(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    // A closed volume needs at least 4 faces.
+    if(faces.size() < 4)
+        return;
+
+    // The polyhedron is unbounded if some direction r moves away from no face
+    // (dot(n, r) <= 0 for every face). If it exists, there is one along the
+    // intersection of two faces, so only those directions are checked.
+    bool hasEdges = false;
+    for(size_t i = 0; i < faces.size(); ++i) {
+        for(size_t j = i + 1; j < faces.size(); ++j) {
+            Vector r = Vector::cross(faces[i].normal(), faces[j].normal());
+            if(r.magnitude() <= eps)
+                continue; // Parallel faces.
+            r.normalize();
+            hasEdges = true;
+
+            for(float sign : {1.0f, -1.0f}) {
+                bool escapes = true;
+                for(const auto &face : faces) {
+                    if(sign * Vector::dot(face.normal(), r)
+                            > eps * face.normal().magnitude()) {
+                        escapes = false;
+                        break;
+                    }
+                }
+                if(escapes)
+                    return;
+            }
+        }
+    }
+    if(!hasEdges)
+        return;
+
+    // The volume is finite, so the box is given by the vertices, which are
+    // the intersections of 3 faces that are inside all the other faces.
+    int numVertices = 0;
+    for(size_t i = 0; i < faces.size(); ++i) {
+        for(size_t j = i + 1; j < faces.size(); ++j) {
+            for(size_t k = j + 1; k < faces.size(); ++k) {
+                Vector n0 = faces[i].normal(), n1 = faces[j].normal(),
+                       n2 = faces[k].normal();
+                Vector c12 = Vector::cross(n1, n2), c20 = Vector::cross(n2, n0),
+                       c01 = Vector::cross(n0, n1);
+                float det = Vector::dot(n0, c12);
+                if(std::abs(det) <= eps)
+                    continue;
+
+                // Cramer's rule for n . p = -d on the 3 faces.
+                Vector v = (c12 * -faces[i].d + c20 * -faces[j].d
+                        + c01 * -faces[k].d) * (1.0f / det);
+
+                bool inside = true;
+                for(const auto &face : faces) {
+                    float val = face.a * v.x + face.b * v.y + face.c * v.z
+                        + face.d;
+                    if(val > eps * (1.0f + std::abs(face.d))) {
+                        inside = false;
+                        break;
+                    }
+                }
+                if(!inside)
+                    continue;
+
+                obj.boundsMin.x = std::min(obj.boundsMin.x, v.x);
+                obj.boundsMin.y = std::min(obj.boundsMin.y, v.y);
+                obj.boundsMin.z = std::min(obj.boundsMin.z, v.z);
+                obj.boundsMax.x = std::max(obj.boundsMax.x, v.x);
+                obj.boundsMax.y = std::max(obj.boundsMax.y, v.y);
+                obj.boundsMax.z = std::max(obj.boundsMax.z, v.z);
+                ++numVertices;
+            }
+        }
+    }
+    if(!numVertices)
+        return;
+
+    // Pad the box a little so rounding never rejects a grazing hit.
+    Vector pad(1e-3f * (1.0f + obj.boundsMax.x - obj.boundsMin.x),
+            1e-3f * (1.0f + obj.boundsMax.y - obj.boundsMin.y),
+            1e-3f * (1.0f + obj.boundsMax.z - obj.boundsMin.z));
+    obj.boundsMin -= pad;
+    obj.boundsMax += pad;
+    obj.bounded = true;
+}
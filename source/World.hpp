@@ -76,7 +76,8 @@ struct Material {
     float specularExp;          /// Specular exponent.
     float reflectionCoef;       /// Reflection coefficient.
     float transmissionCoef;     /// Transmission coefficient;
-    float refractionRate;       /// Refraction rate.
+    float refractionRate;       /// Refraction rate, at 587.6 nm.
+    float abbeNumber;           /// Abbe number, or 0 without dispersion.
 };
 
 /**
@@ -86,6 +87,7 @@ struct Sphere {
     Color emission;             /// Emission of the sphere.
     Point center;               /// Center of the sphere.
     float radius2;              /// Radius^2 of the sphere.
+    Vector velocity;            /// Motion of the center per unit of time.
     TextureType textureType;    /// Texture type.
     int textureID;              /// Texture ID.
     int materialID;             /// Material ID.
@@ -96,11 +98,38 @@ struct Sphere {
  */
 struct Polyhedron {
     std::vector<Plane> faces;   /// Faces of the object.
+    Point boundsMin;            /// Minimum corner of the bounding box.
+    Point boundsMax;            /// Maximum corner of the bounding box.
+    bool bounded;               /// If the faces enclose a finite volume.
+    Vector velocity;            /// Motion of all the faces per unit of time.
     TextureType textureType;    /// Texture type of all the faces.
     int textureID;              /// ID of the texture of all the faces.
     int materialID;             /// ID of the material of all the faces.
 };
 
+/**
+ * Represents an infinite plane object, visible from both sides.
+ */
+struct InfinitePlane {
+    Plane plane;                /// Plane equation, with a normalized normal.
+    TextureType textureType;    /// Texture type.
+    int textureID;              /// Texture ID.
+    int materialID;             /// Material ID.
+};
+
+/**
+ * Represents a quad object, the parallelogram of the points corner + s * u +
+ * t * v with s and t in [0, 1], visible from both sides.
+ */
+struct Quad {
+    Point corner;               /// First corner of the quad.
+    Vector u;                   /// Edge from the corner to the second corner.
+    Vector v;                   /// Edge from the corner to the last corner.
+    TextureType textureType;    /// Texture type.
+    int textureID;              /// Texture ID.
+    int materialID;             /// Material ID.
+};
+
 /**
  * This class stores the world composition: objects, lights, textures, etc...
  * Everything here is constant through the entire execution of the raytracer.
@@ -130,6 +159,20 @@ class World {
     /// Reads the object description from the input.
     void readObjectDescription(std::ifstream &in);
 
+    /**
+     * Reads the optional velocity at the end of the line of an object.
+     * @param rest Rest of the line.
+     * @param velocity Set to the velocity, or to 0 if there is none.
+     */
+    static void readVelocity(const std::string &rest, Vector &velocity);
+
+    /**
+     * Calculates the axis aligned bounding box of the polyhedron from the
+     * vertices of its faces. If the faces don't enclose a finite volume, the
+     * polyhedron is marked as not bounded.
+     */
+    void computePolyhedronBounds(Polyhedron &obj);
+
 public:
     /// Inits the world with the info from the input args.
     World(const CmdArgs &args);
@@ -140,6 +183,8 @@ public:
     std::vector<Material> materials;                /// Material data.
     std::vector<Sphere> spheres;                    /// Sphere objects.
     std::vector<Polyhedron> polyhedrons;            /// Polyhedron objects.
+    std::vector<InfinitePlane> planes;              /// Plane objects.
+    std::vector<Quad> quads;                        /// Quad objects.
 };
 
 #endif // !WORLD_HPP
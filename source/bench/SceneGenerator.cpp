@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SceneGenerator.hpp"
+#include "../PPMImage.hpp"
+#include "../error.hpp"
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+SceneGenerator::SceneGenerator(const std::string &directory)
+        : _directory(directory) {
+    if(!_directory.empty() && _directory.back() != '/')
+        _directory += '/';
+}
+
+std::string SceneGenerator::write(const std::string &name,
+        const std::string &scene) {
+    std::string filename = _directory + name + ".in";
+    std::ofstream out(filename);
+    stop_if(!out.is_open(), "failed to open scene file (%s).",
+            filename.c_str());
+
+    out << scene;
+    return filename;
+}
+
+void SceneGenerator::writeCamera(std::stringstream &scene) {
+    scene << "0 120 -320\n"
+        << "0 20 0\n"
+        << "0 1 0\n"
+        << "40\n";
+}
+
+void SceneGenerator::writeSphere(std::stringstream &scene, int textureID,
+        int materialID, float x, float y, float z, float radius,
+        float emission) {
+    scene << textureID << " " << materialID << " sphere "
+        << x << " " << y << " " << z << " " << radius << " "
+        << emission << " " << emission << " " << emission << "\n";
+}
+
+void SceneGenerator::writeBox(std::stringstream &scene, int textureID,
+        int materialID, float x0, float y0, float z0, float x1, float y1,
+        float z1) {
+    // The inside of each face is where ax + by + cz + d <= 0.
+    scene << textureID << " " << materialID << " polyhedron 6\n"
+        << "1 0 0 " << -x1 << "\n"
+        << "-1 0 0 " << x0 << "\n"
+        << "0 1 0 " << -y1 << "\n"
+        << "0 -1 0 " << y0 << "\n"
+        << "0 0 1 " << -z1 << "\n"
+        << "0 0 -1 " << z0 << "\n";
+}
+
+void SceneGenerator::writePlane(std::stringstream &scene, int textureID,
+        int materialID, float a, float b, float c, float d) {
+    scene << textureID << " " << materialID << " plane "
+        << a << " " << b << " " << c << " " << d << "\n";
+}
+
+void SceneGenerator::writeQuad(std::stringstream &scene, int textureID,
+        int materialID, float x, float y, float z, float ux, float uy,
+        float uz, float vx, float vy, float vz) {
+    scene << textureID << " " << materialID << " quad "
+        << x << " " << y << " " << z << " "
+        << ux << " " << uy << " " << uz << " "
+        << vx << " " << vy << " " << vz << "\n";
+}
+
+std::string SceneGenerator::writeTexture() {
+    const int size = 32;
+    std::vector<uint8_t> rgb(3 * size * size);
+
+    for(int i = 0; i < size; ++i) {
+        for(int j = 0; j < size; ++j) {
+            uint8_t *pixel = &rgb[3 * (size * i + j)];
+            pixel[0] = (uint8_t) (255 * i / size);
+            pixel[1] = (uint8_t) (255 * j / size);
+            pixel[2] = (uint8_t) ((i + j) % 2 ? 200 : 50);
+        }
+    }
+
+    PPMImage::write(_directory + "bench.ppm", rgb.data(), size, size);
+    return "bench.ppm";
+}
+
+void SceneGenerator::gridPosition(int i, int n, float *x, float *z,
+        float *size) {
+    int side = (int) std::ceil(std::sqrt((float) n));
+    *size = 240.0f / side;
+    *x = -120.0f + *size * (i % side + 0.5f);
+    *z = -120.0f + *size * (i / side + 0.5f);
+}
+
+std::string SceneGenerator::spheres(int n) {
+    std::stringstream scene;
+    writeCamera(scene);
+
+    scene << "2\n"
+        << "solid .75 .75 .75\n"
+        << "checker .08 .25 .20 .93 .83 .82 20\n"
+        << "2\n"
+        << "1 0 1 0 0 0\n"
+        << "0.6 0.2 50 0.2 0 0\n"
+        << n + 2 << "\n";
+
+    writeSphere(scene, 1, 0, 0, -1e4f, 0, 1e4f);
+    writeSphere(scene, 0, 0, 0, 400, 0, 100, 12);
+    for(int i = 0; i < n; ++i) {
+        float x, z, size;
+        gridPosition(i, n, &x, &z, &size);
+        writeSphere(scene, 0, i % 2, x, size * 0.4f, z, size * 0.4f);
+    }
+
+    std::stringstream name;
+    name << "spheres-" << n;
+    return write(name.str(), scene.str());
+}
+
+std::string SceneGenerator::polyhedrons(int n) {
+    std::stringstream scene;
+    writeCamera(scene);
+
+    scene << "2\n"
+        << "solid .75 .75 .75\n"
+        << "checker .08 .25 .20 .93 .83 .82 20\n"
+        << "2\n"
+        << "1 0 1 0 0 0\n"
+        << "0.6 0.2 50 0.2 0 0\n"
+        << n + 2 << "\n";
+
+    writeSphere(scene, 1, 0, 0, -1e4f, 0, 1e4f);
+    writeSphere(scene, 0, 0, 0, 400, 0, 100, 12);
+    for(int i = 0; i < n; ++i) {
+        float x, z, size;
+        gridPosition(i, n, &x, &z, &size);
+        float half = size * 0.35f;
+        writeBox(scene, 0, i % 2, x - half, 0, z - half, x + half,
+                2 * half, z + half);
+    }
+
+    std::stringstream name;
+    name << "polyhedrons-" << n;
+    return write(name.str(), scene.str());
+}
+
+std::string SceneGenerator::textures(int n) {
+    std::stringstream scene;
+    writeCamera(scene);
+
+    scene << "3\n"
+        << "solid .75 .75 .75\n"
+        << "checker .08 .25 .20 .93 .83 .82 5\n"
+        << "texmap " << writeTexture() << "\n"
+        << "0.02 0 0 0\n"
+        << "0 0.02 0 0\n"
+        << "1\n"
+        << "1 0 1 0 0 0\n"
+        << n + 2 << "\n";
+
+    writeSphere(scene, 1, 0, 0, -1e4f, 0, 1e4f);
+    writeSphere(scene, 0, 0, 0, 400, 0, 100, 12);
+    for(int i = 0; i < n; ++i) {
+        float x, z, size;
+        gridPosition(i, n, &x, &z, &size);
+        writeSphere(scene, 1 + i % 2, 0, x, size * 0.4f, z, size * 0.4f);
+    }
+
+    std::stringstream name;
+    name << "textures-" << n;
+    return write(name.str(), scene.str());
+}
+
+std::string SceneGenerator::glass(int n) {
+    std::stringstream scene;
+    writeCamera(scene);
+
+    scene << "2\n"
+        << "solid .999 .999 .999\n"
+        << "checker .08 .25 .20 .93 .83 .82 20\n"
+        << "2\n"
+        << "1 0 1 0 0 0\n"
+        << "0 0 1 0.1 0.9 1.5 40\n"
+        << n + 2 << "\n";
+
+    writeSphere(scene, 1, 0, 0, -1e4f, 0, 1e4f);
+    writeSphere(scene, 0, 0, 0, 400, 0, 100, 12);
+    for(int i = 0; i < n; ++i) {
+        float x, z, size;
+        gridPosition(i, n, &x, &z, &size);
+        writeSphere(scene, 0, 1, x, size * 0.4f, z, size * 0.4f);
+    }
+
+    std::stringstream name;
+    name << "glass-" << n;
+    return write(name.str(), scene.str());
+}
+
+std::string SceneGenerator::lights(int n) {
+    std::stringstream scene;
+    writeCamera(scene);
+
+    const int numObjects = 16;
+    scene << "2\n"
+        << "solid .75 .75 .75\n"
+        << "checker .08 .25 .20 .93 .83 .82 20\n"
+        << "1\n"
+        << "1 0 1 0 0 0\n"
+        << numObjects + n + 1 << "\n";
+
+    writeSphere(scene, 1, 0, 0, -1e4f, 0, 1e4f);
+    for(int i = 0; i < numObjects; ++i) {
+        float x, z, size;
+        gridPosition(i, numObjects, &x, &z, &size);
+        writeSphere(scene, 0, 0, x, size * 0.4f, z, size * 0.4f);
+    }
+
+    // The lights float above the objects, with a pseudorandom height and
+    // power, so few of them light most of each point.
+    for(int i = 0; i < n; ++i) {
+        float x, z, size;
+        gridPosition(i, n, &x, &z, &size);
+        float height = 60.0f + 40.0f * (i * 37 % 101) / 100.0f;
+        float emission = 10.0f + 990.0f * (i * 7919 % 97) / 96.0f;
+        writeSphere(scene, 0, 0, x, height, z, size * 0.1f, emission);
+    }
+
+    std::stringstream name;
+    name << "lights-" << n;
+    return write(name.str(), scene.str());
+}
+
+std::string SceneGenerator::cornell(Walls walls, bool glass) {
+    std::stringstream scene;
+
+    scene << "50 46.0397 165.927\n"
+        << "50 45.614 145.936\n"
+        << "0 1 0\n"
+        << "65\n"
+        << "5\n"
+        << "solid .75 .25 .25\n"
+        << "solid .25 .25 .75\n"
+        << "solid .75 .75 .75\n"
+        << "solid 0 0 0\n"
+        << "solid .999 .999 .999\n"
+        << "3\n"
+        << "1 0 500 0 0 0\n"
+        << "0 0 1 1 0 0\n"
+        << "0 0 1 .2 .8 1.5\n"
+        << "9\n";
+
+    // The room spans x in [1, 99], y in [0, 81.6] and z in [0, 170].
+    switch(walls) {
+        case SphereWalls:
+            writeSphere(scene, 0, 0, 1e5f + 1, 40.8f, 81.6f, 1e5f);
+            writeSphere(scene, 1, 0, -1e5f + 99, 40.8f, 81.6f, 1e5f);
+            writeSphere(scene, 2, 0, 50, 40.8f, 1e5f, 1e5f);
+            writeSphere(scene, 3, 0, 50, 40.8f, -1e5f + 170, 1e5f);
+            writeSphere(scene, 2, 0, 50, 1e5f, 81.6f, 1e5f);
+            writeSphere(scene, 2, 0, 50, -1e5f + 81.6f, 81.6f, 1e5f);
+            break;
+        case BoxWalls:
+            writeBox(scene, 0, 0, -10, -10, -10, 1, 92, 180);
+            writeBox(scene, 1, 0, 99, -10, -10, 110, 92, 180);
+            writeBox(scene, 2, 0, -10, -10, -10, 110, 92, 0);
+            writeBox(scene, 3, 0, -10, -10, 170, 110, 92, 180);
+            writeBox(scene, 2, 0, -10, -10, -10, 110, 0, 180);
+            writeBox(scene, 2, 0, -10, 81.6f, -10, 110, 92, 180);
+            break;
+        case PlaneWalls:
+            writePlane(scene, 0, 0, 1, 0, 0, -1);
+            writePlane(scene, 1, 0, 1, 0, 0, -99);
+            writePlane(scene, 2, 0, 0, 0, 1, 0);
+            writePlane(scene, 3, 0, 0, 0, 1, -170);
+            writePlane(scene, 2, 0, 0, 1, 0, 0);
+            writePlane(scene, 2, 0, 0, 1, 0, -81.6f);
+            break;
+        case QuadWalls:
+            writeQuad(scene, 0, 0, 1, 0, 0, 0, 81.6f, 0, 0, 0, 170);
+            writeQuad(scene, 1, 0, 99, 0, 0, 0, 81.6f, 0, 0, 0, 170);
+            writeQuad(scene, 2, 0, 1, 0, 0, 98, 0, 0, 0, 81.6f, 0);
+            writeQuad(scene, 3, 0, 1, 0, 170, 98, 0, 0, 0, 81.6f, 0);
+            writeQuad(scene, 2, 0, 1, 0, 0, 98, 0, 0, 0, 0, 170);
+            writeQuad(scene, 2, 0, 1, 81.6f, 0, 98, 0, 0, 0, 0, 170);
+            break;
+    }
+    writeSphere(scene, 4, glass ? 2 : 1, 27, 16.5f, 47, 16.5f);
+    writeSphere(scene, 4, 2, 73, 16.5f, 78, 16.5f);
+    writeSphere(scene, 3, 0, 50, 681.33f, 81.6f, 600, 12);
+
+    const char *names[] = {"cornell", "cornell-boxes", "cornell-planes",
+        "cornell-quads"};
+    std::string name = names[walls];
+    if(glass)
+        name += "-glass";
+    return write(name, scene.str());
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BENCH_SCENEGENERATOR_HPP
+#define BENCH_SCENEGENERATOR_HPP
+
+#include <string>
+#include <sstream>
+
+/**
+ * Generates scene input files procedurally, for benchmarking.
+ * All the scenes are lit by a single emissive sphere and have their objects
+ * laid out on a grid, so the amount of work grows with the number of objects.
+ */
+class SceneGenerator {
+public:
+    /// How the walls of the Cornell box are modeled.
+    enum Walls {
+        SphereWalls,    /// Huge spheres, as in examples/cornell.in.
+        BoxWalls,       /// Thin polyhedrons.
+        PlaneWalls,     /// Infinite planes.
+        QuadWalls       /// Quads.
+    };
+
+private:
+    std::string _directory;     /// Where the scene files are written.
+
+    /// Writes the scene to <directory>/<name>.in and returns the filename.
+    std::string write(const std::string &name, const std::string &scene);
+
+    /// Writes the camera looking at the origin from the front and above.
+    void writeCamera(std::stringstream &scene);
+
+    /// Writes a sphere object.
+    void writeSphere(std::stringstream &scene, int textureID, int materialID,
+            float x, float y, float z, float radius, float emission = 0.0f);
+
+    /// Writes an axis aligned box as a polyhedron object.
+    void writeBox(std::stringstream &scene, int textureID, int materialID,
+            float x0, float y0, float z0, float x1, float y1, float z1);
+
+    /// Writes an infinite plane object, ax + by + cz + d = 0.
+    void writePlane(std::stringstream &scene, int textureID, int materialID,
+            float a, float b, float c, float d);
+
+    /// Writes a quad object with a corner and two edges.
+    void writeQuad(std::stringstream &scene, int textureID, int materialID,
+            float x, float y, float z, float ux, float uy, float uz,
+            float vx, float vy, float vz);
+
+    /// Writes a 32x32 PPM texture to the directory and returns its name.
+    std::string writeTexture();
+
+    /// Returns the position of the i-th of n objects on the grid and its size.
+    void gridPosition(int i, int n, float *x, float *z, float *size);
+
+public:
+    /// Creates a generator that writes the scenes to the given directory.
+    SceneGenerator(const std::string &directory);
+
+    /// Diffuse and glossy spheres.
+    std::string spheres(int n);
+
+    /// Diffuse and glossy boxes.
+    std::string polyhedrons(int n);
+
+    /// Spheres with checker and map textures.
+    std::string textures(int n);
+
+    /// Transmissive spheres.
+    std::string glass(int n);
+
+    /// Diffuse spheres lit by n small emissive spheres of varied power.
+    std::string lights(int n);
+
+    /**
+     * The Cornell box from examples/cornell.in.
+     * @param walls How the walls are modeled.
+     * @param glass If the mirror sphere is made of glass too.
+     */
+    std::string cornell(Walls walls, bool glass);
+};
+
+#endif // !BENCH_SCENEGENERATOR_HPP
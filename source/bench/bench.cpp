@@ -0,0 +1,1096 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SceneGenerator.hpp"
+#include "../CmdArgs.hpp"
+#include "../clSampler/AccumFormat.hpp"
+#include "../PPMImage.hpp"
+#include "../Sampler.hpp"
+#include "../Screen.hpp"
+#include "../World.hpp"
+#include "../error.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * clTracer benchmark suite.
+ * Renders procedurally generated scenes with warm-up runs and repeats, and
+ * reports the throughput and the time spent on each step of the sampler with
+ * 95% confidence intervals. Optionally compares the renders with and without
+ * the denoiser to reference renders with many more samples, reporting their
+ * SSIM and time, and the accumulation buffer formats to float accumulation,
+ * reporting their memory traffic and error, the Russian roulette policies,
+ * reporting their efficiency, and the renders of the interior scenes with
+ * and without path guiding in the same time, reporting their error, the
+ * ways of sampling the emitters, reporting their error and time, and runs
+ * the microbenchmark of the math functions of the kernels with and without
+ * -fastmath. The results are written as JSON.
+ */
+
+namespace {
+
+/// Benchmark options.
+struct Options {
+    std::string output = "bench.json";  /// JSON output filename.
+    std::string directory = ".";        /// Where the scenes are generated.
+    std::string filter;                 /// Only run scenes with this prefix.
+    int numObjects = 64;                /// Objects in the generated scenes.
+    int width = 320, height = 240;      /// Image size.
+    int numSamples = 4;                 /// Samples per subpixel.
+    int aaLevel = 1;                    /// Anti aliasing level.
+    int warmup = 1;                     /// Runs that are not measured.
+    int repeats = 5;                    /// Measured runs.
+    int referenceSamples = 0;           /// Samples of the quality references.
+    int accumPasses = 0;                /// Passes of the format comparison.
+    int mathIterations = 0;             /// Iterations of the math benchmark.
+    int roulettePasses = 0;             /// Passes of the roulette comparison.
+    int guideSeconds = 0;               /// Time of the guiding comparison.
+    int lightPasses = 0;                /// Passes of the lights comparison.
+    int bdptSeconds = 0;                /// Time of the integrator comparison.
+    int spectralPasses = 0;             /// Passes of the spectral comparison.
+    std::vector<std::string> extra;     /// Extra options for the sampler.
+};
+
+/// Mean of a measurement and the half width of its 95% confidence interval.
+struct Statistic {
+    double mean;
+    double ci95;
+};
+
+/// Measurements of a single configuration.
+struct Result {
+    std::string scene;
+    std::string mode;
+    Statistic compile, upload, kernel, readback;
+    Statistic samplesPerSecond, raysPerSecond;
+};
+
+/// Cost and error of an accumulation format after options.accumPasses.
+struct Precision {
+    std::string scene;
+    std::string format;     /// Value of the -accum option.
+    double traffic;         /// Accumulator bytes read and written, in MB.
+    double time;            /// Kernel time, in ms.
+    double rmse;            /// RMSE relative to the mean of the float render.
+    double maxError;        /// Largest absolute error.
+};
+
+/// Noise and cost of a Russian roulette policy after options.roulettePasses.
+struct Efficiency {
+    std::string scene;
+    std::string roulette;   /// Name of the policy.
+    double time;            /// Kernel time, in ms.
+    double rmse;            /// Estimated RMSE relative to the mean luminance.
+    double efficiency;      /// 1 / (rmse^2 * time), with the time in s.
+};
+
+/// Error of a render with or without path guiding after options.guideSeconds.
+struct Guiding {
+    std::string scene;
+    std::string mode;       /// "bsdf" or "guided".
+    double time;            /// Kernel time, in ms.
+    double rmse;            /// RMSE relative to the mean of the reference.
+};
+
+/// Error of a render with a way of sampling the emitters.
+struct Lighting {
+    std::string scene;
+    std::string mode;       /// Value of the -lights option.
+    double time;            /// Kernel time, in ms.
+    double rmse;            /// Relative RMSE of the radiance clamped to 1.
+};
+
+/// Error of a render with an integrator after options.bdptSeconds.
+struct Integrator {
+    std::string scene;
+    std::string mode;       /// "path", "bdpt" or "sppm".
+    double time;            /// Kernel time, in ms.
+    double rmse;            /// RMSE relative to the mean of the reference.
+};
+
+/// Cost of a render with or without -spectral after options.spectralPasses.
+struct SpectralCost {
+    std::string scene;
+    std::string mode;       /// "rgb" or "spectral".
+    double time;            /// Kernel time, in ms.
+    double mean;            /// Mean of the radiance of the image.
+};
+
+/// Similarity of a render to the reference render of its scene.
+struct Quality {
+    std::string scene;
+    std::string mode;   /// "noisy" or "denoised".
+    double ssim;
+    double time;        /// Kernel, denoiser and readback, in ms.
+};
+
+void printHelpAndQuit(const char *program) {
+    std::cerr << "Usage: " << program << " [options] [-- sampler options]\n"
+        << "Benchmarks clTracer on procedurally generated scenes.\n"
+        << "\nOptions:\n"
+        << "--help\t\tShow help information\n"
+        << "-o <arg>\t\tWrite the JSON results to <arg> (bench.json)\n"
+        << "-d <arg>\t\tGenerate the scenes in directory <arg> (.)\n"
+        << "-scene <arg>\t\tOnly run the scenes whose name starts with <arg>\n"
+        << "-n <arg>\t\tNumber of objects of the generated scenes (64)\n"
+        << "-w <arg>\t\tSet the width of the image to <arg> (320)\n"
+        << "-h <arg>\t\tSet the height of the image to <arg> (240)\n"
+        << "-s <arg>\t\tNumber of samples per pixel (4)\n"
+        << "-aa <arg>\t\tSet the anti aliasing level to <arg> (1)\n"
+        << "-warmup <arg>\t\tNumber of runs that are not measured (1)\n"
+        << "-repeats <arg>\t\tNumber of measured runs (5)\n"
+        << "-ref <arg>\t\tCompare the renders with and without -denoise to "
+        << "references with <arg> samples per pixel (0, disabled)\n"
+        << "-accum <arg>\t\tCompare the accumulation formats to float "
+        << "accumulation after <arg> passes (0, disabled)\n"
+        << "-rr <arg>\t\tCompare the efficiency of the Russian roulette "
+        << "policies after <arg> passes (0, disabled)\n"
+        << "-guide <arg>\t\tCompare the error of the interior scenes with "
+        << "and without path guiding after <arg> seconds (0, disabled)\n"
+        << "-lights <arg>\t\tCompare the error of the ways of sampling the "
+        << "emitters after <arg> passes (0, disabled)\n"
+        << "-bdpt <arg>\t\tCompare the error of the glass scenes with path "
+        << "tracing, bidirectional path tracing and photon mapping after "
+        << "<arg> seconds (0, disabled)\n"
+        << "-spectral <arg>\t\tCompare the kernel time and the mean "
+        << "brightness of the glass scenes in RGB and with -spectral after "
+        << "<arg> passes (0, disabled)\n"
+        << "-math <arg>\t\tBenchmark the math functions of the kernels "
+        << "with <arg> evaluations per work item (0, disabled)\n"
+        << "\nOptions after -- are given to every sampler (e.g. -packet).";
+
+    std::cerr << std::endl;
+    exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+    Options options;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if(arg == "--help")
+            printHelpAndQuit(argv[0]);
+        if(arg == "--") {
+            options.extra.assign(argv + i + 1, argv + argc);
+            break;
+        }
+
+        stop_if(i + 1 >= argc, "missing value of option %s.", arg.c_str());
+        std::string val = argv[++i];
+        int num = (int) strtol(val.c_str(), NULL, 10);
+
+        if(arg == "-o")
+            options.output = val;
+        else if(arg == "-d")
+            options.directory = val;
+        else if(arg == "-scene")
+            options.filter = val;
+        else if(arg == "-n")
+            options.numObjects = num;
+        else if(arg == "-w")
+            options.width = num;
+        else if(arg == "-h")
+            options.height = num;
+        else if(arg == "-s")
+            options.numSamples = num;
+        else if(arg == "-aa")
+            options.aaLevel = num;
+        else if(arg == "-warmup")
+            options.warmup = num;
+        else if(arg == "-repeats")
+            options.repeats = num;
+        else if(arg == "-ref")
+            options.referenceSamples = num;
+        else if(arg == "-accum")
+            options.accumPasses = num;
+        else if(arg == "-rr")
+            options.roulettePasses = num;
+        else if(arg == "-guide")
+            options.guideSeconds = num;
+        else if(arg == "-lights")
+            options.lightPasses = num;
+        else if(arg == "-bdpt")
+            options.bdptSeconds = num;
+        else if(arg == "-spectral")
+            options.spectralPasses = num;
+        else if(arg == "-math")
+            options.mathIterations = num;
+        else
+            stop_if(true, "invalid option (%s).", arg.c_str());
+    }
+
+    stop_if(options.numObjects <= 0 || options.width <= 0
+            || options.height <= 0 || options.numSamples <= 0
+            || options.aaLevel <= 0 || options.warmup < 0
+            || options.repeats <= 0 || options.referenceSamples < 0
+            || options.accumPasses < 0 || options.mathIterations < 0
+            || options.roulettePasses < 0 || options.guideSeconds < 0
+            || options.lightPasses < 0 || options.bdptSeconds < 0
+            || options.spectralPasses < 0,
+            "invalid benchmark options.");
+
+    return options;
+}
+
+/// Two sided 95% quantile of the Student t distribution.
+double studentT95(int degreesOfFreedom) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    if(degreesOfFreedom <= 30)
+        return table[degreesOfFreedom - 1];
+    return 1.96;
+}
+
+Statistic summarize(const std::vector<double> &values) {
+    Statistic stat{0.0, 0.0};
+
+    for(double val : values)
+        stat.mean += val;
+    stat.mean /= values.size();
+
+    if(values.size() > 1) {
+        double variance = 0.0;
+        for(double val : values)
+            variance += (val - stat.mean) * (val - stat.mean);
+        variance /= values.size() - 1;
+
+        stat.ci95 = studentT95(values.size() - 1)
+            * std::sqrt(variance / values.size());
+    }
+
+    return stat;
+}
+
+/**
+ * Returns the command line arguments of a render of the scene.
+ * @param flags Options added before the extra sampler options.
+ */
+CmdArgs makeArgs(const Options &options, const std::string &filename,
+        int numSamples, const std::vector<std::string> &flags) {
+    std::vector<std::string> argStrings = {
+        "clTracer", filename, options.directory + "/bench.ppm",
+        std::to_string(numSamples),
+        "-w", std::to_string(options.width),
+        "-h", std::to_string(options.height),
+        "-aa", std::to_string(options.aaLevel)
+    };
+    argStrings.insert(argStrings.end(), flags.begin(), flags.end());
+    argStrings.insert(argStrings.end(), options.extra.begin(),
+            options.extra.end());
+
+    std::vector<char *> argv;
+    for(auto &arg : argStrings)
+        argv.push_back(&arg[0]);
+
+    return CmdArgs{(int) argv.size(), argv.data()};
+}
+
+/**
+ * Renders the scene options.warmup + options.repeats times and returns the
+ * measurements of the repeats.
+ */
+Result run(const Options &options, const std::string &scene,
+        const std::string &filename, const std::string &mode) {
+    std::vector<std::string> flags;
+    if(mode == "primary")
+        flags.push_back("-primary");
+
+    CmdArgs args = makeArgs(options, filename, options.numSamples, flags);
+    Screen screen{args};
+    World world{args};
+
+    double numSamples = (double) options.width * options.height
+        * options.aaLevel * options.aaLevel * options.numSamples;
+    std::vector<double> compile, upload, kernel, readback, throughput;
+
+    // The sampler prints its progress, which isn't wanted here.
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    for(int i = 0; i < options.warmup + options.repeats; ++i) {
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+
+        if(i < options.warmup)
+            continue;
+
+        const SamplerTimes &times = sampler.times();
+        compile.push_back(times.compile);
+        upload.push_back(times.upload);
+        kernel.push_back(times.kernel);
+        readback.push_back(times.readback);
+        throughput.push_back(numSamples / (times.kernel / 1000.0));
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    Result result;
+    result.scene = scene;
+    result.mode = mode;
+    result.compile = summarize(compile);
+    result.upload = summarize(upload);
+    result.kernel = summarize(kernel);
+    result.readback = summarize(readback);
+
+    // In primary mode every sample is a single ray.
+    Statistic none{0.0, 0.0};
+    result.samplesPerSecond = mode == "path" ? summarize(throughput) : none;
+    result.raysPerSecond = mode == "primary" ? summarize(throughput) : none;
+
+    return result;
+}
+
+/**
+ * Structural similarity of the luma of two 8 bit RGB images, averaged over
+ * 8x8 windows placed every 4 pixels (Wang et al., 2004).
+ */
+double ssim(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b,
+        int width, int height) {
+    const int window = 8, stride = 4;
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+
+    auto luma = [width](const std::vector<uint8_t> &rgb, int x, int y) {
+        const uint8_t *p = &rgb[3 * ((size_t) width * y + x)];
+        return 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+    };
+
+    double sum = 0.0;
+    int numWindows = 0;
+    for(int y = 0; y + window <= height; y += stride) {
+        for(int x = 0; x + window <= width; x += stride) {
+            double meanA = 0.0, meanB = 0.0;
+            double varA = 0.0, varB = 0.0, covariance = 0.0;
+
+            for(int i = 0; i < window; ++i) {
+                for(int j = 0; j < window; ++j) {
+                    meanA += luma(a, x + j, y + i);
+                    meanB += luma(b, x + j, y + i);
+                }
+            }
+            meanA /= window * window;
+            meanB /= window * window;
+
+            for(int i = 0; i < window; ++i) {
+                for(int j = 0; j < window; ++j) {
+                    double da = luma(a, x + j, y + i) - meanA;
+                    double db = luma(b, x + j, y + i) - meanB;
+                    varA += da * da;
+                    varB += db * db;
+                    covariance += da * db;
+                }
+            }
+            varA /= window * window - 1;
+            varB /= window * window - 1;
+            covariance /= window * window - 1;
+
+            sum += (2 * meanA * meanB + c1) * (2 * covariance + c2)
+                / ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+            ++numWindows;
+        }
+    }
+
+    return numWindows ? sum / numWindows : 1.0;
+}
+
+/**
+ * Renders the scene with options.referenceSamples samples, and then with
+ * options.numSamples samples with and without the denoiser, and compares the
+ * two renders to the reference.
+ */
+std::vector<Quality> compare(const Options &options, const std::string &scene,
+        const std::string &filename) {
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    CmdArgs referenceArgs = makeArgs(options, filename,
+            options.referenceSamples, {});
+    Screen screen{referenceArgs};
+    World world{referenceArgs};
+    std::vector<uint8_t> reference =
+        Sampler{world, screen, referenceArgs}.sample();
+
+    std::vector<Quality> qualities;
+    for(const std::string mode : {"noisy", "denoised"}) {
+        std::vector<std::string> flags;
+        if(mode == "denoised")
+            flags.push_back("-denoise");
+
+        CmdArgs args = makeArgs(options, filename, options.numSamples, flags);
+        Sampler sampler{world, screen, args};
+        std::vector<uint8_t> image = sampler.sample();
+
+        const SamplerTimes &times = sampler.times();
+        qualities.push_back(Quality{scene, mode,
+                ssim(image, reference, options.width, options.height),
+                times.kernel + times.denoise + times.readback});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return qualities;
+}
+
+/**
+ * Renders the scene with options.accumPasses passes with every accumulation
+ * format, and compares the averages of the packed formats to the float one.
+ * The passes use the same seeds, so the formats only differ by their
+ * rounding.
+ */
+std::vector<Precision> compareFormats(const Options &options,
+        const std::string &scene, const std::string &filename) {
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    const std::pair<const char *, CmdArgs::AccumFormat> formats[] = {
+        {"float", CmdArgs::FloatAccum}, {"float3", CmdArgs::Float3Accum},
+        {"half", CmdArgs::HalfAccum}, {"rgb9e5", CmdArgs::RGB9E5Accum}
+    };
+
+    std::vector<float> reference;
+    std::vector<Precision> precisions;
+    for(const auto &format : formats) {
+        CmdArgs args = makeArgs(options, filename, options.numSamples,
+                {"-passes", std::to_string(options.accumPasses),
+                "-accum", format.first});
+        Screen screen{args};
+        World world{args};
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+        std::vector<float> image = sampler.radiance();
+        if(reference.empty())
+            reference = image;
+
+        double squaredError = 0.0, maxError = 0.0, mean = 0.0;
+        for(size_t i = 0; i < image.size(); ++i) {
+            double error = std::fabs(image[i] - reference[i]);
+            squaredError += error * error;
+            maxError = std::max(maxError, error);
+            mean += reference[i];
+        }
+        mean /= reference.size();
+
+        // Each pass reads and writes every pixel, except the first, which
+        // only writes them.
+        double numPixels = (double) options.width * options.height;
+        double traffic = accumPixelSize(format.second) * numPixels
+            * (2.0 * options.accumPasses - 1.0) / 1e6;
+
+        precisions.push_back(Precision{scene, format.first, traffic,
+                sampler.times().kernel,
+                std::sqrt(squaredError / image.size()) / std::max(mean, 1e-9),
+                maxError});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return precisions;
+}
+
+/**
+ * Renders the scene with options.roulettePasses passes with each Russian
+ * roulette policy, and returns their efficiency, the inverse of the product
+ * of the variance and the time, from the noise estimated by the sampler.
+ */
+std::vector<Efficiency> compareRoulette(const Options &options,
+        const std::string &scene, const std::string &filename) {
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    const std::pair<const char *, std::vector<std::string>> policies[] = {
+        {"fixed-0.7", {"-roulette", "0.7", "-mindepth", "0"}},
+        {"throughput-0", {"-mindepth", "0"}},
+        {"throughput-3", {"-mindepth", "3"}},
+        {"throughput-5", {"-mindepth", "5"}}
+    };
+
+    std::vector<Efficiency> efficiencies;
+    for(const auto &policy : policies) {
+        std::vector<std::string> flags = {"-passes",
+            std::to_string(options.roulettePasses), "-aov", "variance"};
+        flags.insert(flags.end(), policy.second.begin(), policy.second.end());
+
+        CmdArgs args = makeArgs(options, filename, options.numSamples, flags);
+        Screen screen{args};
+        World world{args};
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+
+        double time = sampler.times().kernel;
+        double rmse = sampler.noise();
+        efficiencies.push_back(Efficiency{scene, policy.first, time, rmse,
+                1.0 / std::max(rmse * rmse * time / 1000.0, 1e-30)});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return efficiencies;
+}
+
+/// Returns the RMSE of the image relative to the mean of the reference.
+double relativeRmse(const std::vector<float> &image,
+        const std::vector<float> &reference) {
+    double squaredError = 0.0, mean = 0.0;
+    for(size_t i = 0; i < image.size(); ++i) {
+        double error = image[i] - reference[i];
+        squaredError += error * error;
+        mean += reference[i];
+    }
+    mean /= reference.size();
+
+    return std::sqrt(squaredError / image.size()) / std::max(mean, 1e-9);
+}
+
+/**
+ * Renders the scene for options.guideSeconds seconds with and without path
+ * guiding, trained on the first GuideTrainingPasses passes, and compares
+ * both to a render without guiding of GuideReferenceScale times as long.
+ */
+std::vector<Guiding> compareGuiding(const Options &options,
+        const std::string &scene, const std::string &filename) {
+    const int GuideTrainingPasses = 4;
+    const int GuideReferenceScale = 16;
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    CmdArgs referenceArgs = makeArgs(options, filename, options.numSamples,
+            {"-timebudget", std::to_string(GuideReferenceScale
+                * options.guideSeconds)});
+    Screen screen{referenceArgs};
+    World world{referenceArgs};
+    Sampler referenceSampler{world, screen, referenceArgs};
+    referenceSampler.sample();
+    std::vector<float> reference = referenceSampler.radiance();
+
+    std::vector<Guiding> guidings;
+    for(const std::string mode : {"bsdf", "guided"}) {
+        std::vector<std::string> flags = {"-timebudget",
+            std::to_string(options.guideSeconds)};
+        if(mode == "guided") {
+            flags.push_back("-guide");
+            flags.push_back(std::to_string(GuideTrainingPasses));
+        }
+
+        CmdArgs args = makeArgs(options, filename, options.numSamples, flags);
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+
+        guidings.push_back(Guiding{scene, mode, sampler.times().kernel,
+                relativeRmse(sampler.radiance(), reference)});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return guidings;
+}
+
+/// Returns the image clamped to [0, 1], as the clamp tonemapper shows it.
+std::vector<float> clampImage(std::vector<float> image) {
+    for(float &value : image)
+        value = std::min(std::max(value, 0.0f), 1.0f);
+    return image;
+}
+
+/**
+ * Renders the scene with options.lightPasses passes with each way of
+ * sampling the emitters, and compares them to a render with the light tree
+ * and LightsReferenceScale times the samples. The emitters seen by the camera
+ * are far brighter than what they light and as noisy in every mode, so the
+ * radiance is clamped to 1 before it's compared.
+ */
+std::vector<Lighting> compareLights(const Options &options,
+        const std::string &scene, const std::string &filename) {
+    const int LightsReferenceScale = 16;
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    std::string passes = std::to_string(options.lightPasses);
+    CmdArgs referenceArgs = makeArgs(options, filename,
+            LightsReferenceScale * options.numSamples,
+            {"-passes", passes, "-lights", "tree"});
+    Screen screen{referenceArgs};
+    World world{referenceArgs};
+    Sampler referenceSampler{world, screen, referenceArgs};
+    referenceSampler.sample();
+    std::vector<float> reference = clampImage(referenceSampler.radiance());
+
+    std::vector<Lighting> lightings;
+    for(const std::string mode : {"none", "uniform", "tree"}) {
+        CmdArgs args = makeArgs(options, filename, options.numSamples,
+                {"-passes", passes, "-lights", mode});
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+
+        lightings.push_back(Lighting{scene, mode, sampler.times().kernel,
+                relativeRmse(clampImage(sampler.radiance()), reference)});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return lightings;
+}
+
+/**
+ * Renders the scene for options.bdptSeconds seconds with path tracing, with
+ * bidirectional path tracing and with SppmPhotons photons per pass of
+ * photon mapping, and compares them to a bidirectional render of
+ * BdptReferenceScale times as long. The reference is unbiased, so the bias
+ * of the photon mapping is part of its error.
+ */
+std::vector<Integrator> compareIntegrators(const Options &options,
+        const std::string &scene, const std::string &filename) {
+    const int BdptReferenceScale = 16;
+    const int SppmPhotons = 1 << 18;
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    CmdArgs referenceArgs = makeArgs(options, filename, options.numSamples,
+            {"-timebudget", std::to_string(BdptReferenceScale
+                * options.bdptSeconds), "-bdpt"});
+    Screen screen{referenceArgs};
+    World world{referenceArgs};
+    Sampler referenceSampler{world, screen, referenceArgs};
+    referenceSampler.sample();
+    std::vector<float> reference = referenceSampler.radiance();
+
+    std::vector<Integrator> integrators;
+    for(const std::string mode : {"path", "bdpt", "sppm"}) {
+        std::vector<std::string> flags = {"-timebudget",
+            std::to_string(options.bdptSeconds)};
+        if(mode == "bdpt")
+            flags.push_back("-bdpt");
+        else if(mode == "sppm")
+            flags.insert(flags.end(), {"-sppm", std::to_string(SppmPhotons)});
+
+        CmdArgs args = makeArgs(options, filename, options.numSamples, flags);
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+
+        integrators.push_back(Integrator{scene, mode, sampler.times().kernel,
+                relativeRmse(sampler.radiance(), reference)});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return integrators;
+}
+
+/// Returns the mean of the values of the image.
+double imageMean(const std::vector<float> &image) {
+    double sum = 0.0;
+    for(float value : image)
+        sum += value;
+    return sum / std::max(image.size(), (size_t) 1);
+}
+
+/**
+ * Renders the scene for options.spectralPasses passes in RGB and with the
+ * 4 wavelengths of -spectral, which refract apart in its dispersive glass.
+ * Both must converge to the same brightness, with or without dispersion.
+ */
+std::vector<SpectralCost> compareSpectral(const Options &options,
+        const std::string &scene, const std::string &filename) {
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    std::string passes = std::to_string(options.spectralPasses);
+    std::vector<SpectralCost> costs;
+    for(const std::string mode : {"rgb", "spectral"}) {
+        std::vector<std::string> flags = {"-passes", passes};
+        if(mode == "spectral")
+            flags.push_back("-spectral");
+
+        CmdArgs args = makeArgs(options, filename, options.numSamples, flags);
+        Screen screen{args};
+        World world{args};
+        Sampler sampler{world, screen, args};
+        sampler.sample();
+
+        costs.push_back(SpectralCost{scene, mode, sampler.times().kernel,
+                imageMean(sampler.radiance())});
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return costs;
+}
+
+/**
+ * Runs the math microbenchmark with options.mathIterations iterations on the
+ * device of a sampler of the scene.
+ */
+std::vector<MathBenchmark> benchmarkMath(const Options &options,
+        const std::string &filename) {
+    std::streambuf *coutBuffer = std::cout.rdbuf(NULL);
+
+    CmdArgs args = makeArgs(options, filename, options.numSamples, {});
+    Screen screen{args};
+    World world{args};
+    std::vector<MathBenchmark> benchmarks =
+        Sampler{world, screen, args}.benchmarkMath(options.mathIterations);
+
+    std::cout.rdbuf(coutBuffer);
+    std::cout.clear();
+
+    return benchmarks;
+}
+
+void writeStatistic(std::ostream &out, const std::string &name,
+        const Statistic &stat, bool last = false) {
+    out << "      \"" << name << "\": { \"mean\": " << stat.mean
+        << ", \"ci95\": " << stat.ci95 << " }" << (last ? "\n" : ",\n");
+}
+
+void writeJSON(const Options &options, const std::vector<Result> &results,
+        const std::vector<Quality> &qualities,
+        const std::vector<Precision> &precisions,
+        const std::vector<Efficiency> &efficiencies,
+        const std::vector<Guiding> &guidings,
+        const std::vector<Lighting> &lightings,
+        const std::vector<Integrator> &integrators,
+        const std::vector<SpectralCost> &costs,
+        const std::vector<MathBenchmark> &benchmarks) {
+    std::ofstream out(options.output);
+    stop_if(!out.is_open(), "failed to open output file (%s).",
+            options.output.c_str());
+
+    out << "{\n"
+        << "  \"width\": " << options.width << ",\n"
+        << "  \"height\": " << options.height << ",\n"
+        << "  \"samples\": " << options.numSamples << ",\n"
+        << "  \"aa\": " << options.aaLevel << ",\n"
+        << "  \"objects\": " << options.numObjects << ",\n"
+        << "  \"warmup\": " << options.warmup << ",\n"
+        << "  \"repeats\": " << options.repeats << ",\n"
+        << "  \"reference_samples\": " << options.referenceSamples << ",\n"
+        << "  \"accum_passes\": " << options.accumPasses << ",\n"
+        << "  \"roulette_passes\": " << options.roulettePasses << ",\n"
+        << "  \"guide_seconds\": " << options.guideSeconds << ",\n"
+        << "  \"light_passes\": " << options.lightPasses << ",\n"
+        << "  \"bdpt_seconds\": " << options.bdptSeconds << ",\n"
+        << "  \"spectral_passes\": " << options.spectralPasses << ",\n"
+        << "  \"math_iterations\": " << options.mathIterations << ",\n"
+        << "  \"sampler_options\": \"";
+    for(size_t i = 0; i < options.extra.size(); ++i)
+        out << (i ? " " : "") << options.extra[i];
+    out << "\",\n"
+        << "  \"results\": [\n";
+
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        out << "    {\n"
+            << "      \"scene\": \"" << result.scene << "\",\n"
+            << "      \"mode\": \"" << result.mode << "\",\n";
+        writeStatistic(out, "compile_ms", result.compile);
+        writeStatistic(out, "upload_ms", result.upload);
+        writeStatistic(out, "kernel_ms", result.kernel);
+        writeStatistic(out, "readback_ms", result.readback);
+        writeStatistic(out, "samples_per_s", result.samplesPerSecond);
+        writeStatistic(out, "rays_per_s", result.raysPerSecond, true);
+        out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"quality\": [\n";
+
+    for(size_t i = 0; i < qualities.size(); ++i) {
+        const Quality &quality = qualities[i];
+        out << "    { \"scene\": \"" << quality.scene << "\", \"mode\": \""
+            << quality.mode << "\", \"ssim\": " << quality.ssim
+            << ", \"time_ms\": " << quality.time << " }"
+            << (i + 1 < qualities.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"accumulation\": [\n";
+
+    for(size_t i = 0; i < precisions.size(); ++i) {
+        const Precision &precision = precisions[i];
+        out << "    { \"scene\": \"" << precision.scene
+            << "\", \"format\": \"" << precision.format
+            << "\", \"traffic_mb\": " << precision.traffic
+            << ", \"kernel_ms\": " << precision.time
+            << ", \"relative_rmse\": " << precision.rmse
+            << ", \"max_error\": " << precision.maxError << " }"
+            << (i + 1 < precisions.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"roulette\": [\n";
+
+    for(size_t i = 0; i < efficiencies.size(); ++i) {
+        const Efficiency &efficiency = efficiencies[i];
+        out << "    { \"scene\": \"" << efficiency.scene
+            << "\", \"policy\": \"" << efficiency.roulette
+            << "\", \"kernel_ms\": " << efficiency.time
+            << ", \"relative_rmse\": " << efficiency.rmse
+            << ", \"efficiency\": " << efficiency.efficiency << " }"
+            << (i + 1 < efficiencies.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"guiding\": [\n";
+
+    for(size_t i = 0; i < guidings.size(); ++i) {
+        const Guiding &guiding = guidings[i];
+        out << "    { \"scene\": \"" << guiding.scene
+            << "\", \"mode\": \"" << guiding.mode
+            << "\", \"kernel_ms\": " << guiding.time
+            << ", \"relative_rmse\": " << guiding.rmse << " }"
+            << (i + 1 < guidings.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"lights\": [\n";
+
+    for(size_t i = 0; i < lightings.size(); ++i) {
+        const Lighting &lighting = lightings[i];
+        out << "    { \"scene\": \"" << lighting.scene
+            << "\", \"mode\": \"" << lighting.mode
+            << "\", \"kernel_ms\": " << lighting.time
+            << ", \"relative_rmse\": " << lighting.rmse << " }"
+            << (i + 1 < lightings.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"bidirectional\": [\n";
+
+    for(size_t i = 0; i < integrators.size(); ++i) {
+        const Integrator &integrator = integrators[i];
+        out << "    { \"scene\": \"" << integrator.scene
+            << "\", \"mode\": \"" << integrator.mode
+            << "\", \"kernel_ms\": " << integrator.time
+            << ", \"relative_rmse\": " << integrator.rmse << " }"
+            << (i + 1 < integrators.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"spectral\": [\n";
+
+    for(size_t i = 0; i < costs.size(); ++i) {
+        const SpectralCost &cost = costs[i];
+        out << "    { \"scene\": \"" << cost.scene
+            << "\", \"mode\": \"" << cost.mode
+            << "\", \"kernel_ms\": " << cost.time
+            << ", \"mean\": " << cost.mean << " }"
+            << (i + 1 < costs.size() ? ",\n" : "\n");
+    }
+
+    out << "  ],\n"
+        << "  \"math\": [\n";
+
+    for(size_t i = 0; i < benchmarks.size(); ++i) {
+        const MathBenchmark &benchmark = benchmarks[i];
+        out << "    { \"function\": \"" << benchmark.function
+            << "\", \"fast_math\": "
+            << (benchmark.fastMath ? "true" : "false")
+            << ", \"ns_per_eval\": " << benchmark.time
+            << ", \"max_abs_error\": " << benchmark.maxAbsError
+            << ", \"max_rel_error\": " << benchmark.maxRelError << " }"
+            << (i + 1 < benchmarks.size() ? ",\n" : "\n");
+    }
+
+    out << "  ]\n"
+        << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    // Largest relative difference of the mean of a spectral render of the
+    // glass scenes from the RGB one. It covers the noise of a few passes.
+    const double SpectralMeanTolerance = 0.05;
+
+    std::ios_base::sync_with_stdio(false);
+
+    Options options = parseOptions(argc, argv);
+    SceneGenerator generator{options.directory};
+    int n = options.numObjects;
+
+    std::vector<std::pair<std::string, std::function<std::string()>>> scenes = {
+        {"spheres", [&] { return generator.spheres(n); }},
+        {"polyhedrons", [&] { return generator.polyhedrons(n); }},
+        {"textures", [&] { return generator.textures(n); }},
+        {"glass", [&] { return generator.glass(n); }},
+        {"lights", [&] { return generator.lights(16 * n); }},
+        {"cornell", [&] {
+            return generator.cornell(SceneGenerator::SphereWalls, false); }},
+        {"cornell-glass", [&] {
+            return generator.cornell(SceneGenerator::SphereWalls, true); }},
+        {"cornell-boxes", [&] {
+            return generator.cornell(SceneGenerator::BoxWalls, false); }},
+        {"cornell-planes", [&] {
+            return generator.cornell(SceneGenerator::PlaneWalls, false); }},
+        {"cornell-quads", [&] {
+            return generator.cornell(SceneGenerator::QuadWalls, false); }}
+    };
+
+    std::vector<Result> results;
+    std::vector<Quality> qualities;
+    std::vector<Precision> precisions;
+    std::vector<Efficiency> efficiencies;
+    std::vector<Guiding> guidings;
+    std::vector<Lighting> lightings;
+    std::vector<Integrator> integrators;
+    std::vector<SpectralCost> costs;
+    std::vector<MathBenchmark> benchmarks;
+    bool brightnessMismatch = false;
+    for(const auto &scene : scenes) {
+        if(scene.first.compare(0, options.filter.size(), options.filter))
+            continue;
+
+        std::string filename = scene.second();
+        for(const std::string mode : {"path", "primary"}) {
+            Result result = run(options, scene.first, filename, mode);
+
+            std::cerr << scene.first << " (" << mode << "): kernel "
+                << result.kernel.mean << " +- " << result.kernel.ci95
+                << " ms, compile " << result.compile.mean << " +- "
+                << result.compile.ci95 << " ms, upload " << result.upload.mean
+                << " +- " << result.upload.ci95 << " ms, ";
+            if(mode == "path")
+                std::cerr << result.samplesPerSecond.mean / 1e6 << " +- "
+                    << result.samplesPerSecond.ci95 / 1e6 << " Msamples/s";
+            else
+                std::cerr << result.raysPerSecond.mean / 1e6 << " +- "
+                    << result.raysPerSecond.ci95 / 1e6 << " Mrays/s";
+            std::cerr << std::endl;
+
+            results.push_back(result);
+        }
+
+        if(options.referenceSamples) {
+            for(const Quality &quality : compare(options, scene.first,
+                        filename)) {
+                std::cerr << scene.first << " (" << quality.mode << "): SSIM "
+                    << quality.ssim << ", " << quality.time << " ms"
+                    << std::endl;
+                qualities.push_back(quality);
+            }
+        }
+
+        if(options.accumPasses) {
+            for(const Precision &precision : compareFormats(options,
+                        scene.first, filename)) {
+                std::cerr << scene.first << " (" << precision.format
+                    << " accumulator): " << precision.traffic << " MB, "
+                    << precision.time << " ms, relative RMSE "
+                    << precision.rmse << ", max error "
+                    << precision.maxError << std::endl;
+                precisions.push_back(precision);
+            }
+        }
+
+        if(options.roulettePasses) {
+            for(const Efficiency &efficiency : compareRoulette(options,
+                        scene.first, filename)) {
+                std::cerr << scene.first << " (" << efficiency.roulette
+                    << " roulette): " << efficiency.time
+                    << " ms, relative RMSE " << efficiency.rmse
+                    << ", efficiency " << efficiency.efficiency << std::endl;
+                efficiencies.push_back(efficiency);
+            }
+        }
+
+        // Path guiding is meant for the interior scenes, lit indirectly.
+        if(options.guideSeconds && !scene.first.compare(0, 7, "cornell")) {
+            for(const Guiding &guiding : compareGuiding(options, scene.first,
+                        filename)) {
+                std::cerr << scene.first << " (" << guiding.mode << "): "
+                    << guiding.time << " ms, relative RMSE " << guiding.rmse
+                    << std::endl;
+                guidings.push_back(guiding);
+            }
+        }
+
+        if(options.lightPasses) {
+            for(const Lighting &lighting : compareLights(options, scene.first,
+                        filename)) {
+                std::cerr << scene.first << " (" << lighting.mode
+                    << " lights): " << lighting.time << " ms, relative RMSE "
+                    << lighting.rmse << std::endl;
+                lightings.push_back(lighting);
+            }
+        }
+
+        // The caustics of the glass scenes are what the light tracing finds.
+        if(options.bdptSeconds
+                && scene.first.find("glass") != std::string::npos) {
+            for(const Integrator &integrator : compareIntegrators(options,
+                        scene.first, filename)) {
+                std::cerr << scene.first << " (" << integrator.mode << "): "
+                    << integrator.time << " ms, relative RMSE "
+                    << integrator.rmse << std::endl;
+                integrators.push_back(integrator);
+            }
+        }
+        if(options.spectralPasses
+                && scene.first.find("glass") != std::string::npos) {
+            std::vector<SpectralCost> sceneCosts = compareSpectral(options,
+                    scene.first, filename);
+            double rgbMean = sceneCosts.front().mean;
+            for(const SpectralCost &cost : sceneCosts) {
+                double difference = cost.mean / std::max(rgbMean, 1e-9) - 1.0;
+                std::cerr << scene.first << " (" << cost.mode << "): "
+                    << cost.time << " ms, mean " << cost.mean << " ("
+                    << 100.0 * difference << "% from RGB)" << std::endl;
+                costs.push_back(cost);
+
+                if(std::fabs(difference) > SpectralMeanTolerance) {
+                    std::cerr << scene.first << ": the spectral brightness "
+                        << "doesn't match the RGB one" << std::endl;
+                    brightnessMismatch = true;
+                }
+            }
+        }
+
+        // The math functions don't depend on the scene.
+        if(options.mathIterations && benchmarks.empty()) {
+            benchmarks = benchmarkMath(options, filename);
+            for(const MathBenchmark &benchmark : benchmarks) {
+                std::cerr << benchmark.function
+                    << (benchmark.fastMath ? " (fast math): " : ": ")
+                    << benchmark.time << " ns, max error "
+                    << benchmark.maxAbsError << ", max relative error "
+                    << benchmark.maxRelError << std::endl;
+            }
+        }
+    }
+
+    writeJSON(options, results, qualities, precisions, efficiencies, guidings,
+            lightings, integrators, costs, benchmarks);
+
+    // A spectral render brighter or darker than the RGB one is a bug of the
+    // spectral mode, so it fails the benchmark.
+    return brightnessMismatch ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "AccumFormat.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+/// Reads the value of type T at index i of the buffer.
+template <typename T>
+T load(const std::vector<uint8_t> &data, size_t i) {
+    T value;
+    memcpy(&value, &data[i * sizeof(T)], sizeof(T));
+    return value;
+}
+
+} // namespace
+
+size_t accumPixelSize(CmdArgs::AccumFormat format) {
+    switch(format) {
+    case CmdArgs::Float3Accum:
+        return 3 * sizeof(float);
+    case CmdArgs::HalfAccum:
+        return 4 * sizeof(uint16_t);
+    case CmdArgs::RGB9E5Accum:
+        return sizeof(uint32_t);
+    default:
+        return 4 * sizeof(float);
+    }
+}
+
+size_t aovValueSize(CmdArgs::AccumFormat format) {
+    return format == CmdArgs::HalfAccum ? sizeof(uint16_t) : sizeof(float);
+}
+
+float halfToFloat(uint16_t half) {
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    float sign = half & 0x8000 ? -1.0f : 1.0f;
+
+    if(exponent == 0)
+        return sign * std::ldexp((float) mantissa, -24);
+    if(exponent == 0x1f)
+        return mantissa ? NAN : sign * INFINITY;
+    return sign * std::ldexp((float) (mantissa | 0x400), exponent - 25);
+}
+
+std::vector<float> decodeAccum(CmdArgs::AccumFormat format,
+        const std::vector<uint8_t> &data, size_t numPixels, int numPasses) {
+    std::vector<float> rgb(3 * numPixels);
+
+    for(size_t i = 0; i < numPixels; ++i) {
+        float *out = &rgb[3 * i];
+        switch(format) {
+        case CmdArgs::FloatAccum:
+        case CmdArgs::Float3Accum: {
+            size_t stride = format == CmdArgs::FloatAccum ? 4 : 3;
+            for(int c = 0; c < 3; ++c)
+                out[c] = load<float>(data, stride * i + c) / numPasses;
+            break;
+        }
+        case CmdArgs::HalfAccum:
+            for(int c = 0; c < 3; ++c)
+                out[c] = halfToFloat(load<uint16_t>(data, 4 * i + c));
+            break;
+        case CmdArgs::RGB9E5Accum: {
+            uint32_t packed = load<uint32_t>(data, i);
+            float scale = std::ldexp(1.0f, (int) (packed >> 27) - 24);
+            for(int c = 0; c < 3; ++c)
+                out[c] = ((packed >> (9 * c)) & 511) * scale;
+            break;
+        }
+        }
+    }
+
+    return rgb;
+}
+
+std::vector<float> decodeAov(CmdArgs::AccumFormat format,
+        const std::vector<uint8_t> &data, int channel, size_t numPixels,
+        int numPasses) {
+    std::vector<float> values(numPixels);
+
+    // Half channels already hold the average of the passes.
+    size_t begin = channel * numPixels;
+    for(size_t i = 0; i < numPixels; ++i) {
+        if(format == CmdArgs::HalfAccum)
+            values[i] = halfToFloat(load<uint16_t>(data, begin + i));
+        else if(numPasses)
+            values[i] = load<float>(data, begin + i) / numPasses;
+        else
+            values[i] = load<float>(data, begin + i);
+    }
+
+    return values;
+}
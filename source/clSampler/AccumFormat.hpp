@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef ACCUMFORMAT_HPP
+#define ACCUMFORMAT_HPP
+
+#include "../CmdArgs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Host side of the accumulation buffer formats of accum.cl and aov.cl.
+ */
+
+/// Returns the bytes per pixel of a radiance accumulator of the format.
+size_t accumPixelSize(CmdArgs::AccumFormat format);
+
+/// Returns the bytes per value of an AOV framebuffer of the format.
+size_t aovValueSize(CmdArgs::AccumFormat format);
+
+/// Converts an IEEE 754 half to float.
+float halfToFloat(uint16_t half);
+
+/**
+ * Returns the average of the passes of a radiance accumulator, as 3 floats
+ * per pixel.
+ * @param data Contents of the accumulator.
+ * @param numPasses Number of passes in the accumulator.
+ */
+std::vector<float> decodeAccum(CmdArgs::AccumFormat format,
+        const std::vector<uint8_t> &data, size_t numPixels, int numPasses);
+
+/**
+ * Returns a channel of an AOV framebuffer.
+ * @param data Contents of the framebuffer.
+ * @param numPasses Number of passes in the framebuffer, or 0 to return the
+ * values as stored (e.g. the IDs).
+ */
+std::vector<float> decodeAov(CmdArgs::AccumFormat format,
+        const std::vector<uint8_t> &data, int channel, size_t numPixels,
+        int numPasses);
+
+#endif // !ACCUMFORMAT_HPP
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "AovLayout.hpp"
+
+AovLayout::AovLayout(const CmdArgs &args)
+        : _aovs{args.aovs()}, _channels{}, _numChannels{0} {
+    if(args.denoise())
+        _aovs |= CmdArgs::AlbedoAov | CmdArgs::NormalAov | CmdArgs::DepthAov;
+    if(args.targetRmse() > 0.0f)
+        _aovs |= CmdArgs::VarianceAov;
+
+    for(int i = 0; i < CmdArgs::NumAovs; ++i) {
+        if(!has(1 << i))
+            continue;
+        _channels[i] = _numChannels;
+        _numChannels += size(1 << i);
+    }
+}
+
+int AovLayout::channel(int aov) const {
+    for(int i = 0; i < CmdArgs::NumAovs; ++i)
+        if(aov == 1 << i)
+            return _channels[i];
+    return -1;
+}
+
+int AovLayout::size(int aov) {
+    switch(aov) {
+    case CmdArgs::AlbedoAov:
+    case CmdArgs::NormalAov:
+        return 3;
+    case CmdArgs::IDAov:
+        return 2;
+    default:
+        return 1;
+    }
+}
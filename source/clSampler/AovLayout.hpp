@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AOVLAYOUT_HPP
+#define AOVLAYOUT_HPP
+
+#include "../CmdArgs.hpp"
+
+/**
+ * Channels of the AOV framebuffer. Each enabled AOV takes consecutive planes
+ * of width * height floats, in the order of the CmdArgs::Aov flags.
+ */
+class AovLayout {
+    int _aovs;                          /// Enabled CmdArgs::Aov flags.
+    int _channels[CmdArgs::NumAovs];    /// First channel of each AOV.
+    int _numChannels;
+
+public:
+    /**
+     * Enables the AOVs of args.aovs(), plus the albedo, normal and depth
+     * used by the denoiser if args.denoise() and the variance used to
+     * estimate the noise if args.targetRmse().
+     */
+    explicit AovLayout(const CmdArgs &args);
+
+    /// Returns if the CmdArgs::Aov aov is written to the framebuffer.
+    inline bool has(int aov) const {
+        return _aovs & aov;
+    }
+
+    /// Returns the first channel of the enabled CmdArgs::Aov aov.
+    int channel(int aov) const;
+
+    /// Returns the number of float channels of each pixel.
+    inline int numChannels() const {
+        return _numChannels;
+    }
+
+    /// Returns the number of channels of the CmdArgs::Aov aov.
+    static int size(int aov);
+};
+
+#endif // !AOVLAYOUT_HPP
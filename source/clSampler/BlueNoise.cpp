@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "BlueNoise.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+/**
+ * Binary pattern with the energy of each pixel, the sum of a gaussian
+ * centered at every set pixel. The mask wraps around at the borders.
+ */
+class Pattern {
+    int _size;
+    std::vector<float> _kernel;    /// Gaussian by the distance in x and y.
+    std::vector<float> _energy;
+    std::vector<bool> _set;
+
+public:
+    Pattern(int size)
+            : _size{size}, _kernel(size * size), _energy(size * size, 0.0f),
+            _set(size * size, false) {
+        const float sigma = 1.5f;
+        for(int y = 0; y < size; ++y) {
+            for(int x = 0; x < size; ++x) {
+                int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                _kernel[y * size + x] = std::exp(-(dx * dx + dy * dy)
+                        / (2.0f * sigma * sigma));
+            }
+        }
+    }
+
+    inline bool isSet(int i) const {
+        return _set[i];
+    }
+
+    /// Sets or clears the pixel and updates the energy.
+    void change(int i, bool set) {
+        float sign = set ? 1.0f : -1.0f;
+        int px = i % _size, py = i / _size;
+
+        _set[i] = set;
+        for(int y = 0; y < _size; ++y) {
+            int ky = (y - py + _size) % _size;
+            for(int x = 0; x < _size; ++x) {
+                int kx = (x - px + _size) % _size;
+                _energy[y * _size + x] += sign * _kernel[ky * _size + kx];
+            }
+        }
+    }
+
+    /// Set pixel with the highest energy.
+    int tightestCluster() const {
+        int best = -1;
+        for(size_t i = 0; i < _set.size(); ++i)
+            if(_set[i] && (best < 0 || _energy[i] > _energy[best]))
+                best = i;
+        return best;
+    }
+
+    /// Clear pixel with the lowest energy.
+    int largestVoid() const {
+        int best = -1;
+        for(size_t i = 0; i < _set.size(); ++i)
+            if(!_set[i] && (best < 0 || _energy[i] < _energy[best]))
+                best = i;
+        return best;
+    }
+};
+
+} // namespace
+
+std::vector<uint8_t> generateBlueNoise(int size) {
+    int numPixels = size * size;
+    std::vector<int> rank(numPixels);
+    Pattern pattern{size};
+
+    // Start from a tenth of the pixels set at random.
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<int> pixel{0, numPixels - 1};
+    int numSet = 0;
+    while(numSet < numPixels / 10) {
+        int i = pixel(rng);
+        if(!pattern.isSet(i)) {
+            pattern.change(i, true);
+            ++numSet;
+        }
+    }
+
+    // Move the pixel of the tightest cluster to the largest void until they
+    // are the same pixel, which spreads the pattern evenly.
+    while(true) {
+        int cluster = pattern.tightestCluster();
+        pattern.change(cluster, false);
+        int largestVoid = pattern.largestVoid();
+        pattern.change(largestVoid, true);
+        if(largestVoid == cluster)
+            break;
+    }
+    Pattern initial = pattern;
+
+    // The pixels of the initial pattern are ranked by removing the tightest
+    // clusters, and the other pixels by filling the largest voids.
+    for(int r = numSet - 1; r >= 0; --r) {
+        int cluster = pattern.tightestCluster();
+        pattern.change(cluster, false);
+        rank[cluster] = r;
+    }
+    for(int r = numSet; r < numPixels; ++r) {
+        int largestVoid = initial.largestVoid();
+        initial.change(largestVoid, true);
+        rank[largestVoid] = r;
+    }
+
+    std::vector<uint8_t> mask(numPixels);
+    for(int i = 0; i < numPixels; ++i)
+        mask[i] = (uint8_t) ((long) rank[i] * 256 / numPixels);
+    return mask;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Checkpoint.hpp"
+#include "../Profiler.hpp"
+#include "../error.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+/// Identifies the checkpoint files and their version.
+const char Magic[8] = {'c', 'l', 'T', 'c', 'k', 'p', 't', '1'};
+
+/// Fixed size part of the file, stored in the byte order of the host.
+struct Header {
+    char magic[8];
+    uint64_t configHash;
+    int32_t width, height;
+    uint32_t passIndex;
+    uint32_t padding;
+    uint64_t accumSize, aovSize;
+};
+
+/// Flushes the file to the disk, returning false on failure.
+bool syncFile(FILE *file) {
+    if(fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+/**
+ * Replaces the file by the source file, which is renamed to it, so that a
+ * reader sees either the old or the new file. Returns false on failure.
+ */
+bool replaceFile(const std::string &source, const std::string &filename) {
+#ifdef _WIN32
+    // rename() fails on Windows if the file exists.
+    return MoveFileExA(source.c_str(), filename.c_str(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(source.c_str(), filename.c_str()) == 0;
+#endif
+}
+
+} // namespace
+
+void Checkpoint::writeTo(const std::string &filename) const {
+    ScopedTimer timer{"Checkpoint::writeTo"};
+
+    Header header = {};
+    std::copy(Magic, Magic + sizeof(Magic), header.magic);
+    header.configHash = configHash;
+    header.width = width;
+    header.height = height;
+    header.passIndex = passIndex;
+    header.accumSize = accum.size();
+    header.aovSize = aovs.size();
+
+    std::string tmpFilename = filename + ".tmp";
+    FILE *file = fopen(tmpFilename.c_str(), "wb");
+    stop_if(!file, "failed to open checkpoint file (%s).",
+            tmpFilename.c_str());
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(accum.data(), 1, accum.size(), file) == accum.size()
+        && fwrite(aovs.data(), 1, aovs.size(), file) == aovs.size()
+        && syncFile(file);
+    ok = fclose(file) == 0 && ok;
+    stop_if(!ok, "failed to write checkpoint file (%s).",
+            tmpFilename.c_str());
+
+    stop_if(!replaceFile(tmpFilename, filename),
+            "failed to rename checkpoint file to %s.", filename.c_str());
+}
+
+bool Checkpoint::readFrom(const std::string &filename) {
+    ScopedTimer timer{"Checkpoint::readFrom"};
+
+    std::ifstream file(filename, std::ios::binary);
+    if(!file.is_open())
+        return false;
+
+    Header header;
+    bool ok = (bool) file.read((char *) &header, sizeof(header))
+        && std::equal(Magic, Magic + sizeof(Magic), header.magic);
+
+    // The sizes must add up to the rest of the file before anything is
+    // allocated from them, so that a corrupt header fails cleanly.
+    if(ok) {
+        std::streamoff begin = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff end = file.tellg();
+        file.seekg(begin);
+        ok = file && begin >= 0 && end >= begin;
+        uint64_t remaining = ok ? (uint64_t) (end - begin) : 0;
+        ok = ok && header.accumSize <= remaining
+            && header.aovSize == remaining - header.accumSize;
+    }
+    if(ok) {
+        configHash = header.configHash;
+        width = header.width;
+        height = header.height;
+        passIndex = header.passIndex;
+        accum.resize(header.accumSize);
+        aovs.resize(header.aovSize);
+        ok = file.read((char *) accum.data(), accum.size())
+            && file.read((char *) aovs.data(), aovs.size());
+    }
+    stop_if(!ok, "invalid checkpoint file (%s).", filename.c_str());
+
+    return true;
+}
+
+uint64_t Checkpoint::hash(const void *data, size_t size, uint64_t hash) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
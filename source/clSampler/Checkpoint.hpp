@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Accumulated state of a progressive render, saved so that the render can
+ * resume after the process dies. The RNG streams of a pass only depend on
+ * its index, so resuming at passIndex continues the render bit for bit.
+ */
+struct Checkpoint {
+    uint64_t configHash;    /// Hash of the program and the camera.
+    int32_t width, height;
+    uint32_t passIndex;     /// Passes in the buffers, i.e. the next pass.
+    std::vector<uint8_t> accum;     /// Contents of the accumulator.
+    std::vector<uint8_t> aovs;      /// Contents of the AOV framebuffer.
+
+    /**
+     * Writes the checkpoint to a temporary file and renames it to filename,
+     * so a crash never leaves a partial checkpoint behind.
+     */
+    void writeTo(const std::string &filename) const;
+
+    /**
+     * Reads the checkpoint written to filename.
+     * @return If the file exists. Stops if it isn't a valid checkpoint.
+     */
+    bool readFrom(const std::string &filename);
+
+    /// 64 bit FNV-1a hash of the data, continuing from hash.
+    static uint64_t hash(const void *data, size_t size,
+            uint64_t hash = 14695981039346656037ull);
+};
+
+#endif // !CHECKPOINT_HPP
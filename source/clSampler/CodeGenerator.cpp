@@ -21,7 +21,9 @@
  */
 
 #include "CodeGenerator.hpp"
+#include "AovLayout.hpp"
 #include "../error.hpp"
+#include <cmath>
 #include <sstream>
 
 std::string CodeGenerator::generateStructures(const World &world) {
@@ -50,15 +52,6 @@ std::string CodeGenerator::generateStructures(const World &world) {
         "    int height;\n"
         "} MapTexture;\n"
         "\n"
-        "typedef struct Material {\n"
-        "    float diffuseCoef;\n"
-        "    float specularCoef;\n"
-        "    float specularExp;\n"
-        "    float reflectionCoef;\n"
-        "    float transmissionCoef;\n"
-        "    float refractionRate;\n"
-        "} Material;\n"
-        "\n"
         "typedef struct Sphere {\n"
         "    float4 emission;\n"
         "    float4 center;\n"
@@ -68,26 +61,159 @@ std::string CodeGenerator::generateStructures(const World &world) {
         "    int materialID;\n"
         "} Sphere;\n"
         "\n"
+        "typedef struct FaceGroup {\n"
+        "    float4 a;\n"
+        "    float4 b;\n"
+        "    float4 c;\n"
+        "    float4 d;\n"
+        "} FaceGroup;\n"
+        "\n"
         "typedef struct Polyhedron {\n"
-        "    int numFaces;\n"
-        "    int facesBegin;\n"
+        "    float4 boundsMin;\n"
+        "    float4 boundsMax;\n"
+        "    int bounded;\n"
+        "    int numFaceGroups;\n"
+        "    int faceGroupsBegin;\n"
         "    TextureType textureType;\n"
         "    int textureID;\n"
         "    int materialID;\n"
         "} Polyhedron;\n"
         "\n"
+        "typedef struct InfinitePlane {\n"
+        "    float4 plane;\n"
+        "    TextureType textureType;\n"
+        "    int textureID;\n"
+        "    int materialID;\n"
+        "} InfinitePlane;\n"
+        "\n"
+        "typedef struct Quad {\n"
+        "    float4 plane;\n"
+        "    float4 corner;\n"
+        "    float4 uDual;\n"
+        "    float4 vDual;\n"
+        "    TextureType textureType;\n"
+        "    int textureID;\n"
+        "    int materialID;\n"
+        "} Quad;\n"
+        "\n"
+        "typedef struct LightNode {\n"
+        "    float4 bounds;\n"
+        "    float power;\n"
+        "    int child;\n"
+        "    int leaf;\n"
+        "} LightNode;\n"
+        "\n"
     );
 }
 
-std::string CodeGenerator::generateConstants(const Screen &screen,
-        const CmdArgs &args) {
+std::string CodeGenerator::generateConstants(const World &world,
+        const Screen &screen, const CmdArgs &args) {
     std::stringstream code;
 
-    code << "#define PixelWidth ((float) " << screen.pixelWidth() << ")\n"
-        << "#define PixelHeight ((float) " << screen.pixelHeight() << ")\n"
-        << "#define NumSamples (" << args.numSamples() << ")\n"
-        << "#define AALevel (" << args.aaLevel() << ")\n"
-        << "\n";
+    code << "#define NumSamples (" << args.numSamples() << ")\n"
+        << "#define AALevel (" << args.aaLevel() << ")\n";
+
+    if(args.packetTracing())
+        code << "#define PacketTracing\n";
+    if(args.primaryRaysOnly())
+        code << "#define PrimaryRaysOnly\n";
+    if(args.raySorting()) {
+        // Bits needed to store any material ID in the sort key.
+        int materialBits = 1;
+        while((1u << materialBits) < world.materials.size())
+            ++materialBits;
+
+        code << "#define RaySorting\n"
+            << "#define SortGroupWidth (" << SortGroupWidth << ")\n"
+            << "#define SortMaterialBits (" << materialBits << ")\n";
+    }
+    if(args.tracing())
+        code << "#define KernelCounters\n";
+    code << "#define MinDepth (" << args.minDepth() << ")\n"
+        << "#define MaxDepth (" << args.maxDepth() << ")\n";
+    if(args.roulette() > 0.0f)
+        code << "#define RouletteProbability (" << writeExactFloat(
+                args.roulette()) << ")\n";
+    if(args.guidePasses()) {
+        // The cells grow with the distance to the camera, so they cover
+        // about GuideCellPixels pixels at any distance. The scale is the
+        // angle of that many pixels at the center of the screen.
+        const float *topLeft = screen.topLeftPixelPos();
+        const float *camera = screen.cameraPos();
+        const float *up = screen.upVector(), *right = screen.rightVector();
+        float distance2 = 0.0f;
+        for(int i = 0; i < 3; ++i) {
+            float center = topLeft[i] + right[i] * screen.widthSize() / 2
+                - up[i] * screen.heightSize() / 2;
+            distance2 += (center - camera[i]) * (center - camera[i]);
+        }
+        float cellScale = GuideCellPixels * screen.pixelHeight()
+            / std::sqrt(distance2);
+
+        code << "#define PathGuiding\n"
+            << "#define GuideCells (" << GuideCells << ")\n"
+            << "#define GuideResolution (" << GuideResolution << ")\n"
+            << "#define GuideCellScale (" << writeExactFloat(cellScale)
+            << ")\n";
+    }
+    if(args.lightSampling() != CmdArgs::NoLightSampling) {
+        code << "#define LightSampling\n";
+        if(args.lightSampling() == CmdArgs::TreeLights)
+            code << "#define TreeLights\n";
+        else
+            code << "#define UniformLights\n";
+    }
+    if(args.bidirectional()) {
+        // The subpaths are private arrays sized by the depth.
+        int depth = args.maxDepth();
+        if(depth > CmdArgs::MaxBidirectionalDepth)
+            depth = CmdArgs::MaxBidirectionalDepth;
+
+        code << "#define Bidirectional\n"
+            << "#define BidirectionalDepth (" << depth << ")\n";
+    }
+    if(args.spectral())
+        code << "#define Spectral\n";
+    if(args.aperture() > 0.0f)
+        code << "#define ThinLens\n";
+    if(args.shutter() > 0.0f) {
+        code << "#define MotionBlur\n"
+            << "#define Shutter (" << writeExactFloat(args.shutter())
+            << ")\n";
+    }
+    if(args.sppmPhotons()) {
+        code << "#define Sppm\n"
+            << "#define SppmPhotons (" << args.sppmPhotons() << ")\n"
+            << "#define SppmGridCells (" << SppmGridCells << ")\n"
+            << "#define SppmScanGroupSize (" << SppmScanGroupSize << ")\n";
+    }
+    if(args.denoise())
+        code << "#define Denoise\n";
+    if(args.fastMath())
+        code << "#define FastMath\n";
+
+    const char *accumFormats[] = {"AccumFloat", "AccumFloat3", "AccumHalf",
+        "AccumRGB9E5"};
+    code << "#define " << accumFormats[args.accumFormat()] << "\n";
+    if(args.aovFormat() == CmdArgs::HalfAccum)
+        code << "#define AovHalf\n";
+
+    AovLayout aovs{args};
+    const char *aovNames[CmdArgs::NumAovs] = {"AovAlbedo", "AovNormal",
+        "AovDepth", "AovID", "AovSamples", "AovVariance"};
+    for(int i = 0; i < CmdArgs::NumAovs; ++i) {
+        if(!aovs.has(1 << i))
+            continue;
+        code << "#define " << aovNames[i] << "\n"
+            << "#define " << aovNames[i] << "Channel ("
+            << aovs.channel(1 << i) << ")\n";
+    }
+
+    const char *tonemaps[] = {"TonemapClamp", "TonemapReinhard",
+        "TonemapACES", "TonemapFilmic"};
+    code << "#define " << tonemaps[args.tonemap()] << "\n"
+        << "#define BlueNoiseSize (" << BlueNoiseSize << ")\n";
+    code << "\n";
 
     return code.str();
 }
@@ -110,7 +236,8 @@ std::string CodeGenerator::generateSolidTextures(const World &world) {
         code << "};\n\n";
     }
     else {
-        code << "__constant SolidTexture solidTextures[1]; // Dummy.\n\n";
+        code << "__constant SolidTexture solidTextures[1] = { 0 }; "
+            "// Dummy.\n\n";
     }
 
     return code.str();
@@ -135,7 +262,8 @@ std::string CodeGenerator::generateCheckerTextures(const World &world) {
         code << "};\n\n";
     }
     else {
-        code << "__constant CheckerTexture checkerTextures[1]; // Dummy.\n\n";
+        code << "__constant CheckerTexture checkerTextures[1] = { 0 }; "
+            "// Dummy.\n\n";
     }
 
     return code.str();
@@ -183,8 +311,8 @@ std::string CodeGenerator::generateMapTextures(const World &world) {
         code << "};\n\n";
     }
     else {
-        code << "__constant MapTexture mapTextures[1]; // Dummy.\n\n";
-        code << "__constant float4 mapData[1]; // Dummy.\n\n";
+        code << "__constant MapTexture mapTextures[1] = { 0 }; // Dummy.\n\n";
+        code << "__constant float4 mapData[1] = { 0 }; // Dummy.\n\n";
     }
 
     return code.str();
@@ -195,17 +323,56 @@ std::string CodeGenerator::generateMaterials(const World &world) {
 
     stop_if(!world.materials.size(), "Input needs at least one material.");
 
-    code << "#define NumMaterials " << world.materials.size() << "\n\n"
-        << "__constant Material materials[] = {\n";
-
+    // The materials are written as one table per field (see brdf.cl), with
+    // the constants of the BRDFs precomputed.
+    std::stringstream lobeCdf, lobeWeight, specular, refractionRate, cauchy;
     for(size_t i = 0; i < world.materials.size(); ++i) {
-        code << "    " << writeMaterial(world.materials[i]);
-        if(i != world.materials.size() - 1)
-            code << ",";
-        code << "\n";
+        const Material &mat = world.materials[i];
+        const char *separator = i + 1 < world.materials.size() ? ",\n" : "\n";
+        float pi = (float) M_PI;
+
+        // Summed in the order of the lobes, as brdfChooseLobe() did.
+        float cdf[4];
+        cdf[0] = mat.diffuseCoef;
+        cdf[1] = cdf[0] + mat.specularCoef;
+        cdf[2] = cdf[1] + mat.reflectionCoef;
+        cdf[3] = cdf[2] + mat.transmissionCoef;
+
+        lobeCdf << "    " << writeExactFloat4(cdf[0], cdf[1], cdf[2], cdf[3])
+            << separator;
+        lobeWeight << "    " << writeExactFloat4(mat.diffuseCoef / pi,
+                mat.specularCoef * (mat.specularExp + 8.0f) / (8.0f * pi),
+                mat.reflectionCoef, mat.transmissionCoef) << separator;
+        specular << "    " << writeExactFloat4(mat.specularExp,
+                1.0f / (mat.specularExp + 1.0f),
+                (mat.specularExp + 2.0f) / (2.0f * pi), 0.0f) << separator;
+        refractionRate << "    " << writeExactFloat(mat.refractionRate)
+            << separator;
+
+        // The Cauchy equation through the refraction rate at the d line with
+        // the difference between the F and C lines given by the Abbe number.
+        float a = mat.refractionRate, b = 0.0f;
+        if(mat.abbeNumber > 0.0f) {
+            const double lineD = 587.56, lineF = 486.13, lineC = 656.27;
+            b = (float) ((a - 1.0) / (mat.abbeNumber
+                        * (1.0 / (lineF * lineF) - 1.0 / (lineC * lineC))));
+            a -= (float) (b / (lineD * lineD));
+        }
+        cauchy << "    (float2) (" << writeExactFloat(a) << ", "
+            << writeExactFloat(b) << ")" << separator;
     }
 
-    code << "};\n\n";
+    code << "#define NumMaterials " << world.materials.size() << "\n\n"
+        << "__constant float4 materialLobeCdf[] = {\n" << lobeCdf.str()
+        << "};\n\n"
+        << "__constant float4 materialLobeWeight[] = {\n" << lobeWeight.str()
+        << "};\n\n"
+        << "__constant float4 materialSpecular[] = {\n" << specular.str()
+        << "};\n\n"
+        << "__constant float materialRefractionRate[] = {\n"
+        << refractionRate.str() << "};\n\n"
+        << "__constant float2 materialCauchy[] = {\n" << cauchy.str()
+        << "};\n\n";
 
     return code.str();
 }
@@ -226,9 +393,22 @@ std::string CodeGenerator::generateSpheres(const World &world) {
         }
 
         code << "};\n\n";
+
+        // The velocities are only given if some sphere moves, so that the
+        // static spheres cost nothing even with a shutter.
+        bool moving = false;
+        for(const auto &sphere : world.spheres)
+            moving |= sphere.velocity.magnitude() > 0.0;
+        if(moving) {
+            code << "#define MovingSpheres\n\n"
+                << "__constant float4 sphereVelocity[] = {\n";
+            for(const auto &sphere : world.spheres)
+                code << "    " << writeVector(sphere.velocity) << ",\n";
+            code << "};\n\n";
+        }
     }
     else {
-        code << "__constant Sphere spheres[1]; // Dummy.\n\n";
+        code << "__constant Sphere spheres[1] = { 0 }; // Dummy.\n\n";
     }
 
     return code.str();
@@ -236,44 +416,160 @@ std::string CodeGenerator::generateSpheres(const World &world) {
 
 std::string CodeGenerator::generatePolyhedrons(const World &world) {
     std::stringstream code;
-    size_t faceIndex = 0;
+    int groupIndex = 0;
 
     code << "#define NumPolyhedrons " << world.polyhedrons.size() << "\n\n";
 
     if(world.polyhedrons.size()) {
-        code << "__constant float4 polyhedronFaces[] = {\n";
+        // The faces are stored in groups of FaceGroupSize planes, one vector
+        // per coefficient, so the kernel can test a whole group at once.
+        code << "__constant FaceGroup polyhedronFaces[] = {\n";
+        for(size_t i = 0; i < world.polyhedrons.size(); ++i) {
+            const auto &faces = world.polyhedrons[i].faces;
+            for(size_t j = 0; j < faces.size(); j += FaceGroupSize)
+                code << "    " << writeFaceGroup(faces, j) << ",\n";
+        }
+        code << "};\n\n";
 
-        size_t k = 0;
+        // Normalized face normals, with the same layout as the groups.
+        code << "__constant float4 polyhedronNormals[] = {\n";
         for(size_t i = 0; i < world.polyhedrons.size(); ++i) {
-            for(size_t j = 0; j < world.polyhedrons[i].faces.size(); ++j) {
-                code << "    " << writePlane(world.polyhedrons[i].faces[j]);
-                //if(k + 1 != faceIndex)
-                    code << ",";
-                code << "\n";
+            const auto &faces = world.polyhedrons[i].faces;
+            size_t numNormals = numFaceGroups(world.polyhedrons[i])
+                * FaceGroupSize;
+            for(size_t j = 0; j < numNormals; ++j) {
+                Vector normal;
+                if(j < faces.size())
+                    normal = faces[j].normal().normalize();
+                code << "    " << writeVector(normal) << ",\n";
             }
-            k += world.polyhedrons[i].faces.size();
         }
-
         code << "};\n\n";
 
         code << "__constant Polyhedron polyhedrons[] = {\n";
         for(size_t i = 0; i < world.polyhedrons.size(); ++i) {
-            code << "    " << writePolyhedron(world.polyhedrons[i], faceIndex);
+            code << "    " << writePolyhedron(world.polyhedrons[i], groupIndex);
             if(i != world.polyhedrons.size() - 1)
                 code << ",";
             code << "\n";
-            faceIndex += world.polyhedrons[i].faces.size();
+            groupIndex += numFaceGroups(world.polyhedrons[i]);
+        }
+        code << "};\n\n";
+
+        // As the spheres, only given if some polyhedron moves.
+        bool moving = false;
+        for(const auto &polyhedron : world.polyhedrons)
+            moving |= polyhedron.velocity.magnitude() > 0.0;
+        if(moving) {
+            code << "#define MovingPolyhedrons\n\n"
+                << "__constant float4 polyhedronVelocity[] = {\n";
+            for(const auto &polyhedron : world.polyhedrons)
+                code << "    " << writeVector(polyhedron.velocity) << ",\n";
+            code << "};\n\n";
+        }
+    }
+    else {
+        code << "__constant Polyhedron polyhedrons[1] = { 0 }; // Dummy.\n\n";
+        code << "__constant FaceGroup polyhedronFaces[1] = { 0 }; "
+            "// Dummy.\n\n";
+        code << "__constant float4 polyhedronNormals[1] = { 0 }; // Dummy.\n\n";
+    }
+
+    return code.str();
+}
+
+std::string CodeGenerator::generatePlanes(const World &world) {
+    std::stringstream code;
+
+    code << "#define NumPlanes " << world.planes.size() << "\n\n";
+
+    if(world.planes.size()) {
+        code << "__constant InfinitePlane planes[] = {\n";
+
+        for(size_t i = 0; i < world.planes.size(); ++i) {
+            code << "    " << writePlane(world.planes[i]);
+            if(i != world.planes.size() - 1)
+                code << ",";
+            code << "\n";
         }
+
         code << "};\n\n";
     }
     else {
-        code << "__constant Polyhedron polyhedrons[1]; // Dummy.\n\n";
-        code << "__constant float4 polyhedronFaces[1]; // Dummy.\n\n";
+        code << "__constant InfinitePlane planes[1] = { 0 }; // Dummy.\n\n";
     }
 
     return code.str();
 }
 
+std::string CodeGenerator::generateQuads(const World &world) {
+    std::stringstream code;
+
+    code << "#define NumQuads " << world.quads.size() << "\n\n";
+
+    if(world.quads.size()) {
+        code << "__constant Quad quads[] = {\n";
+
+        for(size_t i = 0; i < world.quads.size(); ++i) {
+            code << "    " << writeQuad(world.quads[i]);
+            if(i != world.quads.size() - 1)
+                code << ",";
+            code << "\n";
+        }
+
+        code << "};\n\n";
+    }
+    else {
+        code << "__constant Quad quads[1] = { 0 }; // Dummy.\n\n";
+    }
+
+    return code.str();
+}
+
+std::string CodeGenerator::generateLights(const World &world,
+        const CmdArgs &args) {
+    std::stringstream code;
+    LightTree tree{world};
+    const std::vector<int> &lights = tree.lights();
+
+    code << "#define NumLights " << lights.size() << "\n\n";
+
+    // The tree is only needed to traverse it.
+    if(args.lightSampling() == CmdArgs::TreeLights && lights.size()) {
+        const std::vector<LightTree::Node> &nodes = tree.nodes();
+        code << "__constant LightNode lightNodes[] = {\n";
+
+        for(size_t i = 0; i < nodes.size(); ++i) {
+            code << "    " << writeLightNode(nodes[i]);
+            if(i != nodes.size() - 1)
+                code << ",";
+            code << "\n";
+        }
+
+        code << "};\n\n";
+    }
+    else {
+        code << "__constant LightNode lightNodes[1] = { 0 }; // Dummy.\n\n";
+    }
+
+    if(lights.size()) {
+        code << "__constant int lights[] = {";
+        for(size_t i = 0; i < lights.size(); ++i)
+            code << (i % 16 ? " " : "\n    ") << lights[i]
+                << (i + 1 < lights.size() ? "," : "\n");
+        code << "};\n\n";
+    }
+    else {
+        code << "__constant int lights[1] = { 0 }; // Dummy.\n\n";
+    }
+
+    return code.str();
+}
+
+int CodeGenerator::numFaceGroups(const Polyhedron &polyhedron) {
+    return (polyhedron.faces.size() + FaceGroupSize - 1) / FaceGroupSize;
+}
+
 std::string CodeGenerator::writeSolidTexture(const SolidTexture &tex) {
     std::stringstream code;
 
@@ -308,21 +604,6 @@ std::string CodeGenerator::writeMapTexture(const MapTexture &tex, int texIndex)
     return code.str();
 }
 
-std::string CodeGenerator::writeMaterial(const Material &material) {
-    std::stringstream code;
-
-    code << "{ "
-        << writeFloat(material.diffuseCoef) << ", "
-        << writeFloat(material.specularCoef) << ", "
-        << writeFloat(material.specularExp) << ", "
-        << writeFloat(material.reflectionCoef) << ", "
-        << writeFloat(material.transmissionCoef) << ", "
-        << writeFloat(material.refractionRate)
-        << " }";
-
-    return code.str();
-}
-
 std::string CodeGenerator::writeSphere(const Sphere &sphere) {
     std::stringstream code;
 
@@ -339,12 +620,15 @@ std::string CodeGenerator::writeSphere(const Sphere &sphere) {
 }
 
 std::string CodeGenerator::writePolyhedron(const Polyhedron &polyhedron,
-        int faceIndex) {
+        int groupIndex) {
     std::stringstream code;
 
     code << "{ "
-        << polyhedron.faces.size() << ", "
-        << faceIndex << ", "
+        << writePoint(polyhedron.boundsMin) << ", "
+        << writePoint(polyhedron.boundsMax) << ", "
+        << (polyhedron.bounded ? 1 : 0) << ", "
+        << numFaceGroups(polyhedron) << ", "
+        << groupIndex << ", "
         << polyhedron.textureType << ", "
         << polyhedron.textureID << ", "
         << polyhedron.materialID
@@ -353,6 +637,88 @@ std::string CodeGenerator::writePolyhedron(const Polyhedron &polyhedron,
     return code.str();
 }
 
+std::string CodeGenerator::writePlane(const InfinitePlane &plane) {
+    std::stringstream code;
+    const Plane &p = plane.plane;
+
+    code << "{ "
+        << writeExactFloat4(p.a, p.b, p.c, p.d) << ", "
+        << plane.textureType << ", "
+        << plane.textureID << ", "
+        << plane.materialID
+        << " }";
+
+    return code.str();
+}
+
+std::string CodeGenerator::writeQuad(const Quad &quad) {
+    std::stringstream code;
+
+    // The dual vectors of the edges give the coordinates of a point p on the
+    // plane as s = dot(uDual, p - corner) and t = dot(vDual, p - corner).
+    Vector n = Vector::cross(quad.u, quad.v);
+    float n2 = Vector::dot(n, n);
+    Vector uDual = Vector::cross(quad.v, n) / n2;
+    Vector vDual = Vector::cross(n, quad.u) / n2;
+    Vector normal = n;
+    normal.normalize();
+    float d = -(normal.x * quad.corner.x + normal.y * quad.corner.y
+            + normal.z * quad.corner.z);
+
+    code << "{ "
+        << writeExactFloat4(normal.x, normal.y, normal.z, d) << ", "
+        << writeExactFloat4(quad.corner.x, quad.corner.y, quad.corner.z,
+                1.0f) << ", "
+        << writeExactFloat4(uDual.x, uDual.y, uDual.z, 0.0f) << ", "
+        << writeExactFloat4(vDual.x, vDual.y, vDual.z, 0.0f) << ", "
+        << quad.textureType << ", "
+        << quad.textureID << ", "
+        << quad.materialID
+        << " }";
+
+    return code.str();
+}
+
+std::string CodeGenerator::writeLightNode(const LightTree::Node &node) {
+    std::stringstream code;
+
+    code << "{ " << writeExactFloat4(node.center[0], node.center[1],
+            node.center[2], node.radius) << ", "
+        << writeExactFloat(node.power) << ", "
+        << node.child << ", "
+        << (node.leaf ? 1 : 0) << " }";
+
+    return code.str();
+}
+
+std::string CodeGenerator::writeFaceGroup(const std::vector<Plane> &faces,
+        size_t begin) {
+    std::stringstream code;
+
+    // Padding planes have a null normal and are always in front of the ray,
+    // so they never clip it.
+    Plane planes[FaceGroupSize];
+    for(int i = 0; i < FaceGroupSize; ++i)
+        planes[i] = begin + i < faces.size() ? faces[begin + i]
+            : Plane(0.0f, 0.0f, 0.0f, -1.0f);
+
+    code << "{ (float4) (";
+    for(int i = 0; i < FaceGroupSize; ++i)
+        code << writeFloat(planes[i].a) << (i + 1 < FaceGroupSize ? ", " : "");
+    code << "), (float4) (";
+    for(int i = 0; i < FaceGroupSize; ++i)
+        code << writeFloat(planes[i].b) << (i + 1 < FaceGroupSize ? ", " : "");
+    code << "), (float4) (";
+    for(int i = 0; i < FaceGroupSize; ++i)
+        code << writeFloat(planes[i].c) << (i + 1 < FaceGroupSize ? ", " : "");
+    code << "), (float4) (";
+    for(int i = 0; i < FaceGroupSize; ++i)
+        code << writeFloat(planes[i].d) << (i + 1 < FaceGroupSize ? ", " : "");
+    code << ") }";
+
+    return code.str();
+}
+
 std::string CodeGenerator::writePoint(const Point &point) {
     std::stringstream code;
     code << "(float4) ("
@@ -364,14 +730,13 @@ std::string CodeGenerator::writePoint(const Point &point) {
     return code.str();
 }
 
-std::string CodeGenerator::writePlane(const Plane &plane) {
+std::string CodeGenerator::writeVector(const Vector &vector) {
     std::stringstream code;
     code << "(float4) ("
-        << writeFloat(plane.a) << ", "
-        << writeFloat(plane.b) << ", "
-        << writeFloat(plane.c) << ", "
-        << writeFloat(plane.d)
-        << ")";
+        << writeFloat(vector.x) << ", "
+        << writeFloat(vector.y) << ", "
+        << writeFloat(vector.z) << ", "
+        << writeFloat(vector.w) << ")";
 
     return code.str();
 }
@@ -410,14 +775,36 @@ std::string CodeGenerator::generateCode(const World &world, const Screen &screen
 
     code << std::fixed;
     code << generateStructures(world)
-        << generateConstants(screen, args)
+        << generateConstants(world, screen, args)
         << generateSolidTextures(world)
         << generateCheckerTextures(world)
         << generateMapTextures(world)
         << generateMaterials(world)
         << generateSpheres(world)
         << generatePolyhedrons(world)
+        << generatePlanes(world)
+        << generateQuads(world)
+        << generateLights(world, args)
         << "#include \"sampler.cl\"\n\n"; // Insert the source here.
 
     return code.str();
 }
+
+std::string CodeGenerator::writeExactFloat(float val) {
+    std::stringstream code;
+    code << std::hexfloat << (double) val << "f";
+
+    return code.str();
+}
+
+std::string CodeGenerator::writeExactFloat4(float x, float y, float z,
+        float w) {
+    std::stringstream code;
+    code << "(float4) ("
+        << writeExactFloat(x) << ", "
+        << writeExactFloat(y) << ", "
+        << writeExactFloat(z) << ", "
+        << writeExactFloat(w) << ")";
+
+    return code.str();
+}
@@ -26,17 +26,25 @@
 #include "../World.hpp"
 #include "../Screen.hpp"
 #include "../CmdArgs.hpp"
+#include "LightTree.hpp"
 #include <string>
 
 /**
  * Generates OpenCL code that represents the given World.
  */
 class CodeGenerator {
+    /// Number of polyhedron faces tested at once by the kernel (a float4).
+    static const int FaceGroupSize = 4;
+
+    /// Approximate width in pixels of the path guiding cells on the screen.
+    static const int GuideCellPixels = 32;
+
     /// Generates the structures.
     std::string generateStructures(const World &world);
 
     /// Generates the constants.
-    std::string generateConstants(const Screen &screen, const CmdArgs &args);
+    std::string generateConstants(const World &world, const Screen &screen,
+            const CmdArgs &args);
 
     /// Generates the solid textures.
     std::string generateSolidTextures(const World &world);
@@ -56,6 +64,15 @@ class CodeGenerator {
     /// Generates the polyhedron objects.
     std::string generatePolyhedrons(const World &world);
 
+    /// Generates the plane objects.
+    std::string generatePlanes(const World &world);
+
+    /// Generates the quad objects.
+    std::string generateQuads(const World &world);
+
+    /// Generates the list and the tree of the emitters.
+    std::string generateLights(const World &world, const CmdArgs &args);
+
     /// Writes a solid texture.
     std::string writeSolidTexture(const SolidTexture &tex);
 
@@ -65,20 +82,32 @@ class CodeGenerator {
     /// Writes a map texture.
     std::string writeMapTexture(const MapTexture &tex, int texIndex);
 
-    /// Writes a material.
-    std::string writeMaterial(const Material &material);
-
     /// Writes a sphere object.
     std::string writeSphere(const Sphere &sphere);
 
+    /// Returns the number of face groups used by the polyhedron.
+    int numFaceGroups(const Polyhedron &polyhedron);
+
     /// Writes a polyhedron object.
-    std::string writePolyhedron(const Polyhedron &polyhedron, int faceIndex);
+    std::string writePolyhedron(const Polyhedron &polyhedron, int groupIndex);
+
+    /// Writes a plane object.
+    std::string writePlane(const InfinitePlane &plane);
+
+    /// Writes a quad object, with its plane and the dual vectors of its edges.
+    std::string writeQuad(const Quad &quad);
+
+    /// Writes a node of the light tree.
+    std::string writeLightNode(const LightTree::Node &node);
+
+    /// Writes the group of faces that starts at the given face index.
+    std::string writeFaceGroup(const std::vector<Plane> &faces, size_t begin);
 
     /// Writes a point structure.
     std::string writePoint(const Point &point);
 
-    /// Writes a plane structure.
-    std::string writePlane(const Plane &plane);
+    /// Writes a vector structure.
+    std::string writeVector(const Vector &vector);
 
     /// Writes a color structure.
     std::string writeColor(const Color &color);
@@ -86,7 +115,34 @@ class CodeGenerator {
     /// Writes a float.
     std::string writeFloat(float val);
 
+    /// Writes a float as a hexadecimal literal, without rounding it.
+    std::string writeExactFloat(float val);
+
+    /// Writes a float4 of exact floats.
+    std::string writeExactFloat4(float x, float y, float z, float w);
+
 public:
+    /// Width and height of the work groups used when sorting the paths.
+    static const int SortGroupWidth = 8;
+
+    /// Width and height of the blue noise dither mask of tonemap().
+    static const int BlueNoiseSize = 64;
+
+    /// Cells of the hash table of the path guiding. Must be a power of 2.
+    static const int GuideCells = 16384;
+
+    /// Directional bins of a path guiding cell along each axis.
+    static const int GuideResolution = 8;
+
+    /// Cells of the hash grid of the photon mapping. Must be a power of 2.
+    static const int SppmGridCells = 1 << 18;
+
+    /**
+     * Work group size of the scan of the photon mapping grid. Must divide
+     * SppmGridCells.
+     */
+    static const int SppmScanGroupSize = 256;
+
     /// Generates code about the given world and returns it.
     std::string generateCode(const World &world, const Screen &screen,
             const CmdArgs &args);
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "LightTree.hpp"
+#include <algorithm>
+#include <cmath>
+
+LightTree::LightTree(const World &world) {
+    for(size_t i = 0; i < world.spheres.size(); ++i)
+        if(power(world.spheres[i]) > 0.0f)
+            _lights.push_back((int) i);
+
+    if(_lights.empty())
+        return;
+
+    // A tree of n leaves has 2n - 1 nodes.
+    _nodes.reserve(2 * _lights.size() - 1);
+    _nodes.emplace_back();
+    build(world, 0, 0, _lights.size());
+}
+
+void LightTree::build(const World &world, size_t node, size_t begin,
+        size_t end) {
+    // Bounds of the spheres and of their centers.
+    float boundsMin[3], boundsMax[3], centersMin[3], centersMax[3];
+    std::fill(boundsMin, boundsMin + 3, INFINITY);
+    std::fill(centersMin, centersMin + 3, INFINITY);
+    std::fill(boundsMax, boundsMax + 3, -INFINITY);
+    std::fill(centersMax, centersMax + 3, -INFINITY);
+
+    float totalPower = 0.0f;
+    for(size_t i = begin; i < end; ++i) {
+        const Sphere &sphere = world.spheres[_lights[i]];
+        float center[3] = {sphere.center.x, sphere.center.y, sphere.center.z};
+        float radius = std::sqrt(sphere.radius2);
+        for(int axis = 0; axis < 3; ++axis) {
+            boundsMin[axis] = std::min(boundsMin[axis], center[axis] - radius);
+            boundsMax[axis] = std::max(boundsMax[axis], center[axis] + radius);
+            centersMin[axis] = std::min(centersMin[axis], center[axis]);
+            centersMax[axis] = std::max(centersMax[axis], center[axis]);
+        }
+        totalPower += power(sphere);
+    }
+
+    Node result;
+    float radius2 = 0.0f;
+    for(int axis = 0; axis < 3; ++axis) {
+        float halfSize = 0.5f * (boundsMax[axis] - boundsMin[axis]);
+        result.center[axis] = boundsMin[axis] + halfSize;
+        radius2 += halfSize * halfSize;
+    }
+    result.radius = std::sqrt(radius2);
+    result.power = totalPower;
+    result.leaf = end - begin == 1;
+    result.child = _lights[begin];
+
+    if(!result.leaf) {
+        int axis = 0;
+        for(int i = 1; i < 3; ++i)
+            if(centersMax[i] - centersMin[i]
+                    > centersMax[axis] - centersMin[axis])
+                axis = i;
+
+        size_t middle = begin + (end - begin) / 2;
+        auto coordinate = [&](int light) {
+            const Point &center = world.spheres[light].center;
+            return axis == 0 ? center.x : axis == 1 ? center.y : center.z;
+        };
+        std::nth_element(_lights.begin() + begin, _lights.begin() + middle,
+                _lights.begin() + end, [&](int a, int b) {
+                    return coordinate(a) < coordinate(b);
+                });
+
+        result.child = (int) _nodes.size();
+        _nodes.resize(_nodes.size() + 2);
+        build(world, result.child, begin, middle);
+        build(world, result.child + 1, middle, end);
+    }
+
+    _nodes[node] = result;
+}
+
+float LightTree::power(const Sphere &sphere) {
+    const Color &emission = sphere.emission;
+    float luminance = 0.2126f * emission.r + 0.7152f * emission.g
+        + 0.0722f * emission.b;
+    return std::max(luminance, 0.0f) * sphere.radius2;
+}
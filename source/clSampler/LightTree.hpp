@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef LIGHTTREE_HPP
+#define LIGHTTREE_HPP
+
+#include "../World.hpp"
+#include <vector>
+
+/**
+ * Binary tree of the emissive spheres of a world, traversed by the kernel to
+ * choose an emitter in proportion to its estimated contribution (see
+ * lights.cl). Each node is bounded by a sphere and holds the summed power of
+ * its emitters. The children of a node are consecutive, and each leaf holds
+ * a single emitter.
+ */
+class LightTree {
+public:
+    /// Node of the tree. Written as the LightNode struct of the kernel.
+    struct Node {
+        float center[3];    /// Center of the bounding sphere.
+        float radius;       /// Radius of the bounding sphere.
+        float power;        /// Summed power of the emitters.
+        int child;          /// First child, or sphere ID of a leaf.
+        bool leaf;          /// If the node holds a single emitter.
+    };
+
+private:
+    std::vector<Node> _nodes;
+    std::vector<int> _lights;   /// Sphere IDs of the emitters.
+
+    /**
+     * Builds the node of the emitters [begin, end) of _lights, splitting them
+     * at the median of the longest axis of their centers.
+     */
+    void build(const World &world, size_t node, size_t begin, size_t end);
+
+public:
+    /// Builds the tree of the emissive spheres of the world.
+    explicit LightTree(const World &world);
+
+    /// Returns the nodes, starting by the root. Empty without emitters.
+    inline const std::vector<Node> &nodes() const {
+        return _nodes;
+    }
+
+    /// Returns the sphere IDs of the emitters, in the order of the leaves.
+    inline const std::vector<int> &lights() const {
+        return _lights;
+    }
+
+    /**
+     * Returns the power of the sphere, as the luminance of its emission
+     * times its squared radius, which is proportional to its area.
+     */
+    static float power(const Sphere &sphere);
+};
+
+#endif // !LIGHTTREE_HPP
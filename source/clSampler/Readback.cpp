@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Readback.hpp"
+#include "../error.hpp"
+
+Readback::Readback(cl_context context, cl_command_queue queue, int width,
+        int height)
+        : _width{width}, _height{height}, _queue{queue}, _mapped{NULL},
+        _pending{false}, _complete{false}, _status{CL_SUCCESS} {
+    int err;
+
+    _buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+            3 * _width * _height, NULL, &err);
+    stop_if(err < 0, "failed to create the readback buffer. Error %d.", err);
+}
+
+Readback::~Readback() {
+    if(_pending)
+        release();
+    clReleaseMemObject(_buffer);
+}
+
+void Readback::enqueue(cl_mem image, cl_uint numWait, const cl_event *wait,
+        cl_event *copied) {
+    int err;
+
+    stop_if(_pending, "the readback buffer is still in use.");
+    _pending = true;
+    _complete = false;
+
+    err = clEnqueueCopyBuffer(_queue, image, _buffer, 0, 0,
+            3 * _width * _height, numWait, wait, copied);
+    stop_if(err < 0, "failed to enqueue the image copy. Error %d.", err);
+
+    cl_event mapped;
+    _mapped = (uint8_t *) clEnqueueMapBuffer(_queue, _buffer, CL_FALSE,
+            CL_MAP_READ, 0, 3 * _width * _height, 0, NULL, &mapped, &err);
+    stop_if(err < 0, "failed to enqueue the readback map. Error %d.", err);
+
+    err = clSetEventCallback(mapped, CL_COMPLETE, &Readback::onMapped, this);
+    stop_if(err < 0, "failed to set the readback callback. Error %d.", err);
+    clReleaseEvent(mapped);
+
+    clFlush(_queue);
+}
+
+void CL_CALLBACK Readback::onMapped(cl_event event, cl_int status,
+        void *data) {
+    Readback *readback = (Readback *) data;
+    {
+        std::lock_guard<std::mutex> lock{readback->_mutex};
+        readback->_complete = true;
+        readback->_status = status;
+    }
+    readback->_done.notify_all();
+}
+
+const uint8_t *Readback::wait() {
+    stop_if(!_pending, "no readback was enqueued.");
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    _done.wait(lock, [this] {
+        return _complete;
+    });
+    stop_if(_status < 0, "failed to read back the image. Error %d.", _status);
+
+    return _mapped;
+}
+
+void Readback::release() {
+    wait();
+
+    clEnqueueUnmapMemObject(_queue, _buffer, _mapped, 0, NULL, NULL);
+    _mapped = NULL;
+    _pending = false;
+}
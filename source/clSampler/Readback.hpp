@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef READBACK_HPP
+#define READBACK_HPP
+
+#include "OpenCL.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Pinned host buffer that receives a copy of an 8 bit RGB image without
+ * blocking the queue. The image is copied to a buffer allocated with
+ * CL_MEM_ALLOC_HOST_PTR, which is mapped without blocking; an event callback
+ * signals when the pixels can be read.
+ */
+class Readback {
+    int _width, _height;
+    cl_command_queue _queue;
+    cl_mem _buffer;        /// Pinned staging buffer.
+    uint8_t *_mapped;      /// Mapped staging buffer, valid when done.
+
+    std::mutex _mutex;
+    std::condition_variable _done;
+    bool _pending;         /// If a readback was enqueued and not released.
+    bool _complete;        /// If the map of the pending readback finished.
+    cl_int _status;        /// Status of the map of the pending readback.
+
+    /// Called by OpenCL when the map finishes.
+    static void CL_CALLBACK onMapped(cl_event event, cl_int status,
+            void *data);
+
+public:
+    Readback() = delete;
+    Readback(const Readback &) = delete;
+    Readback &operator=(const Readback &) = delete;
+
+    /**
+     * Creates the staging buffer for images of the given size.
+     * @param queue Queue where the copies and maps are enqueued.
+     */
+    Readback(cl_context context, cl_command_queue queue, int width,
+            int height);
+
+    /// Releases the staging buffer. The readback must not be pending.
+    ~Readback();
+
+    /**
+     * Enqueues the copy of the image to the staging buffer and its map.
+     * Returns immediately.
+     * @param image Buffer with the image, as written by tonemap().
+     * @param numWait, wait Events that must finish before the copy.
+     * @param copied Set to the event of the copy, if not NULL.
+     */
+    void enqueue(cl_mem image, cl_uint numWait = 0,
+            const cl_event *wait = NULL, cl_event *copied = NULL);
+
+    /// Returns true if a readback was enqueued and wasn't released yet.
+    inline bool pending() const {
+        return _pending;
+    }
+
+    /**
+     * Waits for the enqueued readback and returns the pixels, with 3 bytes
+     * per pixel and no padding between rows. They are valid until release().
+     */
+    const uint8_t *wait();
+
+    /// Unmaps the staging buffer so it can be used again.
+    void release();
+};
+
+#endif // !READBACK_HPP
@@ -28,7 +28,44 @@ Sampler::Sampler(const World &world, const Screen &screen, const CmdArgs &args)
 
 Sampler::~Sampler() { }
 
-std::unique_ptr<PPMImage> Sampler::sample() {
+std::vector<uint8_t> Sampler::sample() {
     return _impl->sample();
 }
 
+void Sampler::setCamera(const Point &position, const Point &target,
+        const Vector &up, float fovy) {
+    _impl->setCamera(position, target, up, fovy);
+}
+
+void Sampler::renderBatch(const std::vector<BatchFrame> &frames,
+        FrameCallback onFrame) {
+    _impl->renderBatch(frames, onFrame);
+}
+
+bool Sampler::resume(const std::string &filename) {
+    return _impl->resume(filename);
+}
+
+std::vector<float> Sampler::radiance() {
+    return _impl->radiance();
+}
+
+double Sampler::noise() {
+    return _impl->noise();
+}
+
+void Sampler::writeAovs(const std::string &filename) {
+    _impl->writeAovs(filename);
+}
+
+std::vector<MathBenchmark> Sampler::benchmarkMath(int iterations) {
+    return _impl->benchmarkMath(iterations);
+}
+
+void Sampler::setPassCallback(PassCallback callback) {
+    _impl->setPassCallback(callback);
+}
+
+const SamplerTimes &Sampler::times() const {
+    return _impl->times();
+}
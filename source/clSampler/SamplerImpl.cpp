@@ -21,8 +21,15 @@
  */
 
 #include "SamplerImpl.hpp"
+#include "AccumFormat.hpp"
+#include "BlueNoise.hpp"
+#include "Checkpoint.hpp"
 #include "CodeGenerator.hpp"
+#include "../ExrImage.hpp"
+#include "../Profiler.hpp"
 #include "../error.hpp"
+#include <algorithm>
+#include <cmath>
 
 #define XSTR(s) #s
 #define STR(s) XSTR(s)
@@ -34,12 +41,31 @@
 // Where the sampler.cl file is.
 #define SAMPLER_CLSOURCE_PATH CL_SOURCE_DIR "sampler.cl"
 
+// Options of the OpenCL programs.
+#define SAMPLER_BUILD_OPTIONS "-I " CL_SOURCE_DIR " " \
+    "-Werror -cl-mad-enable -cl-no-signed-zeros " \
+    "-cl-unsafe-math-optimizations -cl-fast-relaxed-math "
+
 // GPU drivers are simply horrible.
 #define SAMPLER_DEVICE_TYPE CL_DEVICE_TYPE_CPU
 
 Sampler::SamplerImpl::SamplerImpl(const World &world, const Screen &screen,
         const CmdArgs &args)
-        : _width{screen.width()}, _height{screen.height()} {
+        : _width{screen.width()}, _height{screen.height()},
+        _numSamples{args.numSamples()}, _aaLevel{args.aaLevel()},
+        _numPasses{args.numPasses()}, _packetTracing{args.packetTracing()},
+        _raySorting{args.raySorting()}, _profiling{args.tracing()},
+        _denoise{args.denoise()}, _bidirectional{args.bidirectional()},
+        _exposure{std::exp2(args.exposure())},
+        _accumFormat{args.accumFormat()}, _aovFormat{args.aovFormat()},
+        _aovLayout{args}, _screen{screen}, _sortStats{NULL},
+        _filmBuffer{NULL}, _sppmPhotons{args.sppmPhotons()},
+        _sppmPixels{NULL}, _passIndex{0},
+        _checkpointFilename{args.checkpointFilename()},
+        _checkpointInterval{1000.0 * args.checkpointInterval()},
+        _resumedPasses{0}, _timeBudget{1000.0 * args.timeBudget()},
+        _targetRmse{args.targetRmse()}, _guidePasses{args.guidePasses()},
+        _guideTrained{0} {
     int err;
 
     cl_platform_id *platforms;
@@ -68,29 +94,135 @@ Sampler::SamplerImpl::SamplerImpl(const World &world, const Screen &screen,
             &err);
     stop_if(err < 0, "failed to create an OpenCL context. Error %d.", err);
 
-    _queue = clCreateCommandQueue(_context, _device, 0, &err);
+    _queue = clCreateCommandQueue(_context, _device,
+            _profiling ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
     stop_if(err < 0, "failed to create an OpenCL command queue. Error %d", err);
 
+    _times = SamplerTimes{};
+    auto time = getTime();
+
     auto source = generateSource(world, screen, args);
-    _program = cluBuildProgram(_context, _device, source.c_str(), source.size(),
-            "-I " CL_SOURCE_DIR " "
-            "-Werror -cl-mad-enable -cl-no-signed-zeros "
-            "-cl-unsafe-math-optimizations -cl-fast-relaxed-math ",
-            &err);
-    stop_if(err < 0, "failed to compile the OpenCL kernel.");
+    _sourceHash = Checkpoint::hash(source.data(), source.size());
+    {
+        ScopedTimer timer{"cluBuildProgram"};
+        _program = cluBuildProgram(_context, _device, source.c_str(),
+                source.size(), SAMPLER_BUILD_OPTIONS, &err);
+        stop_if(err < 0, "failed to compile the OpenCL kernel.");
+    }
+
+    const char *kernelName = "sample";
+    if(_packetTracing)
+        kernelName = "samplePackets";
+    else if(_raySorting)
+        kernelName = "sampleSorted";
+    else if(_bidirectional)
+        kernelName = "sampleBidirectional";
+    else if(_sppmPhotons)
+        kernelName = "sppmCamera";
 
-    _sampleKernel = clCreateKernel(_program, "sample", &err);
+    _sampleKernel = clCreateKernel(_program, kernelName, &err);
     stop_if(err < 0, "failed to create the sample kernel. Error %d.", err);
 
-    constructBuffers(screen);
+    _tonemapKernel = clCreateKernel(_program, "tonemap", &err);
+    stop_if(err < 0, "failed to create the tonemap kernel. Error %d.", err);
+
+    if(_denoise) {
+        _demodulateKernel = clCreateKernel(_program, "demodulate", &err);
+        stop_if(err < 0, "failed to create the demodulate kernel. Error %d.",
+                err);
+        _atrousKernel = clCreateKernel(_program, "atrous", &err);
+        stop_if(err < 0, "failed to create the a-trous kernel. Error %d.",
+                err);
+        _remodulateKernel = clCreateKernel(_program, "remodulate", &err);
+        stop_if(err < 0, "failed to create the remodulate kernel. Error %d.",
+                err);
+    }
+    if(_bidirectional) {
+        _resolveKernel = clCreateKernel(_program, "resolveFilm", &err);
+        stop_if(err < 0, "failed to create the resolve kernel. Error %d.",
+                err);
+    }
+    if(_sppmPhotons) {
+        _resolveKernel = clCreateKernel(_program, "sppmResolve", &err);
+        stop_if(err < 0, "failed to create the resolve kernel. Error %d.",
+                err);
+        _sppmCountKernel = clCreateKernel(_program, "sppmCount", &err);
+        stop_if(err < 0, "failed to create the count kernel. Error %d.", err);
+        _sppmScanKernel = clCreateKernel(_program, "sppmScan", &err);
+        stop_if(err < 0, "failed to create the scan kernel. Error %d.", err);
+        _sppmScatterKernel = clCreateKernel(_program, "sppmScatter", &err);
+        stop_if(err < 0, "failed to create the scatter kernel. Error %d.",
+                err);
+        _sppmPhotonKernel = clCreateKernel(_program, "sppmPhotons", &err);
+        stop_if(err < 0, "failed to create the photon kernel. Error %d.",
+                err);
+    }
+
+    // In packet mode each work item samples a block of 2x2 pixels.
+    _workSize[0] = _width;
+    _workSize[1] = _height;
+    if(_packetTracing) {
+        _workSize[0] = (_workSize[0] + 1) / 2;
+        _workSize[1] = (_workSize[1] + 1) / 2;
+    }
+
+    // When sorting, the paths are exchanged inside fixed size work groups.
+    _localSize[0] = _localSize[1] = CodeGenerator::SortGroupWidth;
+    if(_raySorting) {
+        _workSize[0] = (_workSize[0] + _localSize[0] - 1) / _localSize[0]
+            * _localSize[0];
+        _workSize[1] = (_workSize[1] + _localSize[1] - 1) / _localSize[1]
+            * _localSize[1];
+    }
+
+    _times.compile = getTime() - time;
+    time = getTime();
+
+    constructBuffers();
+    clFinish(_queue);
+
+    _times.upload = getTime() - time;
 }
 
 Sampler::SamplerImpl::~SamplerImpl() {
-    clReleaseMemObject(_outputImage);
-    clReleaseMemObject(_rightBuffer);
-    clReleaseMemObject(_upBuffer);
-    clReleaseMemObject(_topLeftBuffer);
-    clReleaseMemObject(_originBuffer);
+    for(auto &readback : _readbacks)
+        readback.reset();
+    if(_sortStats)
+        clReleaseMemObject(_sortStats);
+    if(_filmBuffer) {
+        clReleaseMemObject(_filmBuffer);
+        clReleaseKernel(_resolveKernel);
+    }
+    if(_sppmPixels) {
+        clReleaseMemObject(_sppmPixels);
+        clReleaseMemObject(_sppmMaxRadius);
+        clReleaseMemObject(_sppmCounts);
+        clReleaseMemObject(_sppmStarts);
+        clReleaseMemObject(_sppmEnds);
+        clReleaseMemObject(_sppmEntries);
+        clReleaseMemObject(_sppmFlux);
+        clReleaseMemObject(_sppmPhotonCounts);
+        clReleaseKernel(_resolveKernel);
+        clReleaseKernel(_sppmCountKernel);
+        clReleaseKernel(_sppmScanKernel);
+        clReleaseKernel(_sppmScatterKernel);
+        clReleaseKernel(_sppmPhotonKernel);
+    }
+    if(_denoise) {
+        clReleaseMemObject(_denoiseBuffers[0]);
+        clReleaseMemObject(_denoiseBuffers[1]);
+        clReleaseKernel(_demodulateKernel);
+        clReleaseKernel(_atrousKernel);
+        clReleaseKernel(_remodulateKernel);
+    }
+    clReleaseMemObject(_guideCdf);
+    clReleaseMemObject(_guideTrain);
+    clReleaseMemObject(_aovBuffer);
+    clReleaseMemObject(_accumBuffer);
+    clReleaseMemObject(_counters);
+    clReleaseMemObject(_blueNoise);
+    clReleaseMemObject(_outputBuffer);
+    clReleaseKernel(_tonemapKernel);
     clReleaseKernel(_sampleKernel);
     clReleaseCommandQueue(_queue);
     clReleaseProgram(_program);
@@ -100,6 +232,7 @@ Sampler::SamplerImpl::~SamplerImpl() {
 
 std::string Sampler::SamplerImpl::generateSource(const World &world,
         const Screen &screen, const CmdArgs &args) {
+    ScopedTimer timer{"CodeGenerator"};
     CodeGenerator generator;
 
     // Generate the source that represents the given world.
@@ -116,122 +249,1113 @@ std::string Sampler::SamplerImpl::generateSource(const World &world,
     return genSource;
 }
 
-void Sampler::SamplerImpl::constructBuffers(const Screen &screen) {
+void Sampler::SamplerImpl::constructBuffers() {
+    ScopedTimer timer{"constructBuffers"};
     int err;
 
-    _originBuffer = clCreateBuffer(_context, CL_MEM_READ_ONLY, 4 * sizeof(float),
-            NULL, &err);
-    stop_if(err < 0, "failed to create the sample kernel origin position. "
-            "Error %d.", err);
+    _outputBuffer = clCreateBuffer(_context, CL_MEM_READ_WRITE,
+            3 * _width * _height, NULL, &err);
+    stop_if(err < 0, "failed to create the output image. Error %d.", err);
 
-    _topLeftBuffer = clCreateBuffer(_context, CL_MEM_READ_ONLY, 4 * sizeof(float),
-            NULL, &err);
-    stop_if(err < 0, "failed to create the sample kernel top left position. "
-            "Error %d.", err);
 
-    _upBuffer = clCreateBuffer(_context, CL_MEM_READ_ONLY, 4 * sizeof(float),
-            NULL, &err);
-    stop_if(err < 0, "failed to create the sample kernel up vector. "
-            "Error %d.", err);
+    setCameraArg();
 
-    _rightBuffer = clCreateBuffer(_context, CL_MEM_READ_ONLY, 4 * sizeof(float),
-            NULL, &err);
-    stop_if(err < 0, "failed to create the sample kernel right vector. "
-            "Error %d.", err);
+    for(auto &readback : _readbacks)
+        readback = std::make_unique<Readback>(_context, _queue, _width,
+                _height);
+
+    uint32_t seed[2] = {42, 84};
+    err = clSetKernelArg(_sampleKernel, 1, 2 * sizeof(uint32_t), &seed);
+    stop_if(err < 0, "failed to set second kernel argument. Error %d.", err);
+
+    cl_int size[2] = {_width, _height};
+    err = clSetKernelArg(_sampleKernel, 2, sizeof(size), &size);
+    stop_if(err < 0, "failed to set third kernel argument. Error %d.", err);
+
+    // Each counter is 64 bits, as a low and a high word.
+    cl_uint counters[2 * NumKernelCounters] = {};
+    _counters = clCreateBuffer(_context,
+            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(counters),
+            counters, &err);
+    stop_if(err < 0, "failed to create the kernel counters. Error %d.", err);
 
-    cl_image_format rgbaFormat;
-    rgbaFormat.image_channel_order = CL_RGBA;
-    rgbaFormat.image_channel_data_type = CL_UNORM_INT8;
+    err = clSetKernelArg(_sampleKernel, 3, sizeof(_counters), &_counters);
+    stop_if(err < 0, "failed to set fourth kernel argument. Error %d.", err);
 
-    _outputImage = clCreateImage2D(_context, CL_MEM_WRITE_ONLY,
-            &rgbaFormat, _width, _height, 0, NULL, &err);
-    stop_if(err < 0,
-            "failed to create the sample kernel output image. Error %d.", err);
+    _accumBuffer = clCreateBuffer(_context, CL_MEM_READ_WRITE,
+            accumPixelSize(_accumFormat) * _width * _height, NULL, &err);
+    stop_if(err < 0, "failed to create the accumulation buffer. Error %d.",
+            err);
 
+    err = clSetKernelArg(_sampleKernel, 4, sizeof(_accumBuffer), &_accumBuffer);
+    stop_if(err < 0, "failed to set fifth kernel argument. Error %d.", err);
 
-    float *mapped;
+    cl_uint pass = 0;
+    err = clSetKernelArg(_sampleKernel, 5, sizeof(pass), &pass);
+    stop_if(err < 0, "failed to set sixth kernel argument. Error %d.", err);
 
-    mapped = (float *) clEnqueueMapBuffer(_queue, _originBuffer, CL_TRUE,
-            CL_MAP_WRITE, 0, screen.ArraySize, 0, NULL, NULL, &err);
-    stop_if(err < 0, "failed to map first kernel argument.");
+    // A single channel is allocated when there are no AOVs, as buffers can't
+    // be empty.
+    size_t aovSize = aovValueSize(_aovFormat)
+        * std::max(_aovLayout.numChannels(), 1);
+    if(_aovLayout.numChannels())
+        aovSize *= _width * _height;
+    _aovBuffer = clCreateBuffer(_context, CL_MEM_READ_WRITE, aovSize, NULL,
+            &err);
+    stop_if(err < 0, "failed to create the AOV framebuffer. Error %d.", err);
 
-    memcpy(mapped, screen.cameraPos(), screen.ArraySize);
-    clEnqueueUnmapMemObject(_queue, _originBuffer, mapped, 0, NULL, NULL);
+    err = clSetKernelArg(_sampleKernel, 6, sizeof(_aovBuffer), &_aovBuffer);
+    stop_if(err < 0, "failed to set seventh kernel argument. Error %d.", err);
 
-    mapped = (float *) clEnqueueMapBuffer(_queue, _topLeftBuffer, CL_TRUE,
-            CL_MAP_WRITE, 0, screen.ArraySize, 0, NULL, NULL, &err);
-    stop_if(err < 0, "failed to map second kernel argument.");
+    // Single bins are allocated without path guiding, as buffers can't be
+    // empty. The training counters are 64 bits, as a low and a high word.
+    size_t guideBins = 1;
+    if(_guidePasses)
+        guideBins = CodeGenerator::GuideCells * CodeGenerator::GuideResolution
+            * CodeGenerator::GuideResolution;
+    std::vector<cl_uint> guideCounters(2 * guideBins, 0);
+    _guideTrain = clCreateBuffer(_context,
+            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+            guideCounters.size() * sizeof(cl_uint), guideCounters.data(),
+            &err);
+    stop_if(err < 0, "failed to create the path guiding counters. Error %d.",
+            err);
+    _guideCdf = clCreateBuffer(_context, CL_MEM_READ_ONLY,
+            guideBins * sizeof(cl_float), NULL, &err);
+    stop_if(err < 0, "failed to create the path guiding distributions. "
+            "Error %d.", err);
 
-    memcpy(mapped, screen.topLeftPixelPos(), screen.ArraySize);
-    clEnqueueUnmapMemObject(_queue, _topLeftBuffer, mapped, 0, NULL, NULL);
+    cl_uint guidePhase = GuideOff;
+    err = clSetKernelArg(_sampleKernel, 7, sizeof(_guideTrain), &_guideTrain);
+    err |= clSetKernelArg(_sampleKernel, 8, sizeof(_guideCdf), &_guideCdf);
+    err |= clSetKernelArg(_sampleKernel, 9, sizeof(guidePhase), &guidePhase);
+    stop_if(err != CL_SUCCESS,
+            "failed to set the path guiding kernel arguments.");
 
-    mapped = (float *) clEnqueueMapBuffer(_queue, _upBuffer, CL_TRUE,
-            CL_MAP_WRITE, 0, screen.ArraySize, 0, NULL, NULL, &err);
-    stop_if(err < 0, "failed to map third kernel argument.");
+    if(_denoise) {
+        for(cl_mem &buffer : _denoiseBuffers) {
+            buffer = clCreateBuffer(_context, CL_MEM_READ_WRITE,
+                    4 * sizeof(float) * _width * _height, NULL, &err);
+            stop_if(err < 0, "failed to create the denoiser buffers. "
+                    "Error %d.", err);
+        }
+    }
 
-    memcpy(mapped, screen.upVector(), screen.ArraySize);
-    clEnqueueUnmapMemObject(_queue, _upBuffer, mapped, 0, NULL, NULL);
+    if(_raySorting) {
+        cl_uint stats[4] = {0, 0, 0, 0};
+        _sortStats = clCreateBuffer(_context,
+                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(stats), stats,
+                &err);
+        stop_if(err < 0, "failed to create the sort statistics. Error %d.",
+                err);
 
-    mapped = (float *) clEnqueueMapBuffer(_queue, _rightBuffer, CL_TRUE,
-            CL_MAP_WRITE, 0, screen.ArraySize, 0, NULL, NULL, &err);
-    stop_if(err < 0, "failed to map fourth kernel argument.");
+        err = clSetKernelArg(_sampleKernel, 10, sizeof(_sortStats),
+                &_sortStats);
+        stop_if(err < 0, "failed to set eleventh kernel argument. Error %d.",
+                err);
+    }
 
-    memcpy(mapped, screen.rightVector(), screen.ArraySize);
-    clEnqueueUnmapMemObject(_queue, _rightBuffer, mapped, 0, NULL, NULL);
+    // The film is cleared by the resolve kernel after each pass.
+    if(_bidirectional) {
+        std::vector<cl_float> film(4 * _width * _height, 0.0f);
+        _filmBuffer = clCreateBuffer(_context,
+                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                film.size() * sizeof(cl_float), film.data(), &err);
+        stop_if(err < 0, "failed to create the film. Error %d.", err);
 
+        err = clSetKernelArg(_sampleKernel, 10, sizeof(_filmBuffer),
+                &_filmBuffer);
+        err |= clSetKernelArg(_resolveKernel, 0, sizeof(_filmBuffer),
+                &_filmBuffer);
+        err |= clSetKernelArg(_resolveKernel, 1, sizeof(_accumBuffer),
+                &_accumBuffer);
+        err |= clSetKernelArg(_resolveKernel, 2, sizeof(size), &size);
+        stop_if(err != CL_SUCCESS, "failed to set the film kernel arguments.");
+    }
 
-    err = clSetKernelArg(_sampleKernel, 0, sizeof(_originBuffer), &_originBuffer);
-    stop_if(err < 0, "failed to set first kernel argument. Error %d.", err);
+    // The memory of the photon mapping doesn't grow with the passes. The
+    // counts of the grid and the photons of the pixels start at 0, and the
+    // kernels that consume them clear them for the next pass.
+    if(_sppmPhotons) {
+        const size_t numPixels = (size_t) _width * _height;
+        const size_t numCells = CodeGenerator::SppmGridCells;
+        std::vector<cl_uint> zeros(std::max(4 * numPixels, numCells), 0);
+        auto createBuffer = [&](size_t bytes, bool zeroed) {
+            cl_mem buffer = clCreateBuffer(_context, zeroed
+                    ? CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR
+                    : CL_MEM_READ_WRITE, bytes, zeroed ? zeros.data() : NULL,
+                    &err);
+            stop_if(err < 0, "failed to create the photon mapping buffers. "
+                    "Error %d.", err);
+            return buffer;
+        };
+        _sppmPixels = createBuffer(SppmPixelVectors * sizeof(cl_float4)
+                * numPixels, false);
+        _sppmMaxRadius = createBuffer(sizeof(cl_uint), true);
+        _sppmCounts = createBuffer(numCells * sizeof(cl_uint), true);
+        _sppmStarts = createBuffer(numCells * sizeof(cl_uint), false);
+        _sppmEnds = createBuffer(numCells * sizeof(cl_uint), false);
+        _sppmEntries = createBuffer(numPixels * sizeof(cl_int), false);
+        _sppmFlux = createBuffer(4 * numPixels * sizeof(cl_float), true);
+        _sppmPhotonCounts = createBuffer(numPixels * sizeof(cl_uint), true);
 
-    err = clSetKernelArg(_sampleKernel, 1, sizeof(_topLeftBuffer), &_topLeftBuffer);
-    stop_if(err < 0, "failed to set second kernel argument. Error %d.", err);
+        err = clSetKernelArg(_sampleKernel, 10, sizeof(cl_mem), &_sppmPixels);
+        err |= clSetKernelArg(_sampleKernel, 11, sizeof(cl_mem),
+                &_sppmMaxRadius);
 
-    err = clSetKernelArg(_sampleKernel, 2, sizeof(_upBuffer), &_upBuffer);
-    stop_if(err < 0, "failed to set third kernel argument. Error %d.", err);
+        err |= clSetKernelArg(_sppmCountKernel, 0, sizeof(cl_mem),
+                &_sppmPixels);
+        err |= clSetKernelArg(_sppmCountKernel, 1, sizeof(cl_mem),
+                &_sppmMaxRadius);
+        err |= clSetKernelArg(_sppmCountKernel, 2, sizeof(cl_mem),
+                &_sppmCounts);
 
-    err = clSetKernelArg(_sampleKernel, 3, sizeof(_rightBuffer), &_rightBuffer);
-    stop_if(err < 0, "failed to set fourth kernel argument. Error %d.", err);
+        err |= clSetKernelArg(_sppmScanKernel, 0, sizeof(cl_mem),
+                &_sppmCounts);
+        err |= clSetKernelArg(_sppmScanKernel, 1, sizeof(cl_mem),
+                &_sppmStarts);
+        err |= clSetKernelArg(_sppmScanKernel, 2, sizeof(cl_mem), &_sppmEnds);
 
-    uint32_t seed[2] = {42, 84};
-    err = clSetKernelArg(_sampleKernel, 4, 2 * sizeof(uint32_t), &seed);
-    stop_if(err < 0, "failed to set fifth kernel argument. Error %d.", err);
+        err |= clSetKernelArg(_sppmScatterKernel, 0, sizeof(cl_mem),
+                &_sppmPixels);
+        err |= clSetKernelArg(_sppmScatterKernel, 1, sizeof(cl_mem),
+                &_sppmMaxRadius);
+        err |= clSetKernelArg(_sppmScatterKernel, 2, sizeof(cl_mem),
+                &_sppmEnds);
+        err |= clSetKernelArg(_sppmScatterKernel, 3, sizeof(cl_mem),
+                &_sppmEntries);
 
-    err = clSetKernelArg(_sampleKernel, 5, sizeof(_outputImage), &_outputImage);
-    stop_if(err < 0, "failed to set sixth kernel argument. Error %d.", err);
+        err |= clSetKernelArg(_sppmPhotonKernel, 1, sizeof(cl_mem),
+                &_counters);
+        err |= clSetKernelArg(_sppmPhotonKernel, 2, sizeof(cl_mem),
+                &_sppmPixels);
+        err |= clSetKernelArg(_sppmPhotonKernel, 3, sizeof(cl_mem),
+                &_sppmMaxRadius);
+        err |= clSetKernelArg(_sppmPhotonKernel, 4, sizeof(cl_mem),
+                &_sppmStarts);
+        err |= clSetKernelArg(_sppmPhotonKernel, 5, sizeof(cl_mem),
+                &_sppmEnds);
+        err |= clSetKernelArg(_sppmPhotonKernel, 6, sizeof(cl_mem),
+                &_sppmEntries);
+        err |= clSetKernelArg(_sppmPhotonKernel, 7, sizeof(cl_mem),
+                &_sppmFlux);
+        err |= clSetKernelArg(_sppmPhotonKernel, 8, sizeof(cl_mem),
+                &_sppmPhotonCounts);
+
+        err |= clSetKernelArg(_resolveKernel, 0, sizeof(cl_mem),
+                &_sppmPixels);
+        err |= clSetKernelArg(_resolveKernel, 1, sizeof(_accumBuffer),
+                &_accumBuffer);
+        err |= clSetKernelArg(_resolveKernel, 2, sizeof(size), &size);
+        err |= clSetKernelArg(_resolveKernel, 4, sizeof(cl_mem), &_sppmFlux);
+        err |= clSetKernelArg(_resolveKernel, 5, sizeof(cl_mem),
+                &_sppmPhotonCounts);
+        err |= clSetKernelArg(_resolveKernel, 6, sizeof(cl_mem),
+                &_sppmMaxRadius);
+        stop_if(err != CL_SUCCESS,
+                "failed to set the photon mapping kernel arguments.");
+    }
+
+    auto blueNoise = generateBlueNoise(CodeGenerator::BlueNoiseSize);
+    _blueNoise = clCreateBuffer(_context,
+            CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, blueNoise.size(),
+            blueNoise.data(), &err);
+    stop_if(err < 0, "failed to create the blue noise mask. Error %d.", err);
+
+    err = clSetKernelArg(_tonemapKernel, 1, sizeof(size), &size);
+    err |= clSetKernelArg(_tonemapKernel, 3, sizeof(_exposure), &_exposure);
+    err |= clSetKernelArg(_tonemapKernel, 4, sizeof(_blueNoise), &_blueNoise);
+    stop_if(err != CL_SUCCESS, "failed to set the tonemap kernel arguments.");
 }
 
-std::unique_ptr<PPMImage> Sampler::SamplerImpl::sample() {
+std::vector<uint8_t> Sampler::SamplerImpl::sample() {
     int err;
 
     // Start benchmarking the execution.
     auto time = getTime();
 
-    size_t workSize[2] = {(size_t) _width, (size_t) _height};
-    size_t globalOffset[2] = {0, 0};
-    err = clEnqueueNDRangeKernel(_queue, _sampleKernel, 2,
-            globalOffset, workSize, NULL, 0, NULL, NULL);
-    stop_if(err < 0, "failed to enqueue kernel execution. Error %d.", err);
+    // The passes loaded from a checkpoint count towards this call.
+    int maxPasses = std::max(_numPasses - _resumedPasses, 0);
+    _resumedPasses = 0;
+
+    // When checkpointing or with a budget, the host waits for each pass so
+    // the time and the noise are measured on finished passes.
+    bool budgeted = _timeBudget > 0.0 || _targetRmse > 0.0f;
+    bool waitPasses = budgeted || !_checkpointFilename.empty();
+
+    // Each pass adds its samples to the HDR accumulator, which keeps the
+    // passes of the previous calls until the camera changes.
+    std::vector<cl_event> events;
+    std::vector<Time> queued;
+    Time checkpointTime = time;
+    int numPasses = 0, noiseCheck = FirstNoiseCheck;
+    while(numPasses < maxPasses) {
+        int pass = numPasses++;
+        cl_uint passArg = _passIndex + pass;
+
+        queued.push_back(getTime());
+        events.push_back(NULL);
+        enqueuePass(passArg, _profiling ? &events.back() : NULL);
+
+        // Publish the intermediate passes. The image of each pass is read back
+        // behind it in the queue, and the previous pass is published while
+        // this one renders. The last pass is published below.
+        if(_passCallback && pass + 1 < maxPasses) {
+            enqueueOutput(_accumBuffer, _aovBuffer, passArg + 1,
+                    _outputBuffer, NULL);
+            _readbacks[pass % 2]->enqueue(_outputBuffer);
+            if(pass > 0)
+                publishReadback(*_readbacks[(pass + 1) % 2], passArg);
+        }
+
+        if(waitPasses && numPasses < maxPasses) {
+            err = clFinish(_queue);
+            stop_if(err < 0, "failed to wait for the pass. Error %d.", err);
+
+            if(!_checkpointFilename.empty()
+                    && getTime() - checkpointTime >= _checkpointInterval) {
+                writeCheckpoint(passArg + 1);
+                checkpointTime = getTime();
+            }
+            if(budgeted && !withinBudget(numPasses, getTime() - time,
+                        noiseCheck))
+                break;
+        }
+    }
+    if(_passCallback) {
+        // The image of the second to last pass is published here, and the
+        // one of the last pass is published below. The readback of the last
+        // pass, enqueued before the budget stopped the passes, is dropped.
+        Readback &previous = *_readbacks[numPasses % 2];
+        Readback &last = *_readbacks[(numPasses + 1) % 2];
+        if(numPasses > 1 && previous.pending())
+            publishReadback(previous, _passIndex + numPasses - 1);
+        if(last.pending()) {
+            last.wait();
+            last.release();
+        }
+    }
+
+    _passIndex += numPasses;
 
     // Wait for everything to end.
-    clFinish(_queue);
+    err = clFinish(_queue);
     stop_if(err < 0, "failed to wait for queue to finish. Error %d.", err);
 
-    // Print time.
-    std::cout << "Kernel execution time: " << getTime() - time << "ms\n"
+    // Print time and the primary ray throughput.
+    _times.kernel = getTime() - time;
+    if(_profiling) {
+        Profiler::instance().addEvent("kernel", "host", time, _times.kernel);
+        for(int pass = 0; pass < numPasses; ++pass)
+            profileEvent(events[pass], "kernel", queued[pass]);
+    }
+
+    double primaryRays = (double) _width * _height * _aaLevel * _aaLevel
+        * _numSamples * numPasses;
+    std::cout << "Kernel execution time: " << _times.kernel << "ms\n"
+        << "Primary rays: " << primaryRays << " ("
+        << primaryRays / (_times.kernel * 1000.0) << " Mrays/s)\n"
         << "Generating output..." << std::endl;
 
-    // Map the entire output image.
-    size_t rowPitch = 0;
-    size_t origin[3] = {0, 0, 0};
-    size_t region[3] = {(size_t) _width, (size_t) _height, 1};
-    uint8_t *output = (uint8_t *) clEnqueueMapImage(_queue, _outputImage,
-            CL_TRUE, CL_MAP_READ, origin, region, &rowPitch, NULL, 0, NULL,
-            NULL, &err);
-    stop_if(err < 0, "failed to map output kernel image. Error %d.", err);
+    if(budgeted)
+        std::cout << "Passes: " << _passIndex << " ("
+            << _passIndex * _numSamples * _aaLevel * _aaLevel
+            << " samples per pixel)" << std::endl;
+    if(_aovLayout.has(CmdArgs::VarianceAov) && _passIndex)
+        std::cout << "Estimated relative RMSE: " << estimateNoise(_passIndex)
+            << std::endl;
+
+    // The last checkpoint also allows continuing with more passes later.
+    if(!_checkpointFilename.empty() && numPasses)
+        writeCheckpoint(_passIndex);
 
-    auto image = std::make_unique<PPMImage>(output, _width, _height);
+    if(_raySorting) {
+        cl_uint stats[4];
+        err = clEnqueueReadBuffer(_queue, _sortStats, CL_TRUE, 0, sizeof(stats),
+                stats, 0, NULL, NULL);
+        stop_if(err < 0, "failed to read the sort statistics. Error %d.", err);
 
-    clEnqueueUnmapMemObject(_queue, _outputImage, output, 0, NULL, NULL);
+        std::cout << "Shading lane utilization: "
+            << 100.0 * stats[0] / std::max(stats[1], 1u) << "% unsorted, "
+            << 100.0 * stats[2] / std::max(stats[3], 1u) << "% sorted"
+            << std::endl;
+    }
+
+    if(_profiling) {
+        cl_uint counters[2 * NumKernelCounters];
+        err = clEnqueueReadBuffer(_queue, _counters, CL_TRUE, 0,
+                sizeof(counters), counters, 0, NULL, NULL);
+        stop_if(err < 0, "failed to read the kernel counters. Error %d.", err);
+
+        const char *names[NumKernelCounters] = {"rays", "bounces",
+            "terminations"};
+        std::cout << "Kernel counters:";
+        for(int i = 0; i < NumKernelCounters; ++i) {
+            double value = counters[2 * i] + 4294967296.0 * counters[2 * i + 1];
+            Profiler::instance().addCounter(names[i], value);
+            std::cout << " " << names[i] << " " << value;
+        }
+        std::cout << std::endl;
+    }
+
+    cl_mem hdrImage = _accumBuffer;
+    cl_uint hdrPasses = _passIndex;
+    if(_denoise) {
+        time = getTime();
+        hdrImage = enqueueDenoise(_accumBuffer, _aovBuffer, _passIndex);
+        hdrPasses = 1;
+
+        err = clFinish(_queue);
+        stop_if(err < 0, "failed to wait for the denoiser. Error %d.", err);
+
+        _times.denoise = getTime() - time;
+        std::cout << "Denoising time: " << _times.denoise << "ms" << std::endl;
+        if(_profiling)
+            Profiler::instance().addEvent("denoise", "host", time,
+                    _times.denoise);
+    }
+
+    time = getTime();
+
+    // Convert the accumulator to the output image and read it back through
+    // the pinned staging buffer.
+    Readback &readback = *_readbacks[0];
+    cl_event tonemapEvent = NULL, copyEvent = NULL;
+    Time queuedTime = getTime();
+    enqueueTonemap(hdrImage, _outputBuffer, hdrPasses,
+            _profiling ? &tonemapEvent : NULL);
+    readback.enqueue(_outputBuffer, 0, NULL, _profiling ? &copyEvent : NULL);
+    const uint8_t *output = readback.wait();
+    if(_profiling) {
+        profileEvent(tonemapEvent, "tonemap", queuedTime);
+        profileEvent(copyEvent, "readback", queuedTime);
+    }
+
+    std::vector<uint8_t> image(output, output + 3 * _width * _height);
+
+    if(_passCallback)
+        _passCallback(output, _passIndex);
+
+    readback.release();
+
+    _times.readback = getTime() - time;
+    if(_profiling)
+        Profiler::instance().addEvent("readback", "host", time,
+                _times.readback);
 
     return image;
 }
+
+void Sampler::SamplerImpl::publishReadback(Readback &readback, int numPasses) {
+    _passCallback(readback.wait(), numPasses);
+    readback.release();
+}
+
+void Sampler::SamplerImpl::renderBatch(const std::vector<BatchFrame> &frames,
+        FrameCallback onFrame) {
+    ScopedTimer timer{"renderBatch"};
+    int err;
+
+    // Frames alternate between two sets of buffers, so a frame can render
+    // while the image of the previous one is read back.
+    struct Slot {
+        cl_mem accum, image;
+        std::unique_ptr<Readback> readback;
+        std::vector<uint8_t> pixels;
+        long frame;
+    } slots[2];
+
+    cl_command_queue transferQueue = clCreateCommandQueue(_context, _device,
+            0, &err);
+    stop_if(err < 0, "failed to create the transfer queue. Error %d.", err);
+
+    slots[0].accum = _accumBuffer;
+    slots[0].image = _outputBuffer;
+    slots[1].accum = clCreateBuffer(_context, CL_MEM_READ_WRITE,
+            accumPixelSize(_accumFormat) * _width * _height, NULL, &err);
+    stop_if(err < 0, "failed to create the accumulation buffer. Error %d.",
+            err);
+    slots[1].image = clCreateBuffer(_context, CL_MEM_READ_WRITE,
+            3 * _width * _height, NULL, &err);
+    stop_if(err < 0, "failed to create the output image. Error %d.", err);
+
+    for(Slot &slot : slots) {
+        slot.readback = std::make_unique<Readback>(_context, transferQueue,
+                _width, _height);
+        slot.frame = -1;
+    }
+
+    // Waits for the image of the slot and hands it to the callback.
+    auto finishSlot = [&](Slot &slot) {
+        if(slot.frame < 0)
+            return;
+
+        const uint8_t *pixels = slot.readback->wait();
+        slot.pixels.assign(pixels, pixels + 3 * _width * _height);
+        slot.readback->release();
+
+        onFrame(frames[slot.frame], slot.pixels);
+        slot.frame = -1;
+    };
+
+    auto time = getTime();
+
+    for(size_t i = 0; i < frames.size(); ++i) {
+        Slot &slot = slots[i % 2];
+        const BatchFrame &frame = frames[i];
+
+        // The frame that used these buffers was enqueued two frames ago.
+        finishSlot(slot);
+
+        // Only the camera changes between the frames.
+        _screen.lookAt(frame.position, frame.target, frame.up, frame.fovy);
+        setCameraArg();
+        resetGuide();
+
+        err = clSetKernelArg(_sampleKernel, 4, sizeof(slot.accum),
+                &slot.accum);
+        if(_bidirectional || _sppmPhotons)
+            err |= clSetKernelArg(_resolveKernel, 1, sizeof(slot.accum),
+                    &slot.accum);
+        stop_if(err != CL_SUCCESS, "failed to set the frame accumulator.");
+
+        cl_event kernelDone;
+        for(int pass = 0; pass < _numPasses; ++pass)
+            enqueuePass(pass, NULL);
+        // The AOVs are consumed by the denoiser before the next frame renders
+        // on the same queue, so they aren't double buffered.
+        enqueueOutput(slot.accum, _aovBuffer, _numPasses, slot.image,
+                &kernelDone);
+        clFlush(_queue);
+
+        slot.readback->enqueue(slot.image, 1, &kernelDone);
+        clReleaseEvent(kernelDone);
+
+        slot.frame = i;
+    }
+
+    // Finish the last frames in order.
+    finishSlot(slots[frames.size() % 2]);
+    finishSlot(slots[(frames.size() + 1) % 2]);
+
+    _times.kernel = getTime() - time;
+    std::cout << "Rendered " << frames.size() << " frames in "
+        << _times.kernel << "ms ("
+        << _times.kernel / std::max(frames.size(), (size_t) 1)
+        << "ms per frame)" << std::endl;
+
+    // Go back to the buffers of sample().
+    err = clSetKernelArg(_sampleKernel, 4, sizeof(_accumBuffer),
+            &_accumBuffer);
+    if(_bidirectional || _sppmPhotons)
+        err |= clSetKernelArg(_resolveKernel, 1, sizeof(_accumBuffer),
+                &_accumBuffer);
+    stop_if(err != CL_SUCCESS, "failed to restore the accumulator.");
+    _passIndex = _resumedPasses = 0;
+    resetGuide();
+
+    for(Slot &slot : slots)
+        slot.readback.reset();
+    clReleaseMemObject(slots[1].image);
+    clReleaseMemObject(slots[1].accum);
+    clReleaseCommandQueue(transferQueue);
+}
+
+void Sampler::SamplerImpl::enqueuePass(cl_uint pass, cl_event *event) {
+    int err;
+
+    // The seeds of each pass don't overlap with the other passes.
+    cl_uint offset = pass * _workSize[0] * _workSize[1];
+    cl_uint seed[2] = {42 + offset, 84 + offset};
+    err = clSetKernelArg(_sampleKernel, 1, sizeof(seed), &seed);
+    stop_if(err < 0, "failed to set the pass seed. Error %d.", err);
+
+    err = clSetKernelArg(_sampleKernel, 5, sizeof(pass), &pass);
+    stop_if(err < 0, "failed to set the pass index. Error %d.", err);
+
+    // The first passes train the path guiding and the next ones sample it.
+    cl_uint guidePhase = GuideOff;
+    if(_guidePasses)
+        guidePhase = _guideTrained < _guidePasses ? GuideTraining
+            : GuideSampling;
+    err = clSetKernelArg(_sampleKernel, 9, sizeof(guidePhase), &guidePhase);
+    stop_if(err < 0, "failed to set the path guiding phase. Error %d.", err);
+
+    size_t globalOffset[2] = {0, 0};
+    err = clEnqueueNDRangeKernel(_queue, _sampleKernel, 2, globalOffset,
+            _workSize, _raySorting ? _localSize : NULL, 0, NULL, event);
+    stop_if(err < 0, "failed to enqueue kernel execution. Error %d.", err);
+
+    if(_sppmPhotons)
+        enqueuePhotons(pass);
+
+    // The splats or the photons of the pass reach the accumulator once all of
+    // them are done.
+    if(_bidirectional || _sppmPhotons) {
+        err = clSetKernelArg(_resolveKernel, 3, sizeof(pass), &pass);
+        stop_if(err < 0, "failed to set the resolve pass. Error %d.", err);
+
+        err = clEnqueueNDRangeKernel(_queue, _resolveKernel, 2, globalOffset,
+                _workSize, NULL, 0, NULL, NULL);
+        stop_if(err < 0, "failed to enqueue the resolve kernel. Error %d.",
+                err);
+    }
+
+    if(guidePhase == GuideTraining && ++_guideTrained == _guidePasses)
+        buildGuide();
+}
+
+void Sampler::SamplerImpl::enqueuePhotons(cl_uint pass) {
+    int err;
+
+    // The visible points are sorted by their cell, as a counting sort.
+    size_t numPixels = (size_t) _width * _height;
+    size_t scanSize = CodeGenerator::SppmScanGroupSize;
+    err = clEnqueueNDRangeKernel(_queue, _sppmCountKernel, 1, NULL,
+            &numPixels, NULL, 0, NULL, NULL);
+    err |= clEnqueueNDRangeKernel(_queue, _sppmScanKernel, 1, NULL,
+            &scanSize, &scanSize, 0, NULL, NULL);
+    err |= clEnqueueNDRangeKernel(_queue, _sppmScatterKernel, 1, NULL,
+            &numPixels, NULL, 0, NULL, NULL);
+    stop_if(err != CL_SUCCESS, "failed to enqueue the photon mapping grid.");
+
+    // The seeds of the photons are far from those of the camera paths.
+    cl_uint offset = pass * _sppmPhotons;
+    cl_uint seed[2] = {0x80000000u + offset, 0xc0000000u + offset};
+    err = clSetKernelArg(_sppmPhotonKernel, 0, sizeof(seed), &seed);
+    stop_if(err < 0, "failed to set the photon seed. Error %d.", err);
+
+    size_t numPhotons = _sppmPhotons;
+    err = clEnqueueNDRangeKernel(_queue, _sppmPhotonKernel, 1, NULL,
+            &numPhotons, NULL, 0, NULL, NULL);
+    stop_if(err < 0, "failed to enqueue the photon kernel. Error %d.", err);
+}
+
+void Sampler::SamplerImpl::buildGuide() {
+    ScopedTimer timer{"buildGuide"};
+    const int numBins = CodeGenerator::GuideResolution
+        * CodeGenerator::GuideResolution;
+    const size_t size = (size_t) CodeGenerator::GuideCells * numBins;
+
+    // Waits for the training passes, which are before it in the queue.
+    std::vector<cl_uint> counters(2 * size);
+    int err = clEnqueueReadBuffer(_queue, _guideTrain, CL_TRUE, 0,
+            counters.size() * sizeof(cl_uint), counters.data(), 0, NULL,
+            NULL);
+    stop_if(err < 0, "failed to read the path guiding counters. Error %d.",
+            err);
+
+    // Part of each distribution is spread evenly, so that no direction has
+    // a pdf of 0 because it was missed by the training. The cells without
+    // training are uniform.
+    std::vector<cl_float> cdf(size);
+    std::vector<double> light(numBins);
+    int trainedCells = 0;
+    for(size_t cell = 0; cell < size; cell += numBins) {
+        double sum = 0.0;
+        for(int bin = 0; bin < numBins; ++bin) {
+            size_t i = 2 * (cell + bin);
+            light[bin] = counters[i] + 4294967296.0 * counters[i + 1];
+            sum += light[bin];
+        }
+
+        double uniform = GuideUniformFraction;
+        if(sum == 0.0)
+            uniform = 1.0;
+        double cumulative = 0.0;
+        for(int bin = 0; bin < numBins; ++bin) {
+            cumulative += uniform / numBins;
+            if(sum > 0.0)
+                cumulative += (1.0 - uniform) * light[bin] / sum;
+            cdf[cell + bin] = (cl_float) cumulative;
+        }
+        cdf[cell + numBins - 1] = 1.0f;
+        trainedCells += sum > 0.0;
+    }
+
+    err = clEnqueueWriteBuffer(_queue, _guideCdf, CL_TRUE, 0,
+            cdf.size() * sizeof(cl_float), cdf.data(), 0, NULL, NULL);
+    stop_if(err < 0, "failed to upload the path guiding distributions. "
+            "Error %d.", err);
+
+    std::cout << "Path guiding trained on " << _guideTrained << " passes ("
+        << trainedCells << " of " << CodeGenerator::GuideCells << " cells)"
+        << std::endl;
+}
+
+void Sampler::SamplerImpl::resetGuide() {
+    _guideTrained = 0;
+    if(!_guidePasses)
+        return;
+
+    // Ordered after the passes that trained on the previous camera.
+    std::vector<cl_uint> counters(2 * CodeGenerator::GuideCells
+            * CodeGenerator::GuideResolution * CodeGenerator::GuideResolution,
+            0);
+    int err = clEnqueueWriteBuffer(_queue, _guideTrain, CL_TRUE, 0,
+            counters.size() * sizeof(cl_uint), counters.data(), 0, NULL,
+            NULL);
+    stop_if(err < 0, "failed to clear the path guiding counters. Error %d.",
+            err);
+}
+
+cl_mem Sampler::SamplerImpl::enqueueDenoise(cl_mem accum, cl_mem aovs,
+        cl_uint numPasses) {
+    int err;
+    cl_int size[2] = {_width, _height};
+    size_t globalOffset[2] = {0, 0};
+    size_t workSize[2] = {(size_t) _width, (size_t) _height};
+
+    // Enqueues the kernel from the buffer in to the buffer out.
+    auto enqueue = [&](cl_kernel kernel, cl_mem in, cl_mem out,
+            int outIndex) {
+        err = clSetKernelArg(kernel, 0, sizeof(in), &in);
+        err |= clSetKernelArg(kernel, 1, sizeof(aovs), &aovs);
+        err |= clSetKernelArg(kernel, 2, sizeof(size), &size);
+        err |= clSetKernelArg(kernel, 3, sizeof(numPasses), &numPasses);
+        err |= clSetKernelArg(kernel, outIndex, sizeof(out), &out);
+        stop_if(err != CL_SUCCESS, "failed to set the denoiser arguments.");
+
+        err = clEnqueueNDRangeKernel(_queue, kernel, 2, globalOffset,
+                workSize, NULL, 0, NULL, NULL);
+        stop_if(err < 0, "failed to enqueue the denoiser. Error %d.", err);
+    };
+
+    // The lighting is filtered with the albedo divided out, ping-ponging
+    // between the two buffers.
+    enqueue(_demodulateKernel, accum, _denoiseBuffers[0], 4);
+
+    cl_float colorSigma = 1.0f;
+    for(int i = 0; i < DenoiseIterations; ++i) {
+        cl_int step = 1 << i;
+        err = clSetKernelArg(_atrousKernel, 4, sizeof(step), &step);
+        err |= clSetKernelArg(_atrousKernel, 5, sizeof(colorSigma),
+                &colorSigma);
+        stop_if(err != CL_SUCCESS, "failed to set the denoiser arguments.");
+
+        enqueue(_atrousKernel, _denoiseBuffers[i % 2],
+                _denoiseBuffers[(i + 1) % 2], 6);
+        colorSigma *= 0.5f;
+    }
+
+    cl_mem filtered = _denoiseBuffers[DenoiseIterations % 2];
+    cl_mem output = _denoiseBuffers[(DenoiseIterations + 1) % 2];
+    enqueue(_remodulateKernel, filtered, output, 4);
+
+    return output;
+}
+
+void Sampler::SamplerImpl::enqueueOutput(cl_mem accum, cl_mem aovs,
+        cl_uint numPasses, cl_mem output, cl_event *event) {
+    if(_denoise) {
+        accum = enqueueDenoise(accum, aovs, numPasses);
+        numPasses = 1;
+    }
+
+    enqueueTonemap(accum, output, numPasses, event);
+}
+
+void Sampler::SamplerImpl::enqueueTonemap(cl_mem accum, cl_mem output,
+        cl_uint numPasses, cl_event *event) {
+    int err;
+
+    err = clSetKernelArg(_tonemapKernel, 0, sizeof(accum), &accum);
+    err |= clSetKernelArg(_tonemapKernel, 2, sizeof(numPasses), &numPasses);
+    err |= clSetKernelArg(_tonemapKernel, 5, sizeof(output), &output);
+    stop_if(err != CL_SUCCESS, "failed to set the tonemap kernel arguments.");
+
+    size_t globalOffset[2] = {0, 0};
+    size_t workSize[2] = {(size_t) _width, (size_t) _height};
+    err = clEnqueueNDRangeKernel(_queue, _tonemapKernel, 2, globalOffset,
+            workSize, NULL, 0, NULL, event);
+    stop_if(err < 0, "failed to enqueue the tonemap kernel. Error %d.", err);
+}
+
+void Sampler::SamplerImpl::setCamera(const Point &position,
+        const Point &target, const Vector &up, float fovy) {
+    _screen.lookAt(position, target, up, fovy);
+    setCameraArg();
+    _passIndex = _resumedPasses = 0;
+    resetGuide();
+}
+
+void Sampler::SamplerImpl::setCameraArg() {
+    CameraArg camera;
+    memcpy(&camera.origin, _screen.cameraPos(), sizeof(camera.origin));
+    memcpy(&camera.topLeft, _screen.topLeftPixelPos(), sizeof(camera.topLeft));
+    memcpy(&camera.up, _screen.upVector(), sizeof(camera.up));
+    memcpy(&camera.right, _screen.rightVector(), sizeof(camera.right));
+    camera.pixelWidth = _screen.pixelWidth();
+    camera.pixelHeight = _screen.pixelHeight();
+    camera.lensRadius = _screen.lensRadius();
+    camera.focusScale = _screen.focusScale();
+
+    _configHash = Checkpoint::hash(&camera, sizeof(camera), _sourceHash);
+
+    int err = clSetKernelArg(_sampleKernel, 0, sizeof(camera), &camera);
+    stop_if(err < 0, "failed to set the camera kernel argument. Error %d.",
+            err);
+}
+
+void Sampler::SamplerImpl::writeCheckpoint(cl_uint passIndex) {
+    Checkpoint checkpoint;
+    checkpoint.configHash = _configHash;
+    checkpoint.width = _width;
+    checkpoint.height = _height;
+    checkpoint.passIndex = passIndex;
+    checkpoint.accum.resize(accumPixelSize(_accumFormat) * _width * _height);
+    checkpoint.aovs.resize(_aovLayout.numChannels() * _width * _height
+            * aovValueSize(_aovFormat));
+
+    int err = clEnqueueReadBuffer(_queue, _accumBuffer, CL_TRUE, 0,
+            checkpoint.accum.size(), checkpoint.accum.data(), 0, NULL, NULL);
+    if(!checkpoint.aovs.empty())
+        err |= clEnqueueReadBuffer(_queue, _aovBuffer, CL_TRUE, 0,
+                checkpoint.aovs.size(), checkpoint.aovs.data(), 0, NULL,
+                NULL);
+    stop_if(err != CL_SUCCESS, "failed to read the checkpoint buffers.");
+
+    checkpoint.writeTo(_checkpointFilename);
+    std::cout << "Checkpoint of " << passIndex << " passes saved to "
+        << _checkpointFilename << std::endl;
+}
+
+bool Sampler::SamplerImpl::resume(const std::string &filename) {
+    Checkpoint checkpoint;
+    if(!checkpoint.readFrom(filename))
+        return false;
+
+    stop_if(checkpoint.configHash != _configHash || checkpoint.width != _width
+            || checkpoint.height != _height
+            || checkpoint.accum.size()
+                != accumPixelSize(_accumFormat) * _width * _height
+            || checkpoint.aovs.size() != _aovLayout.numChannels() * _width
+                * _height * aovValueSize(_aovFormat),
+            "the checkpoint %s was saved with another scene or options.",
+            filename.c_str());
+
+    int err = clEnqueueWriteBuffer(_queue, _accumBuffer, CL_TRUE, 0,
+            checkpoint.accum.size(), checkpoint.accum.data(), 0, NULL, NULL);
+    if(!checkpoint.aovs.empty())
+        err |= clEnqueueWriteBuffer(_queue, _aovBuffer, CL_TRUE, 0,
+                checkpoint.aovs.size(), checkpoint.aovs.data(), 0, NULL,
+                NULL);
+    stop_if(err != CL_SUCCESS, "failed to upload the checkpoint buffers.");
+
+    // The next pass continues the RNG streams of the checkpoint.
+    _passIndex = _resumedPasses = checkpoint.passIndex;
+    std::cout << "Resumed " << _passIndex << " passes from " << filename
+        << std::endl;
+    return true;
+}
+
+std::vector<float> Sampler::SamplerImpl::radiance() {
+    stop_if(!_passIndex, "there are no passes in the accumulator.");
+    return readRadiance(_passIndex);
+}
+
+double Sampler::SamplerImpl::noise() {
+    stop_if(!_passIndex, "there are no passes in the accumulator.");
+    stop_if(!_aovLayout.has(CmdArgs::VarianceAov),
+            "the variance AOV isn't recorded.");
+    return estimateNoise(_passIndex);
+}
+
+bool Sampler::SamplerImpl::withinBudget(int numPasses, double elapsed,
+        int &noiseCheck) {
+    // Stop before a pass that would end after the deadline, expecting it to
+    // cost as much as the average of the previous passes.
+    if(_timeBudget > 0.0 && elapsed * (numPasses + 1) / numPasses > _timeBudget)
+        return false;
+
+    if(_targetRmse > 0.0f && numPasses >= noiseCheck) {
+        double noise = estimateNoise(_passIndex + numPasses);
+        if(noise <= _targetRmse)
+            return false;
+
+        // The noise falls with the square root of the passes. The estimate
+        // of few passes is noisy too, so the passes at most double before
+        // the next one.
+        double needed = (_passIndex + numPasses) * (noise / _targetRmse)
+            * (noise / _targetRmse) - _passIndex;
+        noiseCheck = std::max(numPasses + 1,
+                (int) std::min(std::ceil(needed), 2.0 * numPasses));
+    }
+
+    return true;
+}
+
+double Sampler::SamplerImpl::estimateNoise(int numPasses) {
+    std::vector<float> color = readRadiance(numPasses);
+    std::vector<float> variance = readVariance(color, numPasses);
+
+    double sumVariance = 0.0, sumLuminance = 0.0;
+    for(size_t i = 0; i < variance.size(); ++i) {
+        sumVariance += variance[i];
+        sumLuminance += 0.2126f * color[3 * i] + 0.7152f * color[3 * i + 1]
+            + 0.0722f * color[3 * i + 2];
+    }
+
+    return std::sqrt(sumVariance / variance.size())
+        / std::max(sumLuminance / variance.size(), 1e-9);
+}
+
+std::vector<float> Sampler::SamplerImpl::readRadiance(int numPasses) {
+    size_t numPixels = _width * _height;
+    std::vector<uint8_t> accum(accumPixelSize(_accumFormat) * numPixels);
+    int err = clEnqueueReadBuffer(_queue, _accumBuffer, CL_TRUE, 0,
+            accum.size(), accum.data(), 0, NULL, NULL);
+    stop_if(err < 0, "failed to read the accumulator. Error %d.", err);
+
+    return decodeAccum(_accumFormat, accum, numPixels, numPasses);
+}
+
+std::vector<float> Sampler::SamplerImpl::readVariance(
+        const std::vector<float> &color, int numPasses) {
+    size_t numPixels = _width * _height;
+    size_t planeSize = aovValueSize(_aovFormat) * numPixels;
+    std::vector<uint8_t> plane(planeSize);
+    int err = clEnqueueReadBuffer(_queue, _aovBuffer, CL_TRUE,
+            _aovLayout.channel(CmdArgs::VarianceAov) * planeSize, planeSize,
+            plane.data(), 0, NULL, NULL);
+    stop_if(err < 0, "failed to read the variance AOV. Error %d.", err);
+
+    // Variance of the mean luminance, from the mean of the squared
+    // luminances of the paths.
+    std::vector<float> variance = decodeAov(_aovFormat, plane, 0, numPixels,
+            numPasses);
+    float numPaths = (float) numPasses * _numSamples * _aaLevel * _aaLevel;
+    for(size_t i = 0; i < numPixels; ++i) {
+        float mean = 0.2126f * color[3 * i] + 0.7152f * color[3 * i + 1]
+            + 0.0722f * color[3 * i + 2];
+        variance[i] = std::max(variance[i] - mean * mean, 0.0f) / numPaths;
+    }
+
+    return variance;
+}
+
+void Sampler::SamplerImpl::writeAovs(const std::string &filename) {
+    ScopedTimer timer{"writeAovs"};
+    int err;
+
+    size_t numPixels = _width * _height;
+    std::vector<float> color = radiance();
+
+    std::vector<uint8_t> aovs(_aovLayout.numChannels() * numPixels
+            * aovValueSize(_aovFormat));
+    if(!aovs.empty()) {
+        err = clEnqueueReadBuffer(_queue, _aovBuffer, CL_TRUE, 0,
+                aovs.size(), aovs.data(), 0, NULL, NULL);
+        stop_if(err < 0, "failed to read the AOV framebuffer. Error %d.", err);
+    }
+
+    // Returns the average of the passes of the channel, or its stored values
+    // if numPasses is 0.
+    auto plane = [&](int channel, int numPasses) {
+        return decodeAov(_aovFormat, aovs, channel, numPixels, numPasses);
+    };
+
+    ExrImage image{_width, _height};
+    const char *rgb[3] = {"R", "G", "B"};
+    for(int c = 0; c < 3; ++c) {
+        std::vector<float> pixels(numPixels);
+        for(size_t i = 0; i < numPixels; ++i)
+            pixels[i] = color[3 * i + c];
+        image.addChannel(rgb[c], std::move(pixels));
+    }
+
+    if(_aovLayout.has(CmdArgs::AlbedoAov)) {
+        int channel = _aovLayout.channel(CmdArgs::AlbedoAov);
+        for(int c = 0; c < 3; ++c)
+            image.addChannel(std::string("albedo.") + rgb[c],
+                    plane(channel + c, _passIndex));
+    }
+    if(_aovLayout.has(CmdArgs::NormalAov)) {
+        int channel = _aovLayout.channel(CmdArgs::NormalAov);
+        const char *xyz[3] = {"X", "Y", "Z"};
+        for(int c = 0; c < 3; ++c)
+            image.addChannel(std::string("normal.") + xyz[c],
+                    plane(channel + c, _passIndex));
+    }
+    if(_aovLayout.has(CmdArgs::DepthAov))
+        image.addChannel("Z", plane(_aovLayout.channel(CmdArgs::DepthAov),
+                _passIndex));
+    if(_aovLayout.has(CmdArgs::IDAov)) {
+        int channel = _aovLayout.channel(CmdArgs::IDAov);
+        image.addChannel("id.object", plane(channel, 0));
+        image.addChannel("id.material", plane(channel + 1, 0));
+    }
+    if(_aovLayout.has(CmdArgs::SamplesAov)) {
+        // The paths of each pass are accumulated as an average too.
+        auto spp = plane(_aovLayout.channel(CmdArgs::SamplesAov), _passIndex);
+        for(float &value : spp)
+            value *= _passIndex;
+        image.addChannel("spp", std::move(spp));
+    }
+    if(_aovLayout.has(CmdArgs::VarianceAov))
+        image.addChannel("variance.Y", readVariance(color, _passIndex));
+
+    image.writeTo(filename);
+}
+
+void Sampler::SamplerImpl::profileEvent(cl_event event, const char *name,
+        Time queued) {
+    cl_ulong queuedNs, startNs, endNs;
+    int err;
+
+    err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED,
+            sizeof(queuedNs), &queuedNs, NULL);
+    err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+            sizeof(startNs), &startNs, NULL);
+    err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+            sizeof(endNs), &endNs, NULL);
+    stop_if(err != CL_SUCCESS, "failed to get the profiling info of %s.",
+            name);
+    clReleaseEvent(event);
+
+    // The device clock has another origin, so align it to the enqueue time.
+    Time start = queued + (startNs - queuedNs) / 1e6;
+    Profiler::instance().addEvent(name, "device", start,
+            (endNs - startNs) / 1e6, Profiler::DeviceThread);
+}
+
+std::vector<MathBenchmark> Sampler::SamplerImpl::benchmarkMath(
+        int iterations) {
+    // Outputs of the mathAccuracy kernel, in the order of the MathFunction
+    // enum of mathbench.cl.
+    enum {
+        SqrtOutput, PowrOutput, Sin2PiOutput, Cos2PiOutput, NormalizeOutput,
+        NumOutputs
+    };
+    static const struct {
+        const char *name;
+        int first, last;    /// Outputs compared for the function.
+    } functions[] = {
+        {"sqrt", SqrtOutput, SqrtOutput},
+        {"powr", PowrOutput, PowrOutput},
+        {"sincos2pi", Sin2PiOutput, Cos2PiOutput},
+        {"normalize", NormalizeOutput, NormalizeOutput}
+    };
+    const size_t numInputs = 1 << 16;
+    int err;
+
+    // Spread the inputs over the ranges of the sampling code, with exponents
+    // from 1/16 to 1024 like the specular exponents and their inverses.
+    std::vector<cl_float4> inputs(numInputs);
+    std::vector<double> reference(NumOutputs * numInputs);
+    for(size_t i = 0; i < numInputs; ++i) {
+        double x = (i + 0.5) / numInputs;
+        double y = std::fmod(i * 0.6180339887, 1.0) - 0.5;
+        double z = std::fmod(i * 0.4142135624, 1.0) - 0.5;
+        double w = std::exp2(-4.0 + 14.0 * std::fmod(i * 0.7320508076, 1.0));
+        inputs[i] = cl_float4{{(float) x, (float) y, (float) z, (float) w}};
+
+        // The reference takes the inputs as rounded to float.
+        x = (float) x;
+        y = (float) y;
+        z = (float) z;
+        w = (float) w;
+        double *ref = &reference[NumOutputs * i];
+        ref[SqrtOutput] = std::sqrt(x);
+        ref[PowrOutput] = std::pow(x, w);
+        ref[Sin2PiOutput] = std::sin(2.0 * M_PI * x);
+        ref[Cos2PiOutput] = std::cos(2.0 * M_PI * x);
+        ref[NormalizeOutput] = x / std::sqrt(x * x + y * y + z * z);
+    }
+
+    cl_mem inputBuffer = clCreateBuffer(_context,
+            CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+            sizeof(cl_float4) * numInputs, inputs.data(), &err);
+    stop_if(err < 0, "failed to create the math input buffer. Error %d.", err);
+    cl_mem outputBuffer = clCreateBuffer(_context, CL_MEM_READ_WRITE,
+            sizeof(cl_float) * NumOutputs * numInputs, NULL, &err);
+    stop_if(err < 0, "failed to create the math output buffer. Error %d.",
+            err);
+
+    std::vector<MathBenchmark> results;
+    for(bool fastMath : {false, true}) {
+        const char source[] = "#include \"mathbench.cl\"\n";
+        std::string options = SAMPLER_BUILD_OPTIONS;
+        if(fastMath)
+            options += "-D FastMath ";
+
+        cl_program program = cluBuildProgram(_context, _device, source,
+                sizeof(source) - 1, options.c_str(), &err);
+        stop_if(err < 0, "failed to compile the math benchmark.");
+        cl_kernel accuracyKernel = clCreateKernel(program, "mathAccuracy",
+                &err);
+        stop_if(err < 0, "failed to create the mathAccuracy kernel. Error %d.",
+                err);
+        cl_kernel throughputKernel = clCreateKernel(program, "mathThroughput",
+                &err);
+        stop_if(err < 0, "failed to create the mathThroughput kernel. "
+                "Error %d.", err);
+
+        err = clSetKernelArg(accuracyKernel, 0, sizeof(cl_mem), &inputBuffer);
+        err |= clSetKernelArg(accuracyKernel, 1, sizeof(cl_mem),
+                &outputBuffer);
+        stop_if(err < 0, "failed to set the mathAccuracy arguments.");
+
+        std::vector<cl_float> outputs(NumOutputs * numInputs);
+        size_t workSize = numInputs;
+        err = clEnqueueNDRangeKernel(_queue, accuracyKernel, 1, NULL,
+                &workSize, NULL, 0, NULL, NULL);
+        stop_if(err < 0, "failed to enqueue the mathAccuracy kernel. "
+                "Error %d.", err);
+        err = clEnqueueReadBuffer(_queue, outputBuffer, CL_TRUE, 0,
+                sizeof(cl_float) * outputs.size(), outputs.data(), 0, NULL,
+                NULL);
+        stop_if(err < 0, "failed to read the math outputs. Error %d.", err);
+
+        cl_uint numIterations = iterations;
+        err = clSetKernelArg(throughputKernel, 0, sizeof(cl_uint),
+                &numIterations);
+        err |= clSetKernelArg(throughputKernel, 2, sizeof(cl_mem),
+                &outputBuffer);
+        stop_if(err < 0, "failed to set the mathThroughput arguments.");
+
+        for(const auto &function : functions) {
+            MathBenchmark result{function.name, fastMath, 0.0, 0.0, 0.0};
+            for(size_t i = 0; i < numInputs; ++i) {
+                for(int j = function.first; j <= function.last; ++j) {
+                    double ref = reference[NumOutputs * i + j];
+                    double error = std::fabs(outputs[NumOutputs * i + j]
+                            - ref);
+                    result.maxAbsError = std::max(result.maxAbsError, error);
+                    if(std::fabs(ref) > 1e-3)
+                        result.maxRelError = std::max(result.maxRelError,
+                                error / std::fabs(ref));
+                }
+            }
+
+            // The first run is a warm-up.
+            cl_int functionArg = function.first;
+            err = clSetKernelArg(throughputKernel, 1, sizeof(cl_int),
+                    &functionArg);
+            stop_if(err < 0, "failed to set the mathThroughput function.");
+            Time time = 0.0;
+            for(int run = 0; run < 2; ++run) {
+                time = getTime();
+                err = clEnqueueNDRangeKernel(_queue, throughputKernel, 1, NULL,
+                        &workSize, NULL, 0, NULL, NULL);
+                stop_if(err < 0, "failed to enqueue the mathThroughput "
+                        "kernel. Error %d.", err);
+                err = clFinish(_queue);
+                stop_if(err < 0, "failed to wait for the mathThroughput "
+                        "kernel. Error %d.", err);
+                time = getTime() - time;
+            }
+            result.time = time * 1e6 / ((double) numInputs * iterations);
+
+            results.push_back(result);
+        }
+
+        clReleaseKernel(throughputKernel);
+        clReleaseKernel(accuracyKernel);
+        clReleaseProgram(program);
+    }
+
+    clReleaseMemObject(outputBuffer);
+    clReleaseMemObject(inputBuffer);
+    return results;
+}
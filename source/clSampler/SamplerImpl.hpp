@@ -25,10 +25,49 @@
 
 #include "../Sampler.hpp"
 #include "../utils.hpp"
+#include "AovLayout.hpp"
 #include "OpenCL.h"
+#include "Readback.hpp"
+
+#include <vector>
+
+/**
+ * Camera kernel argument. Must match the Camera struct of camera.cl.
+ */
+struct CameraArg {
+    cl_float4 origin, topLeft, up, right;
+    cl_float pixelWidth, pixelHeight;
+    cl_float lensRadius, focusScale;
+};
+static_assert(sizeof(CameraArg) == 5 * sizeof(cl_float4),
+        "CameraArg must have the layout of the OpenCL Camera struct.");
 
 class Sampler::SamplerImpl {
+    /// Number of fields of the Counters struct of counters.cl.
+    static const int NumKernelCounters = 3;
+
+    /// Number of iterations of the a-trous filter of the denoiser.
+    static const int DenoiseIterations = 5;
+
+    /// Passes of the first noise estimate of a render with a target RMSE.
+    static const int FirstNoiseCheck = 2;
+
+    /// Phases of the path guiding. Must match the GuidePhase of guide.cl.
+    enum GuidePhase {GuideOff, GuideTraining, GuideSampling};
+
+    /// Part of the path guiding distributions spread evenly over the bins.
+    static constexpr double GuideUniformFraction = 0.1;
+
+    /// Number of float4 of the SppmPixel struct of sppm.cl.
+    static const int SppmPixelVectors = 7;
+
     int _width, _height;
+    int _numSamples, _aaLevel, _numPasses;
+    bool _packetTracing, _raySorting, _profiling, _denoise, _bidirectional;
+    float _exposure;         /// Scale of the colors before tonemapping.
+    CmdArgs::AccumFormat _accumFormat; /// Format of the accumulators.
+    CmdArgs::AccumFormat _aovFormat;   /// Format of the AOV framebuffer.
+    AovLayout _aovLayout;    /// Channels of the AOV framebuffer.
     cl_platform_id _platform;
     cl_device_id _device;
     cl_context _context;
@@ -36,16 +75,165 @@ class Sampler::SamplerImpl {
     cl_program _program;
 
     cl_kernel _sampleKernel; /// Path Tracer entry point.
+    cl_kernel _tonemapKernel; /// Converts the accumulator to the output.
+    cl_kernel _demodulateKernel, _atrousKernel, _remodulateKernel;
+    /// Adds the film of -bdpt or the photons of -sppm to the accumulator.
+    cl_kernel _resolveKernel;
+    /// Build the photon mapping grid and trace the photons.
+    cl_kernel _sppmCountKernel, _sppmScanKernel, _sppmScatterKernel;
+    cl_kernel _sppmPhotonKernel;
+    size_t _workSize[2];     /// Global work size of the kernel.
+    size_t _localSize[2];    /// Work group size when sorting.
+
+    Screen _screen;          /// Current viewpoint.
 
-    cl_mem _originBuffer;    /// Origin of the ray.
-    cl_mem _topLeftBuffer;   /// Top left pixel position.
-    cl_mem _upBuffer;        /// Up vector
-    cl_mem _rightBuffer;     /// Right vector
-    cl_mem _outputImage;     /// Output image.
+    cl_mem _outputBuffer;    /// Output image, in 8 bit RGB.
+    cl_mem _blueNoise;       /// Dither mask of the tonemap kernel.
+    cl_mem _counters;        /// Kernel statistics (rays, bounces, etc).
+    cl_mem _accumBuffer;     /// HDR sum of the passes.
+    cl_mem _aovBuffer;       /// AOV framebuffer, summed over the passes.
+    cl_mem _denoiseBuffers[2]; /// Images of the denoiser iterations.
+    cl_mem _sortStats;       /// Lane utilization counters when sorting.
+    cl_mem _filmBuffer;      /// Colors of the pass of -bdpt, with splats.
+
+    int _sppmPhotons;        /// Photons of a pass of -sppm, or 0.
+    cl_mem _sppmPixels;      /// Visible points and estimates of the pixels.
+    cl_mem _sppmMaxRadius;   /// Largest radius of the visible points.
+    cl_mem _sppmCounts;      /// Visible points of each cell of the grid.
+    cl_mem _sppmStarts;      /// First entry of each cell of the grid.
+    cl_mem _sppmEnds;        /// End of the entries of each cell of the grid.
+    cl_mem _sppmEntries;     /// Pixels of the visible points, by cell.
+    cl_mem _sppmFlux;        /// Photon flux of the pass at each pixel.
+    cl_mem _sppmPhotonCounts; /// Photons of the pass at each pixel.
+
+    SamplerTimes _times;     /// Time spent on each step.
+    int _passIndex;          /// Passes in the accumulator.
+
+    std::string _checkpointFilename; /// Empty if checkpoints are disabled.
+    double _checkpointInterval;      /// Minimum time between checkpoints.
+    uint64_t _sourceHash;    /// Hash of the generated program.
+    uint64_t _configHash;    /// Hash of the program and the camera.
+    int _resumedPasses;      /// Passes of the next sample() from a checkpoint.
+
+    double _timeBudget;      /// Time available for the passes, or 0.
+    float _targetRmse;       /// Relative RMSE where the passes stop, or 0.
+
+    int _guidePasses;        /// Training passes of the path guiding, or 0.
+    int _guideTrained;       /// Training passes enqueued so far.
+    cl_mem _guideTrain;      /// Path guiding training counters.
+    cl_mem _guideCdf;        /// Path guiding distributions of the cells.
+
+    PassCallback _passCallback;  /// Called with the image of each pass.
+
+    /// Pinned buffers where the output image is read back.
+    std::unique_ptr<Readback> _readbacks[2];
 
     std::string generateSource(const World &world, const Screen &screen,
             const CmdArgs &args);
-    void constructBuffers(const Screen &screen);
+    void constructBuffers();
+
+    /// Sets the camera kernel argument from the current screen.
+    void setCameraArg();
+
+    /**
+     * Enqueues a pass of the kernel on the queue.
+     * @param pass Index of the pass in the accumulator.
+     * @param event Set to the event of the kernel, if not NULL.
+     */
+    void enqueuePass(cl_uint pass, cl_event *event);
+
+    /**
+     * Enqueues the grid of the visible points of -sppm and the photons of the
+     * pass, after the kernel that found the points.
+     */
+    void enqueuePhotons(cl_uint pass);
+
+    /**
+     * Reads the path guiding training counters and uploads the distributions
+     * of the cells, which the passes sample from then on.
+     */
+    void buildGuide();
+
+    /**
+     * Clears the path guiding training, so that the next passes train it
+     * again. The cells are relative to the camera, so this is needed
+     * whenever the camera changes.
+     */
+    void resetGuide();
+
+    /**
+     * Enqueues the denoiser, which filters the average of the passes guided by
+     * the first hit albedo, normal and depth of the AOV framebuffer.
+     * @param numPasses Number of passes in the accumulators.
+     * @return Buffer with the denoised HDR image, as a single pass.
+     */
+    cl_mem enqueueDenoise(cl_mem accum, cl_mem aovs, cl_uint numPasses);
+
+    /**
+     * Enqueues the conversion of the accumulator to the 8 bit output image,
+     * denoising it first if enabled.
+     * @param numPasses Number of passes in the accumulators.
+     * @param event Set to the event of the last kernel, if not NULL.
+     */
+    void enqueueOutput(cl_mem accum, cl_mem aovs, cl_uint numPasses,
+            cl_mem output, cl_event *event);
+
+    /**
+     * Enqueues the conversion of the accumulator to the 8 bit output image.
+     * @param numPasses Number of passes in the accumulator.
+     * @param event Set to the event of the kernel, if not NULL.
+     */
+    void enqueueTonemap(cl_mem accum, cl_mem output, cl_uint numPasses,
+            cl_event *event);
+
+    /**
+     * Saves the accumulator and the AOV framebuffer to the checkpoint file.
+     * @param passIndex Number of passes in the buffers.
+     */
+    void writeCheckpoint(cl_uint passIndex);
+
+    /**
+     * Returns if another pass fits the time budget and the noise is above the
+     * target RMSE. Waits for the passes of the call, if needed.
+     * @param numPasses Passes already rendered by this sample() call.
+     * @param elapsed Time spent on these passes.
+     * @param noiseCheck Passes of the next noise estimate, updated from the
+     * passes the current estimate predicts to reach the target.
+     */
+    bool withinBudget(int numPasses, double elapsed, int &noiseCheck);
+
+    /**
+     * Returns the RMSE of the pixel luminances relative to their mean,
+     * estimated from the variance AOV.
+     * @param numPasses Number of passes in the buffers.
+     */
+    double estimateNoise(int numPasses);
+
+    /**
+     * Returns the average of the passes of the accumulator, as 3 floats per
+     * pixel.
+     * @param numPasses Number of passes in the accumulator.
+     */
+    std::vector<float> readRadiance(int numPasses);
+
+    /**
+     * Returns the variance of the mean luminance of each pixel, from the
+     * variance AOV.
+     * @param color Average of the passes, as returned by readRadiance().
+     * @param numPasses Number of passes in the buffers.
+     */
+    std::vector<float> readVariance(const std::vector<float> &color,
+            int numPasses);
+
+    /// Gives the image of the readback to the pass callback and releases it.
+    void publishReadback(Readback &readback, int numPasses);
+
+    /**
+     * Adds the execution of the event to the device timeline of the profiler
+     * and releases the event.
+     * @param queued Host time just before the command was enqueued.
+     */
+    void profileEvent(cl_event event, const char *name, Time queued);
 
 public:
     SamplerImpl() = delete;
@@ -59,7 +247,61 @@ public:
     ~SamplerImpl();
 
     /// Samples all pixels and returns the image.
-    std::unique_ptr<PPMImage> sample();
+    std::vector<uint8_t> sample();
+
+    /// Returns the time spent on each step.
+    inline const SamplerTimes &times() const {
+        return _times;
+    }
+
+    /**
+     * Moves the camera and restarts the accumulation.
+     * Look at Sampler::setCamera() for more information.
+     */
+    void setCamera(const Point &position, const Point &target,
+            const Vector &up, float fovy);
+
+    /**
+     * Renders a sequence of frames.
+     * Look at Sampler::renderBatch() for more information.
+     */
+    void renderBatch(const std::vector<BatchFrame> &frames,
+            FrameCallback onFrame);
+
+    /**
+     * Loads the passes saved to a checkpoint.
+     * Look at Sampler::resume() for more information.
+     */
+    bool resume(const std::string &filename);
+
+    /**
+     * Returns the average of the passes in the accumulator.
+     * Look at Sampler::radiance() for more information.
+     */
+    std::vector<float> radiance();
+
+    /**
+     * Returns the estimated noise of the average of the passes.
+     * Look at Sampler::noise() for more information.
+     */
+    double noise();
+
+    /**
+     * Writes the AOVs of the passes since the last camera change.
+     * Look at Sampler::writeAovs() for more information.
+     */
+    void writeAovs(const std::string &filename);
+
+    /**
+     * Runs the microbenchmark of the math functions.
+     * Look at Sampler::benchmarkMath() for more information.
+     */
+    std::vector<MathBenchmark> benchmarkMath(int iterations);
+
+    /// Sets the function called after each pass.
+    inline void setPassCallback(PassCallback callback) {
+        _passCallback = callback;
+    }
 };
 
 #endif // !SAMPLERIMPL_HPP
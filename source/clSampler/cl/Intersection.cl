@@ -27,9 +27,20 @@
 typedef enum IntersectionType {
     NoIntersection,
     SphereIntersection,
-    PolyhedronIntersection
+    PolyhedronIntersection,
+    PlaneIntersection,
+    QuadIntersection
 } IntersectionType;
 
+/// Closest intersection of a ray, as computed by trace().
+typedef struct Hit {
+    float4 position;
+    float4 normal;
+    IntersectionType type;
+    int id;
+    bool inside;
+} Hit;
+
 /**
  * Traces the ray cast by sample() and sees if it intersects anything. Returns
  * what happened.
@@ -48,12 +59,28 @@ typedef enum IntersectionType {
  * Set to 0 to ignore.
  * @param outInside Set to true if the ray is inside (the sphere) and to false
  * otherwise. Set to 0 to ignore.
+ * @param time Time of the ray in the shutter interval, where the moving
+ * objects are intersected. Ignored without MotionBlur.
  * @return The type of intersection.
  */
 IntersectionType trace(float4 origin, float4 direction,
         IntersectionType exclType, int exclID, float4 *endPos,
         int *outIntersectionID, float4 *outIntersection,
-        float4 *outIntersectionNormal, bool *outInside);
+        float4 *outIntersectionNormal, bool *outInside, float time);
+
+/**
+ * Returns the center of a sphere at the given time, which moves linearly by
+ * its velocity with MotionBlur and MovingSpheres.
+ */
+float4 sphereCenter(int id, float time);
+
+/**
+ * Returns where a point of an object was at time 0, where the textures are
+ * evaluated so that they move with the object. Static objects, or all of
+ * them without MotionBlur, return the point itself.
+ */
+float4 objectRestPosition(IntersectionType iType, int id, float4 p,
+        float time);
 
 /**
  * Tries to intersect with a sphere.
@@ -68,6 +95,46 @@ IntersectionType trace(float4 origin, float4 direction,
 float sphereIntersection(float4 origin, float4 dir, float4 center,
         float radius2, float maxT, bool *inside);
 
+/**
+ * Tries to intersect with a plane, from both sides.
+ * @param plane Coefficients (a, b, c, d) of ax + by + cz + d = 0, with a
+ * normalized normal (a, b, c).
+ * @param origin Origin of the ray.
+ * @param dir Direction of the ray.
+ * @param maxT Maximum parametric value. If the intersection generates a bigger
+ * parametric value, it is discarded.
+ * @return The parametric value used to calculate the intersection position.
+ */
+float planeIntersection(float4 plane, float4 origin, float4 dir, float maxT);
+
+/**
+ * Tries to intersect with a quad, from both sides.
+ * @param id ID of the quad to try to intersect.
+ * @param origin Origin of the ray.
+ * @param dir Direction of the ray.
+ * @param maxT Maximum parametric value. If the intersection generates a bigger
+ * parametric value, it is discarded.
+ * @return The parametric value used to calculate the intersection position.
+ */
+float quadIntersection(int id, float4 origin, float4 dir, float maxT);
+
+/**
+ * Returns the normal of the plane on the side the ray comes from.
+ */
+float4 planeNormal(float4 plane, float4 dir);
+
+/**
+ * Tests if the ray hits the given axis aligned bounding box before maxT.
+ * @param boundsMin Minimum corner of the box.
+ * @param boundsMax Maximum corner of the box.
+ * @param origin Origin of the ray.
+ * @param dir Direction of the ray.
+ * @param maxT Maximum parametric value.
+ * @return If the ray hits the box.
+ */
+bool boundsIntersection(float4 boundsMin, float4 boundsMax, float4 origin,
+        float4 dir, float maxT);
+
 /**
  * Tries to instersect with a polyhedron.
  * @param id ID of the polyhedron to try to intersect.
@@ -84,7 +151,7 @@ float polyhedronIntersection(int id, float4 origin, float4 dir, float maxT,
 IntersectionType trace(float4 origin, float4 direction,
         IntersectionType exclType, int exclID, float4 *endPos,
         int *outIntersectionID, float4 *outIntersection,
-        float4 *outIntersectionNormal, bool *outInside)
+        float4 *outIntersectionNormal, bool *outInside, float time)
 {
     float4 closestNormal;
     float closestT = FLT_MAX;
@@ -101,12 +168,38 @@ IntersectionType trace(float4 origin, float4 direction,
     else
         maxT = FLT_MAX;
 
+    // The planes and quads are intersected first: their tests are cheap, and
+    // the closest of their hits bounds the tests of the other objects, so
+    // walls skip the polyhedrons behind them by their bounding boxes.
+    for(int i = 0; i < NumPlanes; ++i) {
+        if(exclType == PlaneIntersection && i == exclID) continue;
+
+        float t = planeIntersection(planes[i].plane, origin, direction, maxT);
+
+        if(t > FLT_EPSILON && t < closestT) {
+            closestT = t;
+            closestType = PlaneIntersection;
+            closestID = i;
+        }
+    }
+    for(int i = 0; i < NumQuads; ++i) {
+        if(exclType == QuadIntersection && i == exclID) continue;
+
+        float t = quadIntersection(i, origin, direction, maxT);
+
+        if(t > FLT_EPSILON && t < closestT) {
+            closestT = t;
+            closestType = QuadIntersection;
+            closestID = i;
+        }
+    }
+
     // Intersect with spheres.
     for(int i = 0; i < NumSpheres; ++i) {
         if(exclType == SphereIntersection && i == exclID) continue;
 
-        float t = sphereIntersection(origin, direction, spheres[i].center,
-                spheres[i].radius2, maxT, &inside);
+        float t = sphereIntersection(origin, direction, sphereCenter(i, time),
+                spheres[i].radius2, min(maxT, closestT), &inside);
 
         if(t > FLT_EPSILON && t < closestT) {
             closestT = t;
@@ -119,8 +212,16 @@ IntersectionType trace(float4 origin, float4 direction,
     for(int i = 0; i < NumPolyhedrons; ++i) {
         if(exclType == PolyhedronIntersection && i == exclID) continue;
 
+        // A moving polyhedron is intersected where it was at time 0, by
+        // moving the ray back instead.
+        float4 movedOrigin = origin;
+#if defined(MotionBlur) && defined(MovingPolyhedrons)
+        movedOrigin -= polyhedronVelocity[i] * time;
+#endif
+
         float4 normal;
-        float t = polyhedronIntersection(i, origin, direction, maxT, &normal);
+        float t = polyhedronIntersection(i, movedOrigin, direction,
+                min(maxT, closestT), &normal);
 
         if(t > FLT_EPSILON && t < closestT) {
             closestT = t;
@@ -139,7 +240,7 @@ IntersectionType trace(float4 origin, float4 direction,
         if(closestType == SphereIntersection) {
             if(outIntersectionNormal) {
                 closestNormal = normalize(*outIntersection
-                        - spheres[closestID].center);
+                        - sphereCenter(closestID, time));
                 if(closestInside) // Invert the normal.
                     closestNormal *= -1.0f;
 
@@ -160,24 +261,63 @@ IntersectionType trace(float4 origin, float4 direction,
 
             return PolyhedronIntersection;
         }
+
+        // Planes and quads have no inside.
+        if(outIntersectionNormal) {
+            float4 plane = closestType == PlaneIntersection
+                ? planes[closestID].plane : quads[closestID].plane;
+            *outIntersectionNormal = planeNormal(plane, direction);
+        }
+        if(outInside)
+            *outInside = false;
+
+        return closestType;
     }
 
     return NoIntersection;
 }
 
+float4 sphereCenter(int id, float time) {
+#if defined(MotionBlur) && defined(MovingSpheres)
+    return spheres[id].center + sphereVelocity[id] * time;
+#else
+    return spheres[id].center;
+#endif
+}
+
+float4 objectRestPosition(IntersectionType iType, int id, float4 p,
+        float time) {
+#if defined(MotionBlur) && defined(MovingSpheres)
+    if(iType == SphereIntersection)
+        return p - sphereVelocity[id] * time;
+#endif
+#if defined(MotionBlur) && defined(MovingPolyhedrons)
+    if(iType == PolyhedronIntersection)
+        return p - polyhedronVelocity[id] * time;
+#endif
+    return p;
+}
+
 float sphereIntersection(float4 origin, float4 dir, float4 center,
         float radius2, float maxT, bool *inside)
 {
+    // The squared distance of the center to the ray is taken from the vector
+    // between them instead of dot(e, e) - tca^2, which cancels for large
+    // spheres, and the root of smaller magnitude from the product of the
+    // roots instead of tca - thc, which cancels when they are close (Haines
+    // et al., Precision Improvements for Ray/Sphere Intersection, 2019).
     float4 e = center - origin;
     float tca = dot(e, dir);
-    float d2 = dot(e, e) - pow(tca, 2);
-    if(d2 > radius2) return -1.0f; // No intersection.
+    float4 l = e - tca * dir;
+    float discriminant = radius2 - dot(l, l);
+    if(discriminant < 0.0f) return -1.0f; // No intersection.
 
-    float thc = sqrt(radius2 - d2);
-    float t1 = tca - thc;
-    float t2 = tca + thc;
+    float q = tca + copysign(sqrt(discriminant), tca);
+    float c = dot(e, e) - radius2;
+    float t1 = fmin(c / q, q);
+    float t2 = fmax(c / q, q);
 
-    // t1 is always smaller than t2 since t1 subtracts thc.
+    // t1 is always the smaller root.
     if(t1 > 0.0f && t1 < maxT) {
         *inside = false;
         return t1;
@@ -190,53 +330,109 @@ float sphereIntersection(float4 origin, float4 dir, float4 center,
     return -1.0f;
 }
 
+float planeIntersection(float4 plane, float4 origin, float4 dir, float maxT) {
+    float dn = dot(plane.xyz, dir.xyz);
+    if(fabs(dn) <= FLT_EPSILON) return -1.0f; // Parallel ray.
+
+    float t = -(dot(plane.xyz, origin.xyz) + plane.w) / dn;
+    return t < maxT ? t : -1.0f;
+}
+
+float quadIntersection(int id, float4 origin, float4 dir, float maxT) {
+    float t = planeIntersection(quads[id].plane, origin, dir, maxT);
+    if(t <= 0.0f) return -1.0f;
+
+    float4 p = origin + t * dir - quads[id].corner;
+    float s = dot(quads[id].uDual, p), r = dot(quads[id].vDual, p);
+    if(s < 0.0f || s > 1.0f || r < 0.0f || r > 1.0f) return -1.0f;
+
+    return t;
+}
+
+float4 planeNormal(float4 plane, float4 dir) {
+    float4 normal = (float4) (plane.xyz, 0.0f);
+    return dot(normal, dir) > 0.0f ? -normal : normal;
+}
+
+bool boundsIntersection(float4 boundsMin, float4 boundsMax, float4 origin,
+        float4 dir, float maxT) {
+    // Avoid dividing by zero on axis aligned rays.
+    float4 invDir = 1.0f / select(dir, copysign((float4) (FLT_EPSILON), dir),
+            fabs(dir) < (float4) (FLT_EPSILON));
+
+    float4 tA = (boundsMin - origin) * invDir;
+    float4 tB = (boundsMax - origin) * invDir;
+    float4 tLow = fmin(tA, tB), tHigh = fmax(tA, tB);
+
+    float tNear = max(max(tLow.x, tLow.y), tLow.z);
+    float tFar = min(min(tHigh.x, tHigh.y), tHigh.z);
+
+    return tFar >= max(tNear, 0.0f) && tNear < maxT;
+}
+
 float polyhedronIntersection(int id, float4 origin, float4 dir, float maxT,
         float4 *normal) {
-    int facesBegin = polyhedrons[id].facesBegin;
-    float t;
-    float t0 = 0.0f, t1 = FLT_MAX;
-    float4 nT0, nT1;
-
-    for(int i = 0; i < polyhedrons[id].numFaces; ++i) {
-        float4 p0 = (float4) (origin.xyz, 0.0f);
-        float4 n = (float4) (polyhedronFaces[facesBegin + i].xyz, 0.0f);
-        float dn = dot(dir, n); // hu
-        float val = dot(p0, n) + polyhedronFaces[facesBegin + i].w; // hp
-
-        if(fabs(dn) <= FLT_EPSILON) {
-            if(val > FLT_EPSILON)
-                t1 = -1.0f;
-        }
-        if(dn > FLT_EPSILON) {
-            t = -val / dn;
-            if(t < t1) {
-                // Replace the furthest point.
-                t1 = t;
-                nT1 = n;
-            }
-        }
-        if(dn < -FLT_EPSILON) {
-            t = -val / dn;
-            if(t > t0) {
-                t0 = t;
-                nT0 = n;
-            }
-        }
+    if(polyhedrons[id].bounded && !boundsIntersection(
+                polyhedrons[id].boundsMin, polyhedrons[id].boundsMax, origin,
+                dir, maxT))
+        return -1.0f;
+
+    int groupsBegin = polyhedrons[id].faceGroupsBegin;
+    float4 t0 = (float4) (0.0f), t1 = (float4) (FLT_MAX);
+    int4 face0 = (int4) (-1), face1 = (int4) (-1);
+    int4 outside = (int4) (0);
+
+    // Clip the ray against 4 planes at a time. Each lane keeps the furthest
+    // entry point and the closest exit point of its own planes.
+    for(int i = 0; i < polyhedrons[id].numFaceGroups; ++i) {
+        int g = groupsBegin + i;
+        float4 dn = dir.x * polyhedronFaces[g].a + dir.y * polyhedronFaces[g].b
+            + dir.z * polyhedronFaces[g].c; // hu
+        float4 val = origin.x * polyhedronFaces[g].a
+            + origin.y * polyhedronFaces[g].b
+            + origin.z * polyhedronFaces[g].c + polyhedronFaces[g].d; // hp
+        int4 face = (int4) (4 * g) + (int4) (0, 1, 2, 3);
+
+        // A parallel plane either never clips the ray or rejects all of it.
+        int4 parallel = fabs(dn) <= (float4) (FLT_EPSILON);
+        outside |= parallel & (val > (float4) (FLT_EPSILON));
+
+        float4 t = -val / select(dn, (float4) (1.0f), parallel);
+        int4 exits = (dn > (float4) (FLT_EPSILON)) & (t < t1);
+        int4 enters = (dn < (float4) (-FLT_EPSILON)) & (t > t0);
+
+        t1 = select(t1, t, exits);
+        face1 = select(face1, face, exits);
+        t0 = select(t0, t, enters);
+        face0 = select(face0, face, enters);
     }
 
-    if(t1 < t0)
+    if(any(outside))
+        return -1.0f;
+
+    // Reduce the lanes.
+    float tNear = t0.x, tFar = t1.x;
+    int nearFace = face0.x, farFace = face1.x;
+    if(t0.y > tNear) { tNear = t0.y; nearFace = face0.y; }
+    if(t0.z > tNear) { tNear = t0.z; nearFace = face0.z; }
+    if(t0.w > tNear) { tNear = t0.w; nearFace = face0.w; }
+    if(t1.y < tFar) { tFar = t1.y; farFace = face1.y; }
+    if(t1.z < tFar) { tFar = t1.z; farFace = face1.z; }
+    if(t1.w < tFar) { tFar = t1.w; farFace = face1.w; }
+
+    if(tFar < tNear)
         return -1.0f;
-    if(fabs(t0) <= FLT_EPSILON && (t1 >= t0) && t1 < FLT_MAX) {
-        *normal = normalize(-1.0f * nT1);
-        if(t1 < maxT)
-            return t1;
+    if(tNear <= FLT_EPSILON && tFar < FLT_MAX) { // Starts inside.
+        *normal = -polyhedronNormals[farFace];
+        if(tFar < maxT)
+            return tFar;
         else
             return -1.0f;
     }
-    if(t0 > FLT_EPSILON && t1 >= t0) {
-        *normal = normalize(nT0);
-        if(t0 < maxT)
-            return t0;
+    if(tNear > FLT_EPSILON) {
+        *normal = polyhedronNormals[nearFace];
+        if(tNear < maxT)
+            return tNear;
         else
             return -1.0f;
     }
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef ACCUM_CL
+#define ACCUM_CL
+
+/*
+ * Storage of the radiance accumulator, selected by the Accum* defines. The
+ * float formats keep the sum of the passes; the packed formats keep their
+ * running mean instead, as a sum loses the precision of a small mantissa
+ * after a few passes.
+ */
+#if defined(AccumHalf)
+typedef half AccumPixel;    /// 4 halfs per pixel, stored with vstore_half4.
+#elif defined(AccumRGB9E5)
+typedef uint AccumPixel;    /// RGB with 9 bit mantissas and a shared exponent.
+#elif defined(AccumFloat3)
+typedef float AccumPixel;   /// 3 floats per pixel, stored with vstore3.
+#else
+typedef float4 AccumPixel;
+#endif
+
+/**
+ * Adds the color of a pass to pixel i of the accumulator.
+ * @param pass Index of the pass. The accumulator is reset on pass 0.
+ */
+void accumAdd(__global AccumPixel *accum, int i, float4 color, uint pass);
+
+/**
+ * Returns the average of the passes of pixel i of the accumulator.
+ * @param numPasses Number of passes in the accumulator.
+ */
+float4 accumRead(__global const AccumPixel *accum, int i, uint numPasses);
+
+/// Packs the non negative color as RGB9E5 (EXT_texture_shared_exponent).
+uint packRGB9E5(float3 color);
+
+/// Unpacks an RGB9E5 color.
+float3 unpackRGB9E5(uint packed);
+
+void accumAdd(__global AccumPixel *accum, int i, float4 color, uint pass) {
+#if defined(AccumHalf)
+    float4 mean = pass ? vload_half4(i, accum) : (float4) (0.0f);
+    vstore_half4(mean + (color - mean) / (pass + 1), i, accum);
+#elif defined(AccumRGB9E5)
+    float3 mean = pass ? unpackRGB9E5(accum[i]) : (float3) (0.0f);
+    accum[i] = packRGB9E5(mean + (color.xyz - mean) / (pass + 1));
+#elif defined(AccumFloat3)
+    float3 sum = pass ? vload3(i, accum) + color.xyz : color.xyz;
+    vstore3(sum, i, accum);
+#else
+    accum[i] = pass ? accum[i] + color : color;
+#endif
+}
+
+float4 accumRead(__global const AccumPixel *accum, int i, uint numPasses) {
+#if defined(AccumHalf)
+    return vload_half4(i, accum);
+#elif defined(AccumRGB9E5)
+    return (float4) (unpackRGB9E5(accum[i]), 0.0f);
+#elif defined(AccumFloat3)
+    return (float4) (vload3(i, accum) / numPasses, 0.0f);
+#else
+    return accum[i] / numPasses;
+#endif
+}
+
+uint packRGB9E5(float3 color) {
+    // Largest value of a 9 bit mantissa with the largest exponent.
+    color = clamp(color, 0.0f, 65408.0f);
+
+    // Shared exponent biased by 15, so that the largest component gets a
+    // mantissa in [256, 512).
+    int exponent;
+    frexp(max(color.x, max(color.y, color.z)), &exponent);
+    exponent = max(exponent, -15) + 15;
+
+    uint3 mantissa = convert_uint3_sat_rte(color * exp2(24.0f - exponent));
+    if(max(mantissa.x, max(mantissa.y, mantissa.z)) > 511) {
+        ++exponent;
+        mantissa = convert_uint3_sat_rte(color * exp2(24.0f - exponent));
+    }
+
+    return mantissa.x | mantissa.y << 9 | mantissa.z << 18
+        | (uint) exponent << 27;
+}
+
+float3 unpackRGB9E5(uint packed) {
+    uint3 mantissa = (uint3) (packed, packed >> 9, packed >> 18) & 511;
+    return convert_float3(mantissa) * exp2((float) (packed >> 27) - 24.0f);
+}
+
+#endif // !ACCUM_CL
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AOV_CL
+#define AOV_CL
+
+/// Depth of the rays that don't hit anything.
+#define MissDepth 1e10f
+
+/*
+ * Storage of the AOV framebuffer. With AovHalf the channels are halfs that
+ * keep the running mean of the passes instead of their sum.
+ */
+#ifdef AovHalf
+typedef half AovValue;
+#else
+typedef float AovValue;
+#endif
+
+/**
+ * Arbitrary output variables of the paths of a work item. Each AOV is only
+ * recorded if its Aov* define is set, and is written to the planes of the
+ * AOV framebuffer that start at its Aov*Channel define.
+ */
+typedef struct Aovs {
+    float4 albedo;      /// Sum of the first hit albedos.
+    float4 normal;      /// Sum of the first hit normals.
+    float depth;        /// Sum of the first hit depths.
+    float moment2;      /// Sum of the squared luminances of the paths.
+    int objectID;       /// Object of the first hit of the first path.
+    int materialID;     /// Material of the first hit of the first path.
+    bool hasID;         /// If the IDs were recorded.
+} Aovs;
+
+/// Sets all the AOVs to 0.
+void aovsInit(Aovs *aovs);
+
+/**
+ * Adds the first hit of a path to the AOVs.
+ * @param depth Distance from the ray origin to the hit.
+ * @param objectID Index of the object, or -1 on a miss.
+ * @param materialID Index of the material, or -1 on a miss or an emitter.
+ */
+void aovsRecordHit(Aovs *aovs, float4 albedo, float4 normal, float depth,
+        int objectID, int materialID);
+
+/// Adds the color of a path to the AOVs.
+void aovsRecordPath(Aovs *aovs, float4 color);
+
+/**
+ * Adds the AOVs of numPaths paths to the AOV framebuffer of the pixel. The
+ * averages of the paths are accumulated over the passes, the IDs are kept
+ * from the first pass and the sample count is accumulated as the number of
+ * paths of each pass.
+ * @param fb AOV framebuffer, with a plane of size.x * size.y values per
+ * channel.
+ * @param pass Index of the pass. The framebuffer is reset on pass 0.
+ */
+void aovsFlush(Aovs *aovs, __global AovValue *fb, int2 coord, int2 size,
+        int numPaths, uint pass);
+
+/// Adds value to the channel of the pixel, resetting it on pass 0.
+void aovAdd(__global AovValue *fb, int channel, int i, int numPixels,
+        float value, uint pass);
+
+/// Returns the average of the passes of the channel of the pixel.
+float aovRead(__global const AovValue *fb, int channel, int i, int numPixels,
+        uint numPasses);
+
+/// Returns the averages of the passes of 3 consecutive channels of the pixel.
+float4 aovRead3(__global const AovValue *fb, int channel, int i,
+        int numPixels, uint numPasses);
+
+void aovsInit(Aovs *aovs) {
+    aovs->albedo = (float4) (0.0f);
+    aovs->normal = (float4) (0.0f);
+    aovs->depth = 0.0f;
+    aovs->moment2 = 0.0f;
+    aovs->objectID = -1;
+    aovs->materialID = -1;
+    aovs->hasID = false;
+}
+
+void aovsRecordHit(Aovs *aovs, float4 albedo, float4 normal, float depth,
+        int objectID, int materialID) {
+#ifdef AovAlbedo
+    aovs->albedo += albedo;
+#endif
+#ifdef AovNormal
+    aovs->normal += normal;
+#endif
+#ifdef AovDepth
+    aovs->depth += depth;
+#endif
+#ifdef AovID
+    if(!aovs->hasID) {
+        aovs->objectID = objectID;
+        aovs->materialID = materialID;
+        aovs->hasID = true;
+    }
+#endif
+}
+
+void aovsRecordPath(Aovs *aovs, float4 color) {
+#ifdef AovVariance
+    float luminance = dot(color.xyz, (float3) (0.2126f, 0.7152f, 0.0722f));
+    aovs->moment2 += luminance * luminance;
+#endif
+}
+
+void aovsFlush(Aovs *aovs, __global AovValue *fb, int2 coord, int2 size,
+        int numPaths, uint pass) {
+    int i = coord.y * size.x + coord.x;
+    int numPixels = size.x * size.y;
+
+#ifdef AovAlbedo
+    aovAdd(fb, AovAlbedoChannel, i, numPixels, aovs->albedo.x / numPaths,
+            pass);
+    aovAdd(fb, AovAlbedoChannel + 1, i, numPixels, aovs->albedo.y / numPaths,
+            pass);
+    aovAdd(fb, AovAlbedoChannel + 2, i, numPixels, aovs->albedo.z / numPaths,
+            pass);
+#endif
+#ifdef AovNormal
+    aovAdd(fb, AovNormalChannel, i, numPixels, aovs->normal.x / numPaths,
+            pass);
+    aovAdd(fb, AovNormalChannel + 1, i, numPixels, aovs->normal.y / numPaths,
+            pass);
+    aovAdd(fb, AovNormalChannel + 2, i, numPixels, aovs->normal.z / numPaths,
+            pass);
+#endif
+#ifdef AovDepth
+    aovAdd(fb, AovDepthChannel, i, numPixels, aovs->depth / numPaths, pass);
+#endif
+#ifdef AovID
+    if(!pass) {
+#ifdef AovHalf
+        vstore_half((float) aovs->objectID, AovIDChannel * numPixels + i,
+                fb);
+        vstore_half((float) aovs->materialID,
+                (AovIDChannel + 1) * numPixels + i, fb);
+#else
+        fb[AovIDChannel * numPixels + i] = aovs->objectID;
+        fb[(AovIDChannel + 1) * numPixels + i] = aovs->materialID;
+#endif
+    }
+#endif
+#ifdef AovSamples
+    aovAdd(fb, AovSamplesChannel, i, numPixels, numPaths, pass);
+#endif
+#ifdef AovVariance
+    aovAdd(fb, AovVarianceChannel, i, numPixels, aovs->moment2 / numPaths,
+            pass);
+#endif
+}
+
+void aovAdd(__global AovValue *fb, int channel, int i, int numPixels,
+        float value, uint pass) {
+    int index = channel * numPixels + i;
+#ifdef AovHalf
+    float mean = pass ? vload_half(index, fb) : 0.0f;
+    vstore_half(mean + (value - mean) / (pass + 1), index, fb);
+#else
+    fb[index] = pass ? fb[index] + value : value;
+#endif
+}
+
+float aovRead(__global const AovValue *fb, int channel, int i, int numPixels,
+        uint numPasses) {
+#ifdef AovHalf
+    return vload_half(channel * numPixels + i, fb);
+#else
+    return fb[channel * numPixels + i] / numPasses;
+#endif
+}
+
+float4 aovRead3(__global const AovValue *fb, int channel, int i,
+        int numPixels, uint numPasses) {
+    return (float4) (aovRead(fb, channel, i, numPixels, numPasses),
+            aovRead(fb, channel + 1, i, numPixels, numPasses),
+            aovRead(fb, channel + 2, i, numPixels, numPasses), 0.0f);
+}
+
+#endif // !AOV_CL
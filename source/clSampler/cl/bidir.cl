@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BIDIR_CL
+#define BIDIR_CL
+
+#include "brdf.cl"
+#include "camera.cl"
+#include "counters.cl"
+#include "fastmath.cl"
+#include "intersection.cl"
+#include "lights.cl"
+#include "object.cl"
+#include "radiance.cl"
+#include "random.cl"
+
+/*
+ * Bidirectional path tracing. Each sample traces a camera subpath from the
+ * pixel and a light subpath from a point of a random emitter, and connects
+ * every vertex of one to every vertex of the other with a shadow ray. The
+ * connections of the light vertices to the camera (light tracing) land on
+ * any pixel, so they are splatted to the film with atomic adds, which is how
+ * the caustics seen through a diffuse surface are found.
+ *
+ * Each path can be sampled by a strategy per number of light vertices, and
+ * the contributions are weighted by the balance heuristic. The weights only
+ * need the area densities of each vertex sampled from either side (pdfFwd
+ * and pdfRev), as in Veach's thesis. Only the diffuse lobe is evaluated by
+ * the connections: the vertices that continued through another lobe are
+ * flagged as delta, so the strategies that would connect them are skipped.
+ *
+ * The BRDF of a connection is the diffuse lobe times its probability, which
+ * is what the lobe choice of radiance() converges to.
+ */
+
+/// Kinds of vertices of the subpaths.
+typedef enum VertexType {
+    CameraVertex,   /// Pinhole of the camera.
+    LightVertex,    /// Point of an emitter.
+    SurfaceVertex   /// Bounce on a surface.
+} VertexType;
+
+/**
+ * Vertex of a subpath.
+ */
+typedef struct PathVertex {
+    float4 position;
+    float4 normal;      /// Normal on the side of the incoming ray.
+    float4 beta;        /// Throughput of the subpath up to the vertex.
+    float4 color;       /// Diffuse BRDF times its probability, or emission.
+    float pdfFwd;       /// Area density of the vertex in its subpath.
+    float pdfRev;       /// Area density if sampled by the other subpath.
+    float diffuse;      /// Probability of the diffuse lobe.
+    VertexType type;
+    IntersectionType objType; /// Object of the vertex, skipped by its rays.
+    int objID;
+    bool delta;         /// The subpath continued through a non-diffuse lobe.
+} PathVertex;
+
+/// Vertices of the camera subpaths, including the camera.
+#define CameraPathVertices (BidirectionalDepth + 2)
+
+/// Vertices of the light subpaths, including the point of the emitter.
+#define LightPathVertices (BidirectionalDepth + 1)
+
+/// Part of the distance that shadow rays stop short of the other vertex.
+#define ShadowEpsilon (1e-3f)
+
+/**
+ * Samples a path of the pixel, connecting a camera subpath and a light
+ * subpath.
+ * @param camera Viewpoint of the render.
+ * @param size Width and height of the image.
+ * @param dir Direction of the camera ray.
+ * @param counters Statistics of the work item.
+ * @param aovs AOVs of the work item, where the first hit is recorded.
+ * @param film Sums of the pixels, where the light tracing is splatted.
+ * @return Color of the strategies that end on the camera subpath.
+ */
+float4 bidirectional(const Camera *camera, int2 size, float4 dir,
+        uint2 *seed, Counters *counters, Aovs *aovs, __global float *film);
+
+/**
+ * Extends a subpath from its last vertex until it leaves the scene, hits an
+ * emitter, is stopped by the Russian roulette or fills the path.
+ * @param path Vertices of the subpath.
+ * @param count Number of vertices already in the path.
+ * @param maxVertices Capacity of the path.
+ * @param dir Direction of the ray from the last vertex.
+ * @param beta Throughput of the ray.
+ * @param pdf Solid angle density of dir, or 0 if from a delta lobe.
+ * @param aovs AOVs where the first hit is recorded, or 0.
+ * @return Number of vertices of the subpath.
+ */
+int randomWalk(PathVertex *path, int count, int maxVertices, float4 dir,
+        float4 beta, float pdf, uint2 *seed, Counters *counters, Aovs *aovs);
+
+/**
+ * Samples a light subpath. Returns its number of vertices, 0 if the scene
+ * has no emitters.
+ */
+int lightSubpath(PathVertex *path, uint2 *seed, Counters *counters);
+
+/**
+ * Samples a point of a random emitter, with the area density of the light
+ * subpaths.
+ * @param vertex Set to the point, as the first vertex of a light subpath.
+ */
+void sampleEmitter(PathVertex *vertex, uint2 *seed);
+
+/**
+ * Returns the contribution of the strategy with s light vertices and t
+ * camera vertices, weighted by its MIS weight.
+ * @param splat Set to the pixel the contribution goes to if t == 1.
+ * @return Contribution, or 0 if the strategy can't connect the subpaths.
+ */
+float4 connect(PathVertex *lightPath, int s, PathVertex *cameraPath, int t,
+        const Camera *camera, int2 size, uint2 *seed, Counters *counters,
+        int2 *splat);
+
+/**
+ * Returns the balance heuristic weight of a strategy. The vertices at the
+ * ends of the connection are given as qs and pt, as the last vertex of the
+ * light subpath is sampled by the strategy when s == 1.
+ */
+float misWeight(PathVertex *lightPath, int s, PathVertex *cameraPath, int t,
+        PathVertex *qs, PathVertex *pt, const Camera *camera, int2 size);
+
+/**
+ * Returns the area density of vertex to sampled from vertex from, by the
+ * camera, the emission or the diffuse lobe.
+ */
+float vertexPdf(const PathVertex *from, const PathVertex *to,
+        const Camera *camera, int2 size);
+
+/// Converts a solid angle density at from to the area density of to.
+float areaPdf(float pdf, const PathVertex *from, const PathVertex *to);
+
+/// Returns if the segment between two vertices is unoccluded.
+bool visible(const PathVertex *from, const PathVertex *to,
+        Counters *counters);
+
+/// Returns if the diffuse lobe of the vertex can be connected.
+bool connectible(const PathVertex *vertex);
+
+/**
+ * Projects a point to the film of the camera.
+ * @param coord Set to the pixel of the point.
+ * @param pdf Set to the solid angle density of the camera ray to the point,
+ * over the whole film.
+ * @return If the point is in front of the camera and inside the film.
+ */
+bool cameraRaster(const Camera *camera, int2 size, float4 point,
+        int2 *coord, float *pdf);
+
+/// Adds the color to the pixel of the film, which other work items share.
+void filmAdd(__global float *film, int2 coord, int width, float4 color);
+
+float4 bidirectional(const Camera *camera, int2 size, float4 dir,
+        uint2 *seed, Counters *counters, Aovs *aovs, __global float *film) {
+    PathVertex cameraPath[CameraPathVertices];
+    PathVertex lightPath[LightPathVertices];
+
+    // The camera is the first vertex of its subpath.
+    PathVertex *eye = &cameraPath[0];
+    float dirPdf = 0.0f;
+    int2 coord;
+    eye->position = camera->origin;
+    eye->normal = dir;
+    eye->beta = (float4) (1.0f);
+    eye->color = (float4) (0.0f);
+    eye->pdfFwd = 1.0f;
+    eye->pdfRev = 0.0f;
+    eye->diffuse = 0.0f;
+    eye->type = CameraVertex;
+    eye->objType = NoIntersection;
+    eye->objID = -1;
+    eye->delta = false;
+    cameraRaster(camera, size, camera->origin + dir, &coord, &dirPdf);
+
+    int numCamera = randomWalk(cameraPath, 1, CameraPathVertices, dir,
+            (float4) (1.0f), dirPdf, seed, counters, aovs);
+    int numLight = lightSubpath(lightPath, seed, counters);
+
+    // The strategies with more bounces than the subpaths hold are skipped.
+    float4 color = (float4) (0.0f);
+    for(int t = 1; t <= numCamera; ++t) {
+        for(int s = 0; s <= numLight; ++s) {
+            int depth = s + t - 2;
+            if((s == 1 && t == 1) || depth < 0 || depth > BidirectionalDepth)
+                continue;
+
+            int2 splat = (int2) (0);
+            float4 contribution = connect(lightPath, s, cameraPath, t,
+                    camera, size, seed, counters, &splat);
+            if(t == 1)
+                filmAdd(film, splat, size.x, contribution);
+            else
+                color += contribution;
+        }
+    }
+
+    return color;
+}
+
+int randomWalk(PathVertex *path, int count, int maxVertices, float4 dir,
+        float4 beta, float pdf, uint2 *seed, Counters *counters, Aovs *aovs) {
+    // The Russian roulette looks at the throughput of the bounces alone, as
+    // in radiance(), since the beta of the light subpaths holds the emission.
+    float4 throughput = (float4) (1.0f);
+
+    for(int bounce = 0; count < maxVertices; ++bounce) {
+        PathVertex *prev = &path[count - 1];
+        PathVertex *v = &path[count];
+        bool inside;
+
+        v->objType = trace(prev->position, dir, prev->objType, prev->objID,
+                0, &v->objID, &v->position, &v->normal, &inside, 0.0f);
+        ++counters->rays;
+
+        if(aovs && bounce == 0)
+            recordFirstHit(aovs, v->objType, v->objID, v->position,
+                    v->normal, prev->position, 0.0f);
+        if(v->objType == NoIntersection)
+            break;
+
+        v->type = SurfaceVertex;
+        v->beta = beta;
+        v->pdfFwd = areaPdf(pdf, prev, v);
+        v->pdfRev = 0.0f;
+        v->diffuse = 0.0f;
+        v->delta = false;
+
+        // As in radiance(), the emitters don't reflect, so the paths end at
+        // them. Only the camera subpaths use them, when they emit toward the
+        // path.
+        if(v->objType == SphereIntersection && sphereEmits(v->objID)) {
+            if(path[0].type == LightVertex)
+                break;
+
+            v->type = LightVertex;
+            v->color = inside ? (float4) (0.0f) : spheres[v->objID].emission;
+            ++count;
+            break;
+        }
+
+        int matID, texID;
+        TextureType texType;
+        getObjectIDs(v->objType, v->objID, &matID, &texType, &texID);
+        float4 albedo = getTextureColor(texType, texID, v->position);
+
+        v->diffuse = materialLobeCdf[matID].x;
+        v->color = albedo * (v->diffuse * materialLobeWeight[matID].x);
+        ++count;
+
+        // As in radiance(), the bounce is sampled again if the chosen lobe
+        // can't scatter the ray, such as a transmission past the critical
+        // angle.
+        float4 newDir, f;
+        float dirPdf, rr;
+        Lobe lobe;
+        bool scattered = false;
+        while(!scattered) {
+            rr = rouletteProbability(throughput, bounce);
+            if(randf(seed) >= rr)
+                break;
+
+            lobe = brdfChooseLobe(matID, randf(seed));
+            scattered = brdfSampleLobe(lobe, dir, v->normal, albedo, matID,
+                    inside, seed, &newDir, &f, &dirPdf);
+        }
+        if(!scattered) {
+            ++counters->terminations;
+            break;
+        }
+        ++counters->bounces;
+        throughput *= f / (dirPdf * rr);
+        beta *= f / (dirPdf * rr);
+
+        // The densities of the other lobes are left out of the MIS weights,
+        // as delta vertices.
+        float reversePdf = 0.0f;
+        if(lobe == DiffuseLobe) {
+            pdf = v->diffuse * dirPdf;
+            reversePdf = v->diffuse * max(dot(v->normal, -dir), 0.0f)
+                * M_1_PI_F;
+        }
+        else {
+            v->delta = true;
+            pdf = 0.0f;
+        }
+        prev->pdfRev = areaPdf(reversePdf, v, prev);
+        dir = newDir;
+    }
+
+    return count;
+}
+
+int lightSubpath(PathVertex *path, uint2 *seed, Counters *counters) {
+    if(NumLights == 0)
+        return 0;
+
+    // The emission leaves the point with a cosine distribution.
+    PathVertex *light = &path[0];
+    sampleEmitter(light, seed);
+    float4 dir = sampleCosine(light->normal, seed);
+    float pdf = max(dot(light->normal, dir), 0.0f) * M_1_PI_F;
+    if(pdf <= 0.0f)
+        return 1;
+
+    // The cosine of the emission cancels with its density.
+    return randomWalk(path, 1, LightPathVertices, dir,
+            light->beta * M_PI_F, pdf, seed, counters, 0);
+}
+
+void sampleEmitter(PathVertex *vertex, uint2 *seed) {
+    int id = sampleEmitterPoint(seed, &vertex->position, &vertex->normal,
+            &vertex->pdfFwd);
+
+    vertex->color = spheres[id].emission;
+    vertex->pdfRev = 0.0f;
+    vertex->beta = vertex->color / vertex->pdfFwd;
+    vertex->diffuse = 0.0f;
+    vertex->type = LightVertex;
+    vertex->objType = SphereIntersection;
+    vertex->objID = id;
+    vertex->delta = false;
+}
+
+float4 connect(PathVertex *lightPath, int s, PathVertex *cameraPath, int t,
+        const Camera *camera, int2 size, uint2 *seed, Counters *counters,
+        int2 *splat) {
+    PathVertex *pt = &cameraPath[t - 1];
+    PathVertex sampled, *qs = s ? &lightPath[s - 1] : 0;
+    float4 contribution;
+
+    if(s == 0) {
+        // The camera subpath hit an emitter.
+        if(pt->type != LightVertex)
+            return (float4) (0.0f);
+
+        contribution = pt->beta * pt->color;
+    }
+    else if(t == 1) {
+        // Light tracing: the light vertex is seen by the camera.
+        float pdf;
+        if(!connectible(qs)
+                || !cameraRaster(camera, size, qs->position, splat, &pdf))
+            return (float4) (0.0f);
+
+        float4 toCamera = pt->position - qs->position;
+        toCamera.w = 0.0f;
+        float distance2 = dot(toCamera, toCamera);
+        float cosQ = dot(qs->normal, toCamera) * rsqrt(distance2);
+        if(cosQ <= 0.0f || !visible(qs, pt, counters))
+            return (float4) (0.0f);
+
+        contribution = qs->beta * qs->color * (cosQ * pdf / distance2);
+    }
+    else {
+        if(!connectible(pt))
+            return (float4) (0.0f);
+
+        // Next event estimation samples a new point of an emitter.
+        if(s == 1) {
+            sampleEmitter(&sampled, seed);
+            qs = &sampled;
+        }
+        else if(!connectible(qs)) {
+            return (float4) (0.0f);
+        }
+
+        float4 d = qs->position - pt->position;
+        d.w = 0.0f;
+        float distance2 = dot(d, d);
+        float invDistance = rsqrt(distance2);
+        float cosP = dot(pt->normal, d) * invDistance;
+        float cosQ = -dot(qs->normal, d) * invDistance;
+        if(cosP <= 0.0f || cosQ <= 0.0f || !visible(pt, qs, counters))
+            return (float4) (0.0f);
+
+        // The emitters radiate the same in all directions.
+        contribution = qs->beta * pt->beta * pt->color
+            * (cosP * cosQ / distance2);
+        if(s > 1)
+            contribution *= qs->color;
+    }
+
+    return contribution * misWeight(lightPath, s, cameraPath, t, qs, pt,
+            camera, size);
+}
+
+float misWeight(PathVertex *lightPath, int s, PathVertex *cameraPath, int t,
+        PathVertex *qs, PathVertex *pt, const Camera *camera, int2 size) {
+    if(s + t == 2)
+        return 1.0f;
+
+    // Densities of the vertices next to the connection if they were sampled
+    // by the other subpath.
+    PathVertex *ptMinus = t > 1 ? &cameraPath[t - 2] : 0;
+    PathVertex *qsMinus = s > 1 ? &lightPath[s - 2] : 0;
+    float ptRev, ptMinusRev = 0.0f, qsRev = 0.0f, qsMinusRev = 0.0f;
+    if(s > 0) {
+        ptRev = vertexPdf(qs, pt, camera, size);
+        qsRev = vertexPdf(pt, qs, camera, size);
+        if(ptMinus)
+            ptMinusRev = vertexPdf(pt, ptMinus, camera, size);
+        if(qsMinus)
+            qsMinusRev = vertexPdf(qs, qsMinus, camera, size);
+    }
+    else {
+        // The emitter hit by the camera subpath, as a light subpath.
+        ptRev = 0.25f * M_1_PI_F / (spheres[pt->objID].radius2 * NumLights);
+        ptMinusRev = vertexPdf(pt, ptMinus, camera, size);
+    }
+
+    // Ratios of the density of each other strategy to this one. Zero
+    // densities are delta vertices, which cancel out.
+    float sum = 0.0f, ratio = 1.0f;
+    for(int i = t - 1; i > 0; --i) {
+        float rev = i == t - 1 ? ptRev
+            : i == t - 2 ? ptMinusRev : cameraPath[i].pdfRev;
+        float fwd = cameraPath[i].pdfFwd;
+        ratio *= (rev != 0.0f ? rev : 1.0f) / (fwd != 0.0f ? fwd : 1.0f);
+
+        bool delta = i < t - 1 && cameraPath[i].delta;
+        if(!delta && !cameraPath[i - 1].delta)
+            sum += ratio;
+    }
+
+    ratio = 1.0f;
+    for(int i = s - 1; i >= 0; --i) {
+        float rev = i == s - 1 ? qsRev
+            : i == s - 2 ? qsMinusRev : lightPath[i].pdfRev;
+        float fwd = i == s - 1 ? qs->pdfFwd : lightPath[i].pdfFwd;
+        ratio *= (rev != 0.0f ? rev : 1.0f) / (fwd != 0.0f ? fwd : 1.0f);
+
+        bool delta = i < s - 1 && lightPath[i].delta;
+        if(!delta && !(i > 0 && lightPath[i - 1].delta))
+            sum += ratio;
+    }
+
+    return 1.0f / (1.0f + sum);
+}
+
+float vertexPdf(const PathVertex *from, const PathVertex *to,
+        const Camera *camera, int2 size) {
+    float4 d = to->position - from->position;
+    d.w = 0.0f;
+    float cosFrom = dot(from->normal, d) * rsqrt(dot(d, d));
+
+    float pdf;
+    if(from->type == CameraVertex) {
+        int2 coord;
+        if(!cameraRaster(camera, size, to->position, &coord, &pdf))
+            return 0.0f;
+    }
+    else if(from->type == LightVertex) {
+        pdf = max(cosFrom, 0.0f) * M_1_PI_F;
+    }
+    else {
+        pdf = from->diffuse * max(cosFrom, 0.0f) * M_1_PI_F;
+    }
+
+    return areaPdf(pdf, from, to);
+}
+
+float areaPdf(float pdf, const PathVertex *from, const PathVertex *to) {
+    // The camera is a point, so its density stays in solid angle.
+    if(to->type == CameraVertex)
+        return pdf;
+
+    float4 d = to->position - from->position;
+    d.w = 0.0f;
+    float distance2 = dot(d, d);
+    return pdf * fabs(dot(to->normal, d)) * rsqrt(distance2) / distance2;
+}
+
+bool visible(const PathVertex *from, const PathVertex *to,
+        Counters *counters) {
+    float4 d = to->position - from->position;
+    d.w = 0.0f;
+    float4 end = from->position + d * (1.0f - ShadowEpsilon);
+
+    ++counters->rays;
+    return trace(from->position, normalize(d), from->objType, from->objID,
+            &end, 0, 0, 0, 0, 0.0f) == NoIntersection;
+}
+
+bool connectible(const PathVertex *vertex) {
+    return vertex->type == SurfaceVertex && vertex->diffuse > 0.0f;
+}
+
+bool cameraRaster(const Camera *camera, int2 size, float4 point,
+        int2 *coord, float *pdf) {
+    // The film is the plane of the pixels, in front of the camera.
+    float4 forward = cross(camera->up, camera->right);
+    float4 toFilm = camera->topLeft - camera->origin;
+    if(dot(forward, toFilm) < 0.0f)
+        forward = -forward;
+    float distance = dot(forward, toFilm);
+
+    float4 dir = point - camera->origin;
+    dir.w = 0.0f;
+    dir = normalize(dir);
+    float cosTheta = dot(forward, dir);
+    if(cosTheta <= 0.0f)
+        return false;
+
+    // Pixel (x, y) goes from row y up to row y - 1, as in sample().
+    float4 onFilm = dir * (distance / cosTheta) - toFilm;
+    float x = dot(onFilm, camera->right) / camera->pixelWidth;
+    float y = 1.0f - dot(onFilm, camera->up) / camera->pixelHeight;
+    if(x < 0.0f || y < 0.0f || x >= size.x || y >= size.y)
+        return false;
+    *coord = (int2) ((int) x, (int) y);
+
+    // The film seen from the camera, at distance 1.
+    float area = size.x * camera->pixelWidth * size.y * camera->pixelHeight
+        / (distance * distance);
+    *pdf = 1.0f / (area * cosTheta * cosTheta * cosTheta);
+    return true;
+}
+
+void filmAdd(__global float *film, int2 coord, int width, float4 color) {
+    __global float *pixel = film + 4 * (coord.y * width + coord.x);
+    atomicAddFloat(&pixel[0], color.x);
+    atomicAddFloat(&pixel[1], color.y);
+    atomicAddFloat(&pixel[2], color.z);
+}
+
+#endif // !BIDIR_CL
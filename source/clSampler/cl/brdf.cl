@@ -2,6 +2,22 @@
 #define BRDF_CL
 
 #include "direction.cl"
+#include "fastmath.cl"
+
+/*
+ * The materials are read from the SoA tables generated by the host, indexed by
+ * the material ID:
+ * - materialLobeCdf: cumulative probabilities of the diffuse, specular,
+ *   reflection and transmission lobes.
+ * - materialLobeWeight: the diffuse coefficient divided by pi, the specular
+ *   coefficient times the Blinn-Phong normalization (n + 8) / (8 pi), and the
+ *   reflection and transmission coefficients.
+ * - materialSpecular: the specular exponent n, 1 / (n + 1) and the pdf
+ *   normalization (n + 2) / (2 pi).
+ * - materialRefractionRate: the refraction rate.
+ * - materialCauchy: the A and B (nm^2) of the Cauchy equation of the
+ *   refraction rate, n = A + B / lambda^2. B is 0 without dispersion.
+ */
 
 /**
  * Given the ray direction, intersection normal, material and if it is inside
@@ -9,49 +25,106 @@
  * Returns if a new direction was generated or if is to stop recursion.
  * The BRDF f value still needs to be multiplied by the albedo.
  */
-bool brdf(float4 dir, float4 normal, float4 albedo, __constant Material *mat,
-        bool inside, uint2 *seed, float4 *newDir, float4 *f, float *pdf);
+bool brdf(float4 dir, float4 normal, float4 albedo, int matID, bool inside,
+        uint2 *seed, float4 *newDir, float4 *f, float *pdf);
+
+/// Lobes of the BRDF, in the order they are chosen by brdfChooseLobe().
+typedef enum Lobe {
+    DiffuseLobe,
+    SpecularLobe,
+    ReflectionLobe,
+    TransmissionLobe,
+    NoLobe
+} Lobe;
+
+/**
+ * Chooses which lobe of the material to sample.
+ * @param u Uniform random number in [0, 1].
+ * @return The lobe, or NoLobe if the sample has no contribution.
+ */
+Lobe brdfChooseLobe(int matID, float u);
+
+/**
+ * Same as brdf(), but samples the given lobe.
+ */
+bool brdfSampleLobe(Lobe lobe, float4 dir, float4 normal, float4 albedo,
+        int matID, bool inside, uint2 *seed, float4 *newDir, float4 *f,
+        float *pdf);
 
 /// BRDF for the diffuse component.
-bool brdfDiffuse(float4 normal, float4 albedo, __constant Material *mat,
-        uint2 *seed, float4 *newDir, float4 *f, float *pdf);
+bool brdfDiffuse(float4 normal, float4 albedo, int matID, uint2 *seed,
+        float4 *newDir, float4 *f, float *pdf);
 
 /// BRDF for the specular component.
-bool brdfSpecular(float4 dir, float4 normal, float4 albedo,
-        __constant Material *mat, uint2 *seed, float4 *newDir, float4 *f,
-        float *pdf);
+bool brdfSpecular(float4 dir, float4 normal, float4 albedo, int matID,
+        uint2 *seed, float4 *newDir, float4 *f, float *pdf);
 
 /// BRDF for the reflection component.
-bool brdfReflection(float4 dir, float4 normal, float4 albedo,
-        __constant Material *mat, float4 *newDir, float4 *f, float *pdf);
+bool brdfReflection(float4 dir, float4 normal, float4 albedo, int matID,
+        float4 *newDir, float4 *f, float *pdf);
 
 /// BRDF for the transmission component.
-bool brdfTransmission(float4 dir, float4 normal, float4 albedo,
-        __constant Material *mat, bool inside, float4 *newDir, float4 *f,
-        float *pdf);
+bool brdfTransmission(float4 dir, float4 normal, float4 albedo, int matID,
+        bool inside, float4 *newDir, float4 *f, float *pdf);
+
+/**
+ * Same as brdfTransmission(), but refracts the hero wavelength of a spectral
+ * path by the Cauchy equation of the material. The other wavelengths would
+ * go in other directions, so their lanes are dropped and the hero lane
+ * takes their weight. This only happens once per path.
+ * @param wavelength Hero wavelength, in nm.
+ * @param dispersed If the lanes were already dropped at an earlier bounce.
+ */
+bool brdfDispersion(float4 dir, float4 normal, float4 albedo, int matID,
+        bool inside, float wavelength, bool dispersed, float4 *newDir,
+        float4 *f, float *pdf);
+
+/// Transmission with the given refraction rate of the material.
+bool brdfRefraction(float refrRate, float4 dir, float4 normal, float4 albedo,
+        int matID, bool inside, float4 *newDir, float4 *f, float *pdf);
+
+/// Returns if the material disperses the wavelengths. False without Spectral.
+bool materialDisperses(int matID);
 
 /**
  * Returns the normal base.
  */
 void getNormalBase(float4 normal, float4 *u, float4 *v, float4 *w);
 
-bool brdf(float4 dir, float4 normal, float4 albedo, __constant Material *mat,
-        bool inside, uint2 *seed, float4 *newDir, float4 *f, float *pdf) {
-    float u = randf(seed);
-    float c = 0.0f;
-
-    // Choose which brdf to use based on the coefficients. Note that all
-    // coefficients must sum to <= 1.0f for energy conservation.
-    if(u < (c += mat->diffuseCoef)) // Sample diffuse BRDF.
-        return brdfDiffuse(normal, albedo, mat, seed, newDir, f, pdf);
-    else if(u < (c += mat->specularCoef)) // Sample specular BRDF.
-        return brdfSpecular(dir, normal, albedo, mat, seed, newDir, f, pdf);
-    else if(u < (c += mat->reflectionCoef)) // Sample reflection BRDF.
-        return brdfReflection(dir, normal, albedo, mat, newDir, f, pdf);
-    else if(u < (c += mat->transmissionCoef)) // Sample transmission BRDF.
-        return brdfTransmission(dir, normal, albedo, mat, inside, newDir, f, pdf);
-    else // No contribution.
-        return false;
+bool brdf(float4 dir, float4 normal, float4 albedo, int matID, bool inside,
+        uint2 *seed, float4 *newDir, float4 *f, float *pdf) {
+    Lobe lobe = brdfChooseLobe(matID, randf(seed));
+
+    return brdfSampleLobe(lobe, dir, normal, albedo, matID, inside, seed,
+            newDir, f, pdf);
+}
+
+Lobe brdfChooseLobe(int matID, float u) {
+    // The lobe is the number of cumulative probabilities below u; lobes with
+    // a coefficient of 0 are skipped as their probability equals the previous
+    // one. Note that all coefficients must sum to <= 1.0f for energy
+    // conservation, and u past the last one has no contribution.
+    int4 below = isgreaterequal((float4) (u), materialLobeCdf[matID]);
+    return (Lobe) -(below.x + below.y + below.z + below.w);
+}
+
+bool brdfSampleLobe(Lobe lobe, float4 dir, float4 normal, float4 albedo,
+        int matID, bool inside, uint2 *seed, float4 *newDir, float4 *f,
+        float *pdf) {
+    switch(lobe) {
+        case DiffuseLobe:
+            return brdfDiffuse(normal, albedo, matID, seed, newDir, f, pdf);
+        case SpecularLobe:
+            return brdfSpecular(dir, normal, albedo, matID, seed, newDir, f,
+                    pdf);
+        case ReflectionLobe:
+            return brdfReflection(dir, normal, albedo, matID, newDir, f, pdf);
+        case TransmissionLobe:
+            return brdfTransmission(dir, normal, albedo, matID, inside, newDir,
+                    f, pdf);
+        default:
+            return false;
+    }
 }
 
 void getNormalBase(float4 normal, float4 *u, float4 *v, float4 *w) {
@@ -62,25 +135,26 @@ void getNormalBase(float4 normal, float4 *u, float4 *v, float4 *w) {
 }
 
 /// BRDF for the diffuse component.
-bool brdfDiffuse(float4 normal, float4 albedo, __constant Material *mat,
-        uint2 *seed, float4 *newDir, float4 *f, float *pdf) {
+bool brdfDiffuse(float4 normal, float4 albedo, int matID, uint2 *seed,
+        float4 *newDir, float4 *f, float *pdf) {
     float4 u, v, w;
     getNormalBase(normal, &u, &v, &w);
 
     // Generate random importance sampled direction based on Blinn-Phong pdf.
     float u1 = randf(seed), u2 = randf(seed);
-    float theta = 2 * M_PI * u1, phi = sqrt(u2);
+    float cosTheta, sinTheta = mathSinCos2Pi(u1, &cosTheta);
+    float phi = mathSqrt(u2);
 
     // Convert from spherical coordinates and add the base.
-    *newDir = normalize((float4) (
-        u * cos(theta) * phi +
-        v * sin(theta) * phi +
-        w * sqrt(1.0f - u2)
+    *newDir = mathNormalize((float4) (
+        u * cosTheta * phi +
+        v * sinTheta * phi +
+        w * mathSqrt(1.0f - u2)
     ));
 
     float cosND = max(dot(normal, *newDir), 0.0f);
 
-    *f = albedo * (float) (mat->diffuseCoef * M_1_PI * cosND);
+    *f = albedo * (materialLobeWeight[matID].x * cosND);
     *pdf = cosND * M_1_PI;
 
     if(fabs(*pdf) < FLT_EPSILON)
@@ -90,32 +164,32 @@ bool brdfDiffuse(float4 normal, float4 albedo, __constant Material *mat,
 }
 
 /// BRDF for the specular component.
-bool brdfSpecular(float4 dir, float4 normal, float4 albedo,
-        __constant Material *mat, uint2 *seed, float4 *newDir, float4 *f,
-        float *pdf) {
+bool brdfSpecular(float4 dir, float4 normal, float4 albedo, int matID,
+        uint2 *seed, float4 *newDir, float4 *f, float *pdf) {
     float4 u, v, w;
     getNormalBase(normal, &u, &v, &w);
+    float4 specular = materialSpecular[matID];
 
     // Generate random importance sampled direction based on Blinn-Phong pdf.
+    // The polar angle is only needed through its cosine and sine.
     float u1 = randf(seed), u2 = randf(seed);
-    float e = 1.0f / (mat->specularExp + 1.0f);
-    float theta = acos(pow(u1, e)), phi = 2.0f * M_PI * u2;
+    float cosTheta = mathPowr(u1, specular.y);
+    float sinTheta = mathSqrt(max(1.0f - cosTheta * cosTheta, 0.0f));
+    float cosPhi, sinPhi = mathSinCos2Pi(u2, &cosPhi);
 
     // Convert from spherical coordinates and add the base.
-    *newDir = normalize((float4) (
-        u * sin(theta) * cos(phi) +
-        v * sin(theta) * sin(phi) +
-        w * cos(theta)
+    *newDir = mathNormalize((float4) (
+        u * sinTheta * cosPhi +
+        v * sinTheta * sinPhi +
+        w * cosTheta
     ));
 
-    float cosAlpha = dot(dir, *newDir);
-    if(cosAlpha < 0.0f) cosAlpha = cos(M_PI / 2.0f);
+    // Directions below the mirror direction have no contribution.
+    float cosAlpha = max(dot(dir, *newDir), 0.0f);
+    float lobe = mathPowr(cosAlpha, specular.x);
 
-    *f = albedo * (float) (mat->specularCoef * ((mat->specularExp + 8.0f)
-        / (8.0f * M_PI)) * pow(cosAlpha, mat->specularExp));
-
-    *pdf = ((mat->specularExp + 2.0f) / (2.0f * M_PI))
-        * pow(cosAlpha, mat->specularExp);
+    *f = albedo * (materialLobeWeight[matID].y * lobe);
+    *pdf = specular.z * lobe;
 
     if(fabs(*pdf) < FLT_EPSILON)
         return false;
@@ -124,26 +198,42 @@ bool brdfSpecular(float4 dir, float4 normal, float4 albedo,
 }
 
 /// BRDF for the ideal reflection component.
-bool brdfReflection(float4 dir, float4 normal, float4 albedo,
-        __constant Material *mat, float4 *newDir, float4 *f, float *pdf) {
+bool brdfReflection(float4 dir, float4 normal, float4 albedo, int matID,
+        float4 *newDir, float4 *f, float *pdf) {
     *newDir = getReflectionDirection(dir, normal);
-    *f = albedo * mat->reflectionCoef;
+    *f = albedo * materialLobeWeight[matID].z;
     *pdf = 1.0f;
 
     return true;
 }
 
 /// BRDF for the ideal transmission component.
-bool brdfTransmission(float4 dir, float4 normal, float4 albedo,
-        __constant Material *mat, bool inside, float4 *newDir, float4 *f,
-        float *pdf) {
-    float refrRate = mat->refractionRate;
+bool brdfTransmission(float4 dir, float4 normal, float4 albedo, int matID,
+        bool inside, float4 *newDir, float4 *f, float *pdf) {
+    return brdfRefraction(materialRefractionRate[matID], dir, normal, albedo,
+            matID, inside, newDir, f, pdf);
+}
+
+bool brdfDispersion(float4 dir, float4 normal, float4 albedo, int matID,
+        bool inside, float wavelength, bool dispersed, float4 *newDir,
+        float4 *f, float *pdf) {
+    float2 cauchy = materialCauchy[matID];
+    if(!brdfRefraction(cauchy.x + cauchy.y / (wavelength * wavelength), dir,
+                normal, albedo, matID, inside, newDir, f, pdf))
+        return false;
+
+    *f *= (float4) (dispersed ? 1.0f : 4.0f, 0.0f, 0.0f, 0.0f);
+    return true;
+}
+
+bool brdfRefraction(float refrRate, float4 dir, float4 normal, float4 albedo,
+        int matID, bool inside, float4 *newDir, float4 *f, float *pdf) {
     if(!inside)
         refrRate = 1.0f / refrRate;
 
     bool result = getTransmissionDirection(refrRate, dir, normal, inside, newDir);
     if(result) {
-        *f = albedo * mat->transmissionCoef;
+        *f = albedo * materialLobeWeight[matID].w;
         *pdf = 1.0f;
         return true;
     }
@@ -151,4 +241,12 @@ bool brdfTransmission(float4 dir, float4 normal, float4 albedo,
     return false;
 }
 
+bool materialDisperses(int matID) {
+#ifdef Spectral
+    return materialCauchy[matID].y != 0.0f;
+#else
+    return false;
+#endif
+}
+
 #endif // !BRDF_CL
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CAMERA_CL
+#define CAMERA_CL
+
+#include "random.cl"
+
+/**
+ * Viewpoint of the render, given as a kernel argument so it can be changed
+ * without rebuilding the program. Must match the CameraArg struct of
+ * SamplerImpl.hpp.
+ */
+typedef struct Camera {
+    float4 origin;      /// Position of the camera.
+    float4 topLeft;     /// Position of the top left pixel.
+    float4 up;          /// Direction to the top of the camera.
+    float4 right;       /// Direction to the right of the camera.
+    float pixelWidth;   /// Width of a pixel in world coordinates.
+    float pixelHeight;  /// Height of a pixel in world coordinates.
+    float lensRadius;   /// Radius of the thin lens aperture.
+    float focusScale;   /// Focus distance over the image plane distance.
+} Camera;
+
+/**
+ * Samples the time of a camera ray inside the shutter interval. Without
+ * motion blur all rays leave at time 0 and the seed is left untouched.
+ */
+float sampleShutter(uint2 *seed);
+
+float sampleShutter(uint2 *seed) {
+#ifdef MotionBlur
+    return randf(seed) * Shutter;
+#else
+    return 0.0f;
+#endif
+}
+
+#endif // !CAMERA_CL
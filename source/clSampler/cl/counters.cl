@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef COUNTERS_CL
+#define COUNTERS_CL
+
+/**
+ * Statistics counted by each work item. Must have NumKernelCounters fields.
+ */
+typedef struct Counters {
+    uint rays;         /// Rays traced.
+    uint bounces;      /// Rays scattered by a BRDF.
+    uint terminations; /// Paths stopped by the Russian roulette.
+} Counters;
+
+/// Sets all the counters to 0.
+void countersInit(Counters *counters);
+
+/**
+ * Adds the counters of the work item to the global counters. Each global
+ * counter is 64 bits, stored as the low and the high words. Does nothing if
+ * KernelCounters isn't defined.
+ */
+void countersFlush(Counters *counters, __global uint *totals);
+
+/// Atomically adds value to the 64 bit counter.
+void counterAdd(__global uint *counter, uint value);
+
+/// Adds the value to the float with a compare and swap loop.
+void atomicAddFloat(volatile __global float *address, float value);
+
+void countersInit(Counters *counters) {
+    counters->rays = 0;
+    counters->bounces = 0;
+    counters->terminations = 0;
+}
+
+void countersFlush(Counters *counters, __global uint *totals) {
+#ifdef KernelCounters
+    counterAdd(&totals[0], counters->rays);
+    counterAdd(&totals[2], counters->bounces);
+    counterAdd(&totals[4], counters->terminations);
+#endif
+}
+
+void counterAdd(__global uint *counter, uint value) {
+    if(!value)
+        return;
+
+    // Carry to the high word if the low word wrapped around.
+    uint old = atomic_add(&counter[0], value);
+    if(old + value < old)
+        atomic_inc(&counter[1]);
+}
+
+void atomicAddFloat(volatile __global float *address, float value) {
+    if(value == 0.0f)
+        return;
+
+    union {
+        uint word;
+        float value;
+    } old, sum;
+    do {
+        old.value = *address;
+        sum.value = old.value + value;
+    } while(atomic_cmpxchg((volatile __global uint *) address, old.word,
+                sum.word) != old.word);
+}
+
+#endif // !COUNTERS_CL
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DENOISE_CL
+#define DENOISE_CL
+
+#include "accum.cl"
+#include "aov.cl"
+
+/// Smallest albedo divided out of the colors.
+#define MinAlbedo 0.01f
+
+/// Tolerance of the differences between the normals of two pixels.
+#define NormalSigma 0.3f
+
+/// Tolerance of the differences between the albedos of two pixels.
+#define AlbedoSigma 0.1f
+
+/// Tolerance of the relative depth difference between adjacent pixels.
+#define DepthSigma 0.05f
+
+/**
+ * Divides the albedo of the first hit out of the average color of the passes,
+ * so the filter only smooths the lighting and keeps the texture detail.
+ * @param accum HDR accumulator of the passes.
+ * @param aovFB AOV framebuffer, with the albedo, normal and depth.
+ * @param size Width and height of the image.
+ * @param numPasses Number of passes in the accumulators.
+ * @param out Lighting of each pixel.
+ */
+__kernel void demodulate(__global const AccumPixel *accum,
+        __global const AovValue *aovFB, int2 size, uint numPasses,
+        __global float4 *out)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    if(coord.x >= size.x || coord.y >= size.y)
+        return;
+
+    int i = coord.y * size.x + coord.x;
+    float4 albedo = aovRead3(aovFB, AovAlbedoChannel, i, size.x * size.y,
+            numPasses);
+    out[i] = accumRead(accum, i, numPasses) / max(albedo, (float4) (MinAlbedo));
+}
+
+/**
+ * One iteration of the edge avoiding a-trous wavelet filter (Dammertz et al.,
+ * 2010). Smooths the lighting with a 5x5 B3 spline kernel whose taps are step
+ * pixels apart, weighting each tap down as its color, normal, albedo and
+ * depth move away from the ones of the center pixel.
+ * @param in Lighting filtered by the previous iterations.
+ * @param aovFB AOV framebuffer, with the albedo, normal and depth.
+ * @param step Distance between the taps, doubled on each iteration.
+ * @param colorSigma Tolerance of the color differences, halved on each
+ * iteration.
+ * @param out Filtered lighting.
+ */
+__kernel void atrous(__global const float4 *in,
+        __global const AovValue *aovFB, int2 size, uint numPasses,
+        int step, float colorSigma, __global float4 *out)
+{
+    const float weights[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    if(coord.x >= size.x || coord.y >= size.y)
+        return;
+
+    int numPixels = size.x * size.y;
+    int i = coord.y * size.x + coord.x;
+    float4 color = in[i];
+    float4 albedo = aovRead3(aovFB, AovAlbedoChannel, i, numPixels, numPasses);
+    float4 normal = aovRead3(aovFB, AovNormalChannel, i, numPixels, numPasses);
+    float depth = aovRead(aovFB, AovDepthChannel, i, numPixels, numPasses);
+
+    // Colors are compared after compressing their range, so the fireflies
+    // don't reject all their neighbours.
+    float3 compressed = color.xyz / (1.0f + color.xyz);
+    float depthScale = 1.0f / (DepthSigma * step * depth + 1e-4f);
+
+    float4 sum = (float4) (0.0f);
+    float weightSum = 0.0f;
+    for(int dy = -2; dy <= 2; ++dy) {
+        for(int dx = -2; dx <= 2; ++dx) {
+            int2 q = coord + step * (int2) (dx, dy);
+            if(q.x < 0 || q.y < 0 || q.x >= size.x || q.y >= size.y)
+                continue;
+
+            int j = q.y * size.x + q.x;
+            float4 qColor = in[j];
+            float4 qAlbedo = aovRead3(aovFB, AovAlbedoChannel, j, numPixels,
+                    numPasses);
+            float4 qNormal = aovRead3(aovFB, AovNormalChannel, j, numPixels,
+                    numPasses);
+            float qDepth = aovRead(aovFB, AovDepthChannel, j, numPixels,
+                    numPasses);
+
+            float3 dc = qColor.xyz / (1.0f + qColor.xyz) - compressed;
+            float3 dn = qNormal.xyz - normal.xyz;
+            float3 da = qAlbedo.xyz - albedo.xyz;
+            float dz = fabs(qDepth - depth) * depthScale;
+
+            float weight = weights[abs(dx)] * weights[abs(dy)]
+                * exp(-dot(dc, dc) / (colorSigma * colorSigma)
+                        - dot(dn, dn) / (NormalSigma * NormalSigma)
+                        - dot(da, da) / (AlbedoSigma * AlbedoSigma) - dz);
+
+            sum += weight * qColor;
+            weightSum += weight;
+        }
+    }
+
+    // The center pixel always has a weight, so weightSum > 0.
+    out[i] = sum / weightSum;
+}
+
+/**
+ * Multiplies the filtered lighting back by the albedo of the first hit.
+ * @param in Filtered lighting.
+ * @param aovFB AOV framebuffer, with the albedo, normal and depth.
+ * @param out Denoised HDR color of each pixel, as an accumulator with a single
+ * pass.
+ */
+__kernel void remodulate(__global const float4 *in,
+        __global const AovValue *aovFB, int2 size, uint numPasses,
+        __global AccumPixel *out)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    if(coord.x >= size.x || coord.y >= size.y)
+        return;
+
+    int i = coord.y * size.x + coord.x;
+    float4 albedo = aovRead3(aovFB, AovAlbedoChannel, i, size.x * size.y,
+            numPasses);
+    accumAdd(out, i, in[i] * max(albedo, (float4) (MinAlbedo)), 0);
+}
+
+#endif // !DENOISE_CL
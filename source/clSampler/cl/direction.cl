@@ -53,7 +53,7 @@ float4 getReflectionDirection(float4 dir, float4 normal) {
 bool getTransmissionDirection(float refrRate, float4 dir, float4 normal,
         bool inside, float4 *transDir) {
     float ddn = dot(dir, normal);
-    float cos2t = 1.0f - pow(refrRate, 2) * (1.0f - pow(ddn, 2));
+    float cos2t = 1.0f - refrRate * refrRate * (1.0f - ddn * ddn);
 
     if(cos2t < -FLT_EPSILON) { // Total internal reflection.
         *transDir = normalize((2 * normal * ddn) - dir);
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FASTMATH_CL
+#define FASTMATH_CL
+
+/*
+ * Math functions of the sampling code. With FastMath defined they map to the
+ * native_* builtins, which run on the hardware approximations of the device
+ * (with an implementation defined accuracy), or to polynomial approximations,
+ * otherwise to the full precision builtins. The callers avoid trigonometric
+ * functions where an identity gives the same value from what is already
+ * known, e.g. the sine of a polar angle from its cosine.
+ */
+
+/// Square root of x.
+float mathSqrt(float x);
+
+/// x to the power of y, for x >= 0.
+float mathPowr(float x, float y);
+
+/**
+ * Returns the sine of 2 pi u and sets cosValue to its cosine, the direction of
+ * an uniformly sampled azimuthal angle.
+ */
+float mathSinCos2Pi(float u, float *cosValue);
+
+/// Normalizes the vector, whose w must be 0.
+float4 mathNormalize(float4 v);
+
+#ifdef FastMath
+
+float mathSqrt(float x) {
+    return native_sqrt(x);
+}
+
+float mathPowr(float x, float y) {
+    // native_powr(0, 0) is undefined, but the lobes expect pow()'s 1.
+    return y == 0.0f ? 1.0f : native_powr(x, y);
+}
+
+float mathSinCos2Pi(float u, float *cosValue) {
+    // With a = pi u reduced to [-pi/2, pi/2], the Taylor series of degree 11
+    // and 10 give sin(a) and cos(a) within 1e-6, and the double angle
+    // identities give the sine and the cosine of 2a, within 1.2e-6 once the
+    // products are rounded.
+    float a = M_PI_F * (u - rint(u));
+    float a2 = a * a;
+    float s = a * (1.0f + a2 * (-1.0f / 6 + a2 * (1.0f / 120
+            + a2 * (-1.0f / 5040 + a2 * (1.0f / 362880
+            + a2 * (-1.0f / 39916800))))));
+    float c = 1.0f + a2 * (-1.0f / 2 + a2 * (1.0f / 24
+            + a2 * (-1.0f / 720 + a2 * (1.0f / 40320
+            + a2 * (-1.0f / 3628800)))));
+
+    *cosValue = 1.0f - 2.0f * s * s;
+    return 2.0f * s * c;
+}
+
+float4 mathNormalize(float4 v) {
+    return v * native_rsqrt(dot(v, v));
+}
+
+#else // !FastMath
+
+float mathSqrt(float x) {
+    return sqrt(x);
+}
+
+float mathPowr(float x, float y) {
+    return pow(x, y);
+}
+
+float mathSinCos2Pi(float u, float *cosValue) {
+    return sincos(2.0f * M_PI_F * u, cosValue);
+}
+
+float4 mathNormalize(float4 v) {
+    return normalize(v);
+}
+
+#endif // FastMath
+
+#endif // !FASTMATH_CL
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUIDE_CL
+#define GUIDE_CL
+
+#include "brdf.cl"
+#include "counters.cl"
+#include "fastmath.cl"
+#include "random.cl"
+#include "spectrum.cl"
+
+/*
+ * Path guiding learns the distribution of the light arriving at the diffuse
+ * bounces and samples the bounces from it. Space is split in cells of a hash
+ * table, whose size grows in powers of 2 with the distance to the camera, and
+ * each cell holds a histogram of GuideBins directions. The directions are
+ * binned by their z and their azimuth, which gives bins of equal solid angle.
+ *
+ * On the training passes the bounces are sampled by the BRDF, and the
+ * luminance of the light returned by each bounce divided by its pdf is added
+ * to its bin, as a 64 bit fixed point counter. The host then turns the
+ * counters into the cumulative distribution of each cell, and the next passes
+ * sample the diffuse lobe from a mix of the cosine and the cell distribution.
+ */
+
+/// Number of directional bins of a cell.
+#define GuideBins (GuideResolution * GuideResolution)
+
+/// Probability of sampling a diffuse bounce from the cell distribution.
+#define GuideFraction (0.5f)
+
+/// Scale of the fixed point training counters.
+#define GuideFixedPoint (256.0f)
+
+/// Phases of the path guiding. Must match SamplerImpl::GuidePhase.
+typedef enum GuidePhase {
+    GuideOff,
+    GuideTraining,
+    GuideSampling
+} GuidePhase;
+
+/// Path guiding data of a work item.
+typedef struct Guide {
+    __global uint *train;       /// Training counters of the bins.
+    __global const float *cdf;  /// Cumulative distribution of each cell.
+    float4 camera;              /// Origin of the primary rays.
+    GuidePhase phase;
+} Guide;
+
+/**
+ * Initializes the path guiding data.
+ * @param train Training counters, as the low and high words of each bin.
+ * @param cdf Cumulative distribution of the bins of each cell.
+ * @param camera Position of the camera, which sets the size of the cells.
+ * @param phase Phase of the pass. Always GuideOff without PathGuiding.
+ */
+void guideInit(Guide *guide, __global uint *train, __global const float *cdf,
+        float4 camera, uint phase);
+
+/**
+ * Same as brdfSampleLobe(), but samples the diffuse lobe from the path
+ * guiding distribution when guiding.
+ * @param position Position of the bounce.
+ * @param bin Set to the index of the training counter of the sampled
+ * direction when training, or to -1.
+ */
+bool guidedBrdf(Guide *guide, Lobe lobe, float4 position, float4 dir,
+        float4 normal, float4 albedo, int matID, bool inside, uint2 *seed,
+        float4 *newDir, float4 *f, float *pdf, int *bin);
+
+/**
+ * Adds the light returned by a training bounce to its bin.
+ * @param bin Index of the counter, as given by guidedBrdf().
+ * @param radiance Light returned by the bounce.
+ * @param pdf Pdf of the direction of the bounce.
+ */
+void guideRecord(Guide *guide, int bin, float4 radiance, float pdf);
+
+#ifdef PathGuiding
+/// Returns the index of the cell of the position in the hash table.
+int guideCell(Guide *guide, float4 position);
+
+/// Returns the index of the bin of the direction in its cell.
+int guideBin(float4 dir);
+
+/**
+ * Samples a direction from the distribution of the cell.
+ * @param cdf Cumulative distribution of the cell.
+ */
+float4 guideSample(__global const float *cdf, uint2 *seed);
+
+/// Returns the pdf of the direction in the distribution of the cell.
+float guidePdf(__global const float *cdf, float4 dir);
+
+/**
+ * Samples the diffuse lobe from the mix of the cosine and the distribution
+ * of the cell. Directions below the surface have no contribution.
+ */
+bool guideDiffuse(__global const float *cdf, float4 normal, float4 albedo,
+        int matID, uint2 *seed, float4 *newDir, float4 *f, float *pdf);
+#endif
+
+void guideInit(Guide *guide, __global uint *train, __global const float *cdf,
+        float4 camera, uint phase) {
+    guide->train = train;
+    guide->cdf = cdf;
+    guide->camera = camera;
+#ifdef PathGuiding
+    guide->phase = (GuidePhase) phase;
+#else
+    guide->phase = GuideOff;
+#endif
+}
+
+bool guidedBrdf(Guide *guide, Lobe lobe, float4 position, float4 dir,
+        float4 normal, float4 albedo, int matID, bool inside, uint2 *seed,
+        float4 *newDir, float4 *f, float *pdf, int *bin) {
+    *bin = -1;
+
+#ifdef PathGuiding
+    // Only the diffuse lobe is guided, the others are much narrower than the
+    // bins.
+    if(lobe != DiffuseLobe || guide->phase == GuideOff)
+        return brdfSampleLobe(lobe, dir, normal, albedo, matID, inside, seed,
+                newDir, f, pdf);
+
+    int cell = guideCell(guide, position);
+    if(guide->phase == GuideTraining) {
+        if(!brdfDiffuse(normal, albedo, matID, seed, newDir, f, pdf))
+            return false;
+
+        *bin = cell * GuideBins + guideBin(*newDir);
+        return true;
+    }
+
+    return guideDiffuse(guide->cdf + cell * GuideBins, normal, albedo, matID,
+            seed, newDir, f, pdf);
+#else
+    return brdfSampleLobe(lobe, dir, normal, albedo, matID, inside, seed,
+            newDir, f, pdf);
+#endif
+}
+
+void guideRecord(Guide *guide, int bin, float4 radiance, float pdf) {
+#ifdef PathGuiding
+    float luminance = spectrumLuminance(radiance);
+    counterAdd(&guide->train[2 * bin],
+            convert_uint_sat(luminance / pdf * GuideFixedPoint));
+#endif
+}
+
+#ifdef PathGuiding
+int guideCell(Guide *guide, float4 position) {
+    // The size of the cell is the power of 2 above the size of GuideCellScale
+    // radians at the distance of the position.
+    float distance = length((position - guide->camera).xyz);
+    int level = clamp((int) ceil(log2(distance * GuideCellScale)), -64, 64);
+    int3 cell = convert_int3_rtn(position.xyz / exp2((float) level));
+
+    uint hash = ((uint) cell.x * 73856093u) ^ ((uint) cell.y * 19349663u)
+        ^ ((uint) cell.z * 83492791u) ^ ((uint) level * 2654435761u);
+    return hash & (GuideCells - 1);
+}
+
+int guideBin(float4 dir) {
+    int row = (int) ((dir.z + 1.0f) * (0.5f * GuideResolution));
+    int column = (int) ((atan2(dir.y, dir.x) * M_1_PI_F + 1.0f)
+            * (0.5f * GuideResolution));
+    return clamp(row, 0, GuideResolution - 1) * GuideResolution
+        + clamp(column, 0, GuideResolution - 1);
+}
+
+float4 guideSample(__global const float *cdf, uint2 *seed) {
+    // Find the first bin whose cumulative probability is above u.
+    float u = randf(seed);
+    int low = 0, high = GuideBins - 1;
+    while(low < high) {
+        int middle = (low + high) / 2;
+        if(cdf[middle] > u)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    // Sample the bin uniformly. The azimuth goes from -pi to pi, as atan2().
+    int row = low / GuideResolution, column = low % GuideResolution;
+    float z = (row + randf(seed)) * (2.0f / GuideResolution) - 1.0f;
+    float r = mathSqrt(max(1.0f - z * z, 0.0f));
+    float cosPhi, sinPhi = mathSinCos2Pi(
+            (column + randf(seed)) / GuideResolution - 0.5f, &cosPhi);
+
+    return (float4) (r * cosPhi, r * sinPhi, z, 0.0f);
+}
+
+float guidePdf(__global const float *cdf, float4 dir) {
+    int bin = guideBin(dir);
+    float probability = cdf[bin] - (bin ? cdf[bin - 1] : 0.0f);
+
+    // Every bin has a solid angle of 4 pi / GuideBins.
+    return probability * (GuideBins * 0.25f * M_1_PI_F);
+}
+
+bool guideDiffuse(__global const float *cdf, float4 normal, float4 albedo,
+        int matID, uint2 *seed, float4 *newDir, float4 *f, float *pdf) {
+    if(randf(seed) < GuideFraction)
+        *newDir = guideSample(cdf, seed);
+    else
+        brdfDiffuse(normal, albedo, matID, seed, newDir, f, pdf);
+
+    // The pdf is the mix of both, whichever sampled the direction.
+    float cosND = max(dot(normal, *newDir), 0.0f);
+    *f = albedo * (materialLobeWeight[matID].x * cosND);
+    *pdf = (1.0f - GuideFraction) * cosND * M_1_PI_F
+        + GuideFraction * guidePdf(cdf, *newDir);
+
+    return *pdf >= FLT_EPSILON;
+}
+#endif
+
+#endif // !GUIDE_CL
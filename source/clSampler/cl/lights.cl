@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef LIGHTS_CL
+#define LIGHTS_CL
+
+#include "brdf.cl"
+#include "counters.cl"
+#include "fastmath.cl"
+#include "intersection.cl"
+#include "random.cl"
+#include "spectrum.cl"
+
+/*
+ * With LightSampling the emitters are sampled at the diffuse bounces (next
+ * event estimation). An emissive sphere is chosen, uniformly with
+ * UniformLights or by traversing the light tree with TreeLights, and a
+ * shadow ray is traced to a direction of the cone that it covers. The ray of
+ * the bounce then doesn't add the emission of the spheres it hits, which was
+ * already sampled.
+ *
+ * The light tree is built by the host (see LightTree.hpp). Each node has the
+ * bounding sphere and the summed power of its emitters, and the children of
+ * a node are consecutive. The traversal goes to each child with probability
+ * proportional to its importance at the bounce, so it chooses an emitter in
+ * proportion to its estimated contribution in log2(NumLights) steps.
+ */
+
+/// Largest float below 1.
+#define OneMinusEpsilon (0x1.fffffep-1f)
+
+/**
+ * Returns the light of a random emitter reflected by the diffuse lobe,
+ * divided by the probability of sampling it. Returns 0 without LightSampling.
+ * @param position Position of the bounce.
+ * @param normal Normal of the surface, on the side of the reflection.
+ * @param albedo Color of the surface.
+ * @param exclType Type of the object of the bounce.
+ * @param exclID ID of the object of the bounce.
+ * @param counters Statistics of the work item, which count the shadow ray.
+ * @param wavelengths Wavelengths of the path, for the emission.
+ * @param time Time of the path, for the shadow ray. The emitters don't move.
+ */
+float4 sampleLights(float4 position, float4 normal, float4 albedo, int matID,
+        IntersectionType exclType, int exclID, uint2 *seed,
+        Counters *counters, float4 wavelengths, float time);
+
+/**
+ * Samples a uniform point of a random emitter, where the light subpaths of
+ * -bdpt and the photons of -sppm start. NumLights must be > 0.
+ * @param position Set to the point.
+ * @param normal Set to the outward normal of the emitter at the point.
+ * @param pdf Set to the area density of the point, over all the emitters.
+ * @return ID of the sphere of the emitter.
+ */
+int sampleEmitterPoint(uint2 *seed, float4 *position, float4 *normal,
+        float *pdf);
+
+/// Samples a direction around the normal with a cosine distribution.
+float4 sampleCosine(float4 normal, uint2 *seed);
+
+#ifdef LightSampling
+/**
+ * Chooses an emitter.
+ * @param u Uniform random number in [0, 1).
+ * @param pdf Set to the probability of choosing the emitter.
+ * @return ID of the sphere of the emitter, or -1 if no emitter can light the
+ * position.
+ */
+int chooseLight(float4 position, float4 normal, float u, float *pdf);
+
+/**
+ * Returns the importance of the node of the light tree at the position: its
+ * power over the squared distance to its bounding sphere, clamped to its
+ * radius, or 0 if the bounding sphere is below the surface.
+ */
+float lightImportance(int node, float4 position, float4 normal);
+#endif
+
+float4 sampleLights(float4 position, float4 normal, float4 albedo, int matID,
+        IntersectionType exclType, int exclID, uint2 *seed,
+        Counters *counters, float4 wavelengths, float time) {
+#ifdef LightSampling
+    if(NumLights == 0)
+        return (float4) (0.0f);
+
+    float lightPdf;
+    int id = chooseLight(position, normal, randf(seed), &lightPdf);
+    if(id < 0)
+        return (float4) (0.0f);
+
+    // Nothing is sampled from inside the emitter.
+    float4 toCenter = spheres[id].center - position;
+    toCenter.w = 0.0f;
+    float distance2 = dot(toCenter, toCenter);
+    float radius2 = spheres[id].radius2;
+    if(distance2 <= radius2)
+        return (float4) (0.0f);
+
+    // Sample the cone of directions to the sphere uniformly. 1 - cos(max)
+    // is computed without the cancellation of distant spheres.
+    float sin2Max = radius2 / distance2;
+    float cosMax = mathSqrt(1.0f - sin2Max);
+    float oneMinusCosMax = sin2Max / (1.0f + cosMax);
+    float cosTheta = 1.0f - randf(seed) * oneMinusCosMax;
+    float sinTheta = mathSqrt(max(1.0f - cosTheta * cosTheta, 0.0f));
+    float cosPhi, sinPhi = mathSinCos2Pi(randf(seed), &cosPhi);
+
+    float4 u, v, w;
+    getNormalBase(toCenter * rsqrt(distance2), &u, &v, &w);
+    float4 dir = mathNormalize(u * sinTheta * cosPhi + v * sinTheta * sinPhi
+            + w * cosTheta);
+
+    float cosND = dot(normal, dir);
+    if(cosND <= 0.0f)
+        return (float4) (0.0f);
+
+    // The emitter is only visible if the shadow ray hits it first.
+    int hitID;
+    IntersectionType hitType = trace(position, dir, exclType, exclID, 0,
+            &hitID, 0, 0, 0, time);
+    ++counters->rays;
+    if(hitType != SphereIntersection || hitID != id)
+        return (float4) (0.0f);
+
+    float dirPdf = 0.5f * M_1_PI_F / oneMinusCosMax;
+    return spectrumSample(spheres[id].emission, wavelengths) * albedo
+        * (materialLobeWeight[matID].x * cosND / (dirPdf * lightPdf));
+#else
+    return (float4) (0.0f);
+#endif
+}
+
+int sampleEmitterPoint(uint2 *seed, float4 *position, float4 *normal,
+        float *pdf) {
+    int id = lights[min((int) (randf(seed) * NumLights), NumLights - 1)];
+    float radius2 = spheres[id].radius2;
+
+    // Uniform point of the sphere.
+    float z = 1.0f - 2.0f * randf(seed);
+    float r = mathSqrt(max(1.0f - z * z, 0.0f));
+    float cosPhi, sinPhi = mathSinCos2Pi(randf(seed), &cosPhi);
+    *normal = (float4) (r * cosPhi, r * sinPhi, z, 0.0f);
+    *position = spheres[id].center + *normal * sqrt(radius2);
+    *pdf = 0.25f * M_1_PI_F / (radius2 * NumLights);
+
+    return id;
+}
+
+float4 sampleCosine(float4 normal, uint2 *seed) {
+    float4 u, v, w;
+    getNormalBase(normal, &u, &v, &w);
+
+    float u1 = randf(seed), u2 = randf(seed);
+    float cosPhi, sinPhi = mathSinCos2Pi(u1, &cosPhi);
+    float r = mathSqrt(u2);
+
+    return mathNormalize(u * cosPhi * r + v * sinPhi * r
+            + w * mathSqrt(1.0f - u2));
+}
+
+#ifdef LightSampling
+int chooseLight(float4 position, float4 normal, float u, float *pdf) {
+#ifdef TreeLights
+    // The random number is rescaled to the range of the chosen child at each
+    // level, so a single one chooses the whole path.
+    int node = 0;
+    *pdf = 1.0f;
+    while(!lightNodes[node].leaf) {
+        int child = lightNodes[node].child;
+        float left = lightImportance(child, position, normal);
+        float right = lightImportance(child + 1, position, normal);
+        if(left + right <= 0.0f)
+            return -1;
+
+        float leftProbability = left / (left + right);
+        if(u < leftProbability) {
+            node = child;
+            u = min(u / leftProbability, OneMinusEpsilon);
+            *pdf *= leftProbability;
+        }
+        else {
+            node = child + 1;
+            u = min((u - leftProbability) / (1.0f - leftProbability),
+                    OneMinusEpsilon);
+            *pdf *= 1.0f - leftProbability;
+        }
+    }
+
+    return lightNodes[node].child;
+#else
+    *pdf = 1.0f / NumLights;
+    return lights[min((int) (u * NumLights), NumLights - 1)];
+#endif
+}
+
+float lightImportance(int node, float4 position, float4 normal) {
+    float4 bounds = lightNodes[node].bounds;
+    float3 toCenter = bounds.xyz - position.xyz;
+
+    if(dot(toCenter, normal.xyz) < -bounds.w)
+        return 0.0f;
+
+    float distance2 = dot(toCenter, toCenter);
+    return lightNodes[node].power / max(distance2, bounds.w * bounds.w);
+}
+#endif
+
+#endif // !LIGHTS_CL
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Microbenchmark of the math functions of fastmath.cl. It is built on its own,
+ * with and without FastMath, and isn't part of the sampler program.
+ */
+
+#include "fastmath.cl"
+
+/// Functions measured by the kernels. Must match the order of the host.
+typedef enum MathFunction {
+    SqrtFunction,
+    PowrFunction,
+    Sin2PiFunction,
+    Cos2PiFunction,
+    NormalizeFunction,
+    NumMathFunctions
+} MathFunction;
+
+/**
+ * Evaluates every function once per input, for the accuracy report.
+ * @param in Inputs (x, y, z, w): sqrt() and the sine and cosine take x, in
+ * [0, 1], powr() takes x to the power of w and normalize() takes (x, y, z).
+ * @param out Results, NumMathFunctions per input. Only the x of the
+ * normalized vector is kept.
+ */
+__kernel void mathAccuracy(__global const float4 *in, __global float *out) {
+    size_t i = get_global_id(0);
+    __global float *result = out + NumMathFunctions * i;
+    float4 v = in[i];
+    float cosValue;
+
+    result[SqrtFunction] = mathSqrt(v.x);
+    result[PowrFunction] = mathPowr(v.x, v.w);
+    result[Sin2PiFunction] = mathSinCos2Pi(v.x, &cosValue);
+    result[Cos2PiFunction] = cosValue;
+    result[NormalizeFunction] = mathNormalize((float4) (v.xyz, 0.0f)).x;
+}
+
+/**
+ * Evaluates a function iterations times per work item, for the throughput.
+ * Each result is the input of the next evaluation, so that none of them can
+ * be removed, and the inputs stay in the range of the sampling code.
+ * @param function The MathFunction, where the sine also measures the cosine.
+ * @param out Last value of each work item.
+ */
+__kernel void mathThroughput(uint iterations, int function,
+        __global float *out) {
+    float x = (get_global_id(0) + 0.5f) / get_global_size(0);
+    float cosValue;
+    float4 v;
+
+    switch(function) {
+        case SqrtFunction:
+            for(uint i = 0; i < iterations; ++i)
+                x = mathSqrt(x) * 0.5f + 0.25f;
+            break;
+        case PowrFunction:
+            for(uint i = 0; i < iterations; ++i)
+                x = mathPowr(x, 20.0f) * 0.5f + 0.25f;
+            break;
+        case Sin2PiFunction:
+            for(uint i = 0; i < iterations; ++i)
+                x = mathSinCos2Pi(x, &cosValue) * cosValue + 0.5f;
+            break;
+        case NormalizeFunction:
+            for(uint i = 0; i < iterations; ++i) {
+                v = mathNormalize((float4) (x, 0.5f, 0.25f, 0.0f));
+                x = v.x + v.y;
+            }
+            break;
+        default:
+            break;
+    }
+
+    out[get_global_id(0)] = x;
+}
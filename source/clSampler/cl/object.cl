@@ -20,6 +20,14 @@ float4 getTextureColor(TextureType type, int id, float4 p);
 void getObjectIDs(IntersectionType iType, int id, int *materialID,
         TextureType *textureType, int *textureID);
 
+/**
+ * Returns the index of the object among all the objects of the scene, as
+ * recorded in the ID AOV.
+ * @param iType Type of the intersected object.
+ * @param id ID of the object among the objects of its type.
+ */
+int getObjectIndex(IntersectionType iType, int id);
+
 /**
  * Returns if a sphere emits.
  */
@@ -79,6 +87,32 @@ void getObjectIDs(IntersectionType iType, int id, int *materialID,
                 *textureType = polyhedrons[id].textureType;
             }
             break;
+
+        case PlaneIntersection:
+            *materialID = planes[id].materialID;
+            *textureID = planes[id].textureID;
+            *textureType = planes[id].textureType;
+            break;
+
+        case QuadIntersection:
+            *materialID = quads[id].materialID;
+            *textureID = quads[id].textureID;
+            *textureType = quads[id].textureType;
+            break;
+    }
+}
+
+int getObjectIndex(IntersectionType iType, int id) {
+    // Spheres, polyhedrons, planes and quads, in this order.
+    switch(iType) {
+        case PolyhedronIntersection:
+            return NumSpheres + id;
+        case PlaneIntersection:
+            return NumSpheres + NumPolyhedrons + id;
+        case QuadIntersection:
+            return NumSpheres + NumPolyhedrons + NumPlanes + id;
+        default:
+            return id;
     }
 }
 
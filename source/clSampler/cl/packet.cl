@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PACKET_CL
+#define PACKET_CL
+
+#include "intersection.cl"
+
+/// Number of rays traced together. Each ray uses one lane of a float4.
+#define PacketSize (4)
+
+/**
+ * Frustum that bounds a packet of rays with the same origin. The planes pass
+ * through the origin and their normals point to the inside of the frustum.
+ */
+typedef struct Frustum {
+    float4 origin;
+    float4 planes[4];
+} Frustum;
+
+/**
+ * Creates the frustum from the origin through the given corners. The corners
+ * must be given in order around the border of the packet.
+ */
+Frustum makeFrustum(float4 origin, float4 corner0, float4 corner1,
+        float4 corner2, float4 corner3);
+
+/// Returns true if the sphere is entirely outside the frustum.
+bool frustumCullsSphere(Frustum *frustum, float4 center, float radius2);
+
+/// Returns true if the box is entirely outside the frustum.
+bool frustumCullsBox(Frustum *frustum, float4 boundsMin, float4 boundsMax);
+
+/**
+ * Traces a packet of PacketSize rays that start at the frustum origin and
+ * are inside the frustum. Does the same as trace() for every ray, but the
+ * plane, quad and sphere tests of all rays are done at once and objects
+ * outside the frustum are skipped for the whole packet.
+ * @param frustum Frustum that bounds all the rays.
+ * @param dirs Directions of the rays.
+ * @param hits Set to the closest intersection of each ray.
+ */
+void tracePacket(Frustum *frustum, float4 *dirs, Hit *hits);
+
+Frustum makeFrustum(float4 origin, float4 corner0, float4 corner1,
+        float4 corner2, float4 corner3) {
+    Frustum frustum;
+    float4 corners[4] = {
+        corner0 - origin, corner1 - origin, corner2 - origin, corner3 - origin
+    };
+    float4 center = corners[0] + corners[1] + corners[2] + corners[3];
+
+    frustum.origin = origin;
+    for(int i = 0; i < 4; ++i) {
+        float4 n = normalize(cross(corners[i], corners[(i + 1) % 4]));
+        if(dot(n, center) < 0.0f) // Make it point inside.
+            n *= -1.0f;
+        frustum.planes[i] = n;
+    }
+
+    return frustum;
+}
+
+bool frustumCullsSphere(Frustum *frustum, float4 center, float radius2) {
+    float4 e = center - frustum->origin;
+
+    for(int i = 0; i < 4; ++i) {
+        float dist = dot(frustum->planes[i], e);
+        if(dist < 0.0f && dist * dist > radius2)
+            return true;
+    }
+
+    return false;
+}
+
+bool frustumCullsBox(Frustum *frustum, float4 boundsMin, float4 boundsMax) {
+    for(int i = 0; i < 4; ++i) {
+        // The corner of the box that is the furthest along the normal.
+        float4 n = frustum->planes[i];
+        float4 p = select(boundsMin, boundsMax, n > (float4) (0.0f));
+        if(dot(n, p - frustum->origin) < 0.0f)
+            return true;
+    }
+
+    return false;
+}
+
+void tracePacket(Frustum *frustum, float4 *dirs, Hit *hits) {
+    float4 origin = frustum->origin;
+    float4 dirX = (float4) (dirs[0].x, dirs[1].x, dirs[2].x, dirs[3].x);
+    float4 dirY = (float4) (dirs[0].y, dirs[1].y, dirs[2].y, dirs[3].y);
+    float4 dirZ = (float4) (dirs[0].z, dirs[1].z, dirs[2].z, dirs[3].z);
+
+    float4 closestT = (float4) (FLT_MAX);
+    int4 closestID = (int4) (-1);
+    int4 closestType = (int4) (NoIntersection);
+    int4 closestInside = (int4) (0);
+
+    // Intersect all the rays with the planes and the quads at once, first as
+    // in trace().
+    for(int i = 0; i < NumPlanes; ++i) {
+        float4 plane = planes[i].plane;
+        float4 dn = plane.x * dirX + plane.y * dirY + plane.z * dirZ;
+        float4 t = (float4) (-(dot(plane.xyz, origin.xyz) + plane.w)) / dn;
+
+        int4 closer = (fabs(dn) > (float4) (FLT_EPSILON))
+            & (t > (float4) (FLT_EPSILON)) & (t < closestT);
+        closestT = select(closestT, t, closer);
+        closestID = select(closestID, (int4) (i), closer);
+        closestType = select(closestType, (int4) (PlaneIntersection), closer);
+    }
+    for(int i = 0; i < NumQuads; ++i) {
+        float4 plane = quads[i].plane;
+        float4 dn = plane.x * dirX + plane.y * dirY + plane.z * dirZ;
+        float4 t = (float4) (-(dot(plane.xyz, origin.xyz) + plane.w)) / dn;
+
+        // Coordinates of the hits along the edges.
+        float4 e = origin - quads[i].corner;
+        float4 px = e.x + t * dirX, py = e.y + t * dirY, pz = e.z + t * dirZ;
+        float4 uDual = quads[i].uDual, vDual = quads[i].vDual;
+        float4 s = uDual.x * px + uDual.y * py + uDual.z * pz;
+        float4 r = vDual.x * px + vDual.y * py + vDual.z * pz;
+
+        int4 closer = (fabs(dn) > (float4) (FLT_EPSILON))
+            & (t > (float4) (FLT_EPSILON)) & (t < closestT)
+            & (s >= (float4) (0.0f)) & (s <= (float4) (1.0f))
+            & (r >= (float4) (0.0f)) & (r <= (float4) (1.0f));
+        closestT = select(closestT, t, closer);
+        closestID = select(closestID, (int4) (i), closer);
+        closestType = select(closestType, (int4) (QuadIntersection), closer);
+    }
+
+    // Intersect all the rays with the spheres at once, with the robust test
+    // of sphereIntersection().
+    for(int i = 0; i < NumSpheres; ++i) {
+        if(frustumCullsSphere(frustum, spheres[i].center, spheres[i].radius2))
+            continue;
+
+        float4 e = spheres[i].center - origin;
+        float4 tca = e.x * dirX + e.y * dirY + e.z * dirZ;
+        float4 lx = e.x - tca * dirX, ly = e.y - tca * dirY,
+               lz = e.z - tca * dirZ;
+        float4 radius2 = (float4) (spheres[i].radius2);
+        float4 discriminant = radius2 - (lx * lx + ly * ly + lz * lz);
+        int4 hit = discriminant >= (float4) (0.0f);
+
+        float4 q = tca + copysign(sqrt(fmax(discriminant, (float4) (0.0f))),
+                tca);
+        float4 c = (float4) (dot(e, e) - spheres[i].radius2);
+        float4 t1 = fmin(c / q, q), t2 = fmax(c / q, q);
+        int4 front = t1 > (float4) (0.0f);
+        float4 t = select(t2, t1, front);
+
+        int4 closer = hit & (t > (float4) (FLT_EPSILON)) & (t < closestT);
+        closestT = select(closestT, t, closer);
+        closestID = select(closestID, (int4) (i), closer);
+        closestType = select(closestType, (int4) (SphereIntersection), closer);
+        closestInside = select(closestInside, ~front, closer);
+    }
+
+    float ts[PacketSize];
+    int ids[PacketSize], types[PacketSize], insides[PacketSize];
+    float4 normals[PacketSize];
+    vstore4(closestT, 0, ts);
+    vstore4(closestID, 0, ids);
+    vstore4(closestType, 0, types);
+    vstore4(closestInside, 0, insides);
+
+    // The polyhedron test is already vectorized over the faces, so only the
+    // culling is shared by the packet.
+    for(int i = 0; i < NumPolyhedrons; ++i) {
+        if(polyhedrons[i].bounded && frustumCullsBox(frustum,
+                    polyhedrons[i].boundsMin, polyhedrons[i].boundsMax))
+            continue;
+
+        for(int lane = 0; lane < PacketSize; ++lane) {
+            float4 normal;
+            float t = polyhedronIntersection(i, origin, dirs[lane], FLT_MAX,
+                    &normal);
+
+            if(t > FLT_EPSILON && t < ts[lane]) {
+                ts[lane] = t;
+                ids[lane] = i;
+                types[lane] = PolyhedronIntersection;
+                insides[lane] = 0;
+                normals[lane] = normal;
+            }
+        }
+    }
+
+    for(int lane = 0; lane < PacketSize; ++lane) {
+        Hit *hit = &hits[lane];
+
+        hit->type = (IntersectionType) types[lane];
+        if(hit->type == NoIntersection)
+            continue;
+
+        hit->id = ids[lane];
+        hit->position = origin + ts[lane] * dirs[lane];
+        hit->inside = insides[lane] != 0;
+
+        if(hit->type == SphereIntersection) {
+            hit->normal = normalize(hit->position - spheres[hit->id].center);
+            if(hit->inside) // Invert the normal.
+                hit->normal *= -1.0f;
+        }
+        else if(hit->type == PlaneIntersection) {
+            hit->normal = planeNormal(planes[hit->id].plane, dirs[lane]);
+        }
+        else if(hit->type == QuadIntersection) {
+            hit->normal = planeNormal(quads[hit->id].plane, dirs[lane]);
+        }
+        else {
+            hit->normal = normals[lane];
+        }
+    }
+}
+
+#endif // !PACKET_CL
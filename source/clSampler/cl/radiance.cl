@@ -28,23 +28,67 @@
 #include "random.cl"
 #include "recursion.cl"
 #include "brdf.cl"
+#include "counters.cl"
+#include "aov.cl"
+#include "guide.cl"
+#include "lights.cl"
+#include "spectrum.cl"
+
+/// Lowest probability of continuing a path given by its throughput.
+#define MinRouletteProbability (0.05f)
 
 /**
  * Calculates the color of the ray.
  * @param origin Ray origin.
  * @param dir Ray direction.
+ * @param firstHit Intersection of the ray, if it was already traced. Set to 0
+ * to trace it.
  * @param seed Random seed.
- * @return Color that was sampled.
+ * @param counters Statistics of the work item.
+ * @param aovs AOVs of the work item, where the first hit of this ray is
+ * recorded.
+ * @param guide Path guiding data of the work item.
+ * @param wavelengths Wavelengths of the path, from sampleWavelengths().
+ * @param time Time of the path in the shutter interval, from sampleShutter().
+ * @return Color that was sampled, as the samples at the wavelengths with
+ * Spectral.
  */
-float4 radiance(float4 *origin, float4 *dir, uint2 *seed);
+float4 radiance(float4 *origin, float4 *dir, Hit *firstHit, uint2 *seed,
+        Counters *counters, Aovs *aovs, Guide *guide, float4 wavelengths,
+        float time);
 
 /**
  * Stages of the radiance recursion.
  */
-void radianceStage0(Stack *stack, RetStack *retStack, State *t, uint2 *seed);
-void radianceStage1(Stack *stack, RetStack *retStack, State *t, uint2 *seed);
+void radianceStage0(Stack *stack, RetStack *retStack, State *t, Hit *hit,
+        uint2 *seed, Counters *counters, Aovs *aovs, Guide *guide,
+        float4 wavelengths, float time);
+void radianceStage1(Stack *stack, RetStack *retStack, State *t, uint2 *seed,
+        Guide *guide);
+
+/**
+ * Returns the probability of continuing a path in the Russian roulette,
+ * which is 1 before MinDepth bounces and 0 after MaxDepth bounces. Otherwise
+ * it is RouletteProbability, if defined, or the spectrumLuminance() of the
+ * throughput of the path, so that paths that can only add little light stop
+ * early and bright ones continue.
+ * @param throughput Product of the factors of the bounces of the path.
+ * @param depth Number of bounces of the path.
+ */
+float rouletteProbability(float4 throughput, int depth);
+
+/**
+ * Records the first hit of a path in the AOVs. Emitters and misses have a
+ * white albedo.
+ * @param origin Origin of the ray.
+ * @param time Time of the ray, where the textures of moving objects are.
+ */
+void recordFirstHit(Aovs *aovs, IntersectionType iType, int id,
+        float4 position, float4 normal, float4 origin, float time);
 
-float4 radiance(float4 *argOrigin, float4 *argDir, uint2 *seed) {
+float4 radiance(float4 *argOrigin, float4 *argDir, Hit *firstHit,
+        uint2 *seed, Counters *counters, Aovs *aovs, Guide *guide,
+        float4 wavelengths, float time) {
     Stack stack; // Recursion stack.
     RetStack retStack; // Return stack.
     State *t; // Top state.
@@ -53,7 +97,8 @@ float4 radiance(float4 *argOrigin, float4 *argDir, uint2 *seed) {
     retStackInit(&retStack);
 
     t = stackTop(&stack);
-    initState(t, *argOrigin, *argDir, NoIntersection, -1);
+    initState(t, *argOrigin, *argDir, (float4) (1.0f), false, false,
+            NoIntersection, -1);
     stackPush(&stack);
 
     // Simulated recursion.
@@ -61,8 +106,15 @@ float4 radiance(float4 *argOrigin, float4 *argDir, uint2 *seed) {
         stackPop(&stack);
         t = stackTop(&stack);
         switch(t->stage) {
-            case 0: radianceStage0(&stack, &retStack, t, seed); break;
-            case 1: radianceStage1(&stack, &retStack, t, seed); break;
+            case 0:
+                radianceStage0(&stack, &retStack, t, firstHit, seed,
+                        counters, aovs, guide, wavelengths, time);
+                firstHit = 0; // Only valid for the first ray.
+                aovs = 0;
+                break;
+            case 1:
+                radianceStage1(&stack, &retStack, t, seed, guide);
+                break;
         }
     }
 
@@ -71,35 +123,70 @@ float4 radiance(float4 *argOrigin, float4 *argDir, uint2 *seed) {
     return *retStackTop(&retStack);
 }
 
-void radianceStage0(Stack *stack, RetStack *retStack, State *t, uint2 *seed) {
+void radianceStage0(Stack *stack, RetStack *retStack, State *t, Hit *hit,
+        uint2 *seed, Counters *counters, Aovs *aovs, Guide *guide,
+        float4 wavelengths, float time) {
     float4 intersection, normal;
     IntersectionType iType;
     int id;
     bool inside;
 
     // See if the ray intersects anything.
-    iType = trace(t->origin, t->dir, t->exclType, t->exclID, 0, &id,
-            &intersection, &normal, &inside);
+    if(hit) {
+        iType = hit->type;
+        id = hit->id;
+        intersection = hit->position;
+        normal = hit->normal;
+        inside = hit->inside;
+    }
+    else {
+        iType = trace(t->origin, t->dir, t->exclType, t->exclID, 0, &id,
+                &intersection, &normal, &inside, time);
+        ++counters->rays;
+    }
+
+    // The first hit is recorded in the AOVs, which also guide the denoiser.
+    if(aovs)
+        recordFirstHit(aovs, iType, id, intersection, normal, t->origin,
+                time);
 
     if(iType == NoIntersection) { // Don't need to do anything anymore.
         float4 *r = retStackTop(retStack);
-        *r = (float4) (0.0f, 0.0f, 0.0f, 1.0f);
+        *r = (float4) (0.0f);
         retStackPush(retStack);
         return;
     }
 
-    // If is emitter, return the emitted color.
+    // If is emitter, return the emitted color, unless it was already sampled
+    // at the last bounce.
     // This is a simplification. I'm assuming that an emitter doesn't reflect
     // light.
     if(iType == SphereIntersection && sphereEmits(id)) {
         float4 *r = retStackTop(retStack);
-        *r = spheres[id].emission;
+        *r = t->lightsSampled ? (float4) (0.0f)
+            : spectrumSample(spheres[id].emission, wavelengths);
+        retStackPush(retStack);
+        return;
+    }
+
+#ifdef PrimaryRaysOnly
+    // Don't bounce, just return the albedo at the first hit.
+    {
+        int matID, texID;
+        TextureType texType;
+
+        getObjectIDs(iType, id, &matID, &texType, &texID);
+        float4 *r = retStackTop(retStack);
+        *r = spectrumSample(getTextureColor(texType, texID,
+                    objectRestPosition(iType, id, intersection, time)),
+                wavelengths);
         retStackPush(retStack);
         return;
     }
+#endif
 
-    // Russian roulette.
-    float rr = 0.7;
+    // Russian roulette. Each state below this one on the stack is a bounce.
+    float rr = rouletteProbability(t->throughput, stack->top);
     if(randf(seed) < rr) { // Trace ray.
         float4 newDir, color, f;
         float pdf;
@@ -107,17 +194,42 @@ void radianceStage0(Stack *stack, RetStack *retStack, State *t, uint2 *seed) {
         TextureType texType;
 
         getObjectIDs(iType, id, &matID, &texType, &texID);
-        color = getTextureColor(texType, texID, intersection);
-        if(brdf(t->dir, normal, color, &materials[matID], inside, seed,
-                    &newDir, &f, &pdf)) {
+        color = spectrumSample(getTextureColor(texType, texID,
+                    objectRestPosition(iType, id, intersection, time)),
+                wavelengths);
+        Lobe lobe = brdfChooseLobe(matID, randf(seed));
+
+        // The emitters are sampled at the diffuse bounces.
+        bool lightsSampled = false;
+        t->direct = (float4) (0.0f);
+#ifdef LightSampling
+        if(lobe == DiffuseLobe) {
+            t->direct = sampleLights(intersection, normal, color, matID,
+                    iType, id, seed, counters, wavelengths, time) / rr;
+            lightsSampled = true;
+        }
+#endif
+
+        // The wavelengths of the path split at a dispersive transmission.
+        bool dispersive = lobe == TransmissionLobe
+            && materialDisperses(matID);
+        bool scattered = dispersive
+            ? brdfDispersion(t->dir, normal, color, matID, inside,
+                    wavelengths.x, t->dispersed, &newDir, &f, &pdf)
+            : guidedBrdf(guide, lobe, intersection, t->dir, normal, color,
+                    matID, inside, seed, &newDir, &f, &pdf, &t->guideBin);
+        if(scattered) {
             t->factor = f / (pdf * rr);
+            t->guidePdf = pdf;
+            ++counters->bounces;
 
             t->stage = 1;
             stackPush(stack); // Set this for when the recursion returns.
 
             // Push new recursion.
             State *newT = stackTop(stack);
-            initState(newT, intersection, newDir, iType, id);
+            initState(newT, intersection, newDir, t->throughput * t->factor,
+                    lightsSampled, t->dispersed || dispersive, iType, id);
             stackPush(stack); // New iteration.
         }
         else { // Resample.
@@ -126,16 +238,62 @@ void radianceStage0(Stack *stack, RetStack *retStack, State *t, uint2 *seed) {
         }
     }
     else { // Return no contribution.
+        ++counters->terminations;
         float4 *r = retStackTop(retStack);
-        *r = (float4) (0.0f, 0.0f, 0.0f, 1.0f);
+        *r = (float4) (0.0f);
         retStackPush(retStack);
     }
 }
 
-void radianceStage1(Stack *stack, RetStack *retStack, State *t, uint2 *seed) {
+float rouletteProbability(float4 throughput, int depth) {
+    if(depth >= MaxDepth)
+        return 0.0f;
+    if(depth < MinDepth)
+        return 1.0f;
+
+#ifdef RouletteProbability
+    return RouletteProbability;
+#else
+    // The probability is kept above a minimum, so that the factor of the
+    // paths that survive stays bounded.
+    float luminance = spectrumLuminance(throughput);
+    return clamp(luminance, MinRouletteProbability, 1.0f);
+#endif
+}
+
+void recordFirstHit(Aovs *aovs, IntersectionType iType, int id,
+        float4 position, float4 normal, float4 origin, float time) {
+    if(iType == NoIntersection) {
+        aovsRecordHit(aovs, (float4) (1.0f), (float4) (0.0f), MissDepth, -1,
+                -1);
+        return;
+    }
+
+    float depth = length((position - origin).xyz);
+    int objectID = getObjectIndex(iType, id);
+    if(iType == SphereIntersection && sphereEmits(id)) {
+        aovsRecordHit(aovs, (float4) (1.0f), normal, depth, objectID, -1);
+    }
+    else {
+        int matID, texID;
+        TextureType texType;
+
+        getObjectIDs(iType, id, &matID, &texType, &texID);
+        float4 albedo = getTextureColor(texType, texID,
+                objectRestPosition(iType, id, position, time));
+        aovsRecordHit(aovs, albedo, normal, depth, objectID, matID);
+    }
+}
+
+void radianceStage1(Stack *stack, RetStack *retStack, State *t, uint2 *seed,
+        Guide *guide) {
     retStackPop(retStack);
     float4 *r = retStackTop(retStack);
-    *r *= t->factor; // Calculate the proper light.
+
+    // The light returned is the light arriving from the bounce direction.
+    if(t->guideBin >= 0)
+        guideRecord(guide, t->guideBin, *r, t->guidePdf);
+    *r = *r * t->factor + t->direct; // Calculate the proper light.
     retStackPush(retStack); // Return.
 }
 
@@ -23,6 +23,8 @@
 #ifndef RANDOM_CL
 #define RANDOM_CL
 
+#include "fastmath.cl"
+
 /**
  * Uniform random number generator.
  * Returns a random uint.
@@ -42,7 +44,9 @@ uint randn(uint n, uint2 *state);
 float randf(uint2 *state);
 
 /**
- * Generates a random value in a circle.
+ * Generates a random value in a circle. The square of two uniform values is
+ * mapped to the disk by concentric rings (Shirley and Chiu), which keeps the
+ * strata of the square and needs no rejection loop.
  * @param center Center of the circle.
  * @param right Right vector of the circle.
  * @param up Up vector of the circle.
@@ -79,30 +83,41 @@ float randf(uint2 *state) {
 
 float4 randcircle(float4 center, float4 right, float4 up, float radius,
         uint2 *state) {
-    float4 point;
-
-    // TODO: this is rejection sampling. Should implement something faster.
-    do {
-        point = center + (randf(state) * 2 * radius - radius) * right
-            + (randf(state) * 2 * radius - radius) * up;
-    } while(fabs(distance(center, point)) > radius);
-
-    return point;
+    float a = randf(state) * 2.0f - 1.0f;
+    float b = randf(state) * 2.0f - 1.0f;
+    if(a == 0.0f && b == 0.0f)
+        return center;
+
+    // The larger coordinate is the ring and the other the angle inside its
+    // quadrant, given in turns for mathSinCos2Pi().
+    float r, turns;
+    if(fabs(a) > fabs(b)) {
+        r = a;
+        turns = 0.125f * b / a;
+    }
+    else {
+        r = b;
+        turns = 0.25f - 0.125f * a / b;
+    }
+
+    float c;
+    float s = mathSinCos2Pi(turns, &c);
+    return center + radius * r * (c * right + s * up);
 }
 
 float4 randhemisphere(uint2 *state) {
     float u1 = randf(state), u2 = randf(state);
-    float s = sqrt(1.0f - pow(u1, 2));
-    float u2_2p = 2 * M_PI * u2;
+    float s = mathSqrt(1.0f - u1 * u1);
+    float cosPhi, sinPhi = mathSinCos2Pi(u2, &cosPhi);
 
     float4 p = (float4) (
-        s * cos(u2_2p),
-        s * sin(u2_2p),
+        s * cosPhi,
+        s * sinPhi,
         u2,
         0.0f
     );
 
-    return normalize(p);
+    return mathNormalize(p);
 }
 
 #endif // !RANDOM_CL
@@ -25,12 +25,19 @@
 
 #include "intersection.cl"
 
-#define STACK_SIZE (200)
+// Each bounce adds a state to the stack, and paths stop at MaxDepth bounces.
+#define STACK_SIZE (MaxDepth + 1)
 
 /// Recursion state.
 typedef struct State {
     float4 origin, dir;
     float4 factor;
+    float4 throughput;  /// Product of the factors of the previous bounces.
+    int guideBin;       /// Path guiding counter of the bounce, or -1.
+    float guidePdf;     /// Pdf of the direction of the bounce.
+    float4 direct;      /// Light of the emitters sampled at the bounce.
+    bool lightsSampled; /// If the emitters were sampled at the last bounce.
+    bool dispersed;     /// If only the hero wavelength is left in the path.
     int exclID, stage;
     IntersectionType exclType;
 } State;
@@ -53,7 +60,8 @@ State *stackTop(Stack *stack);
 void stackPush(Stack *stack);
 void stackPop(Stack *stack);
 bool stackEmpty(Stack *stack);
-void initState(State *t, float4 origin, float4 dir, IntersectionType exclType,
+void initState(State *t, float4 origin, float4 dir, float4 throughput,
+        bool lightsSampled, bool dispersed, IntersectionType exclType,
         int exclID);
 void retStackInit(RetStack *retStack);
 float4 *retStackTop(RetStack *retStack);
@@ -80,10 +88,15 @@ bool stackEmpty(Stack *stack) {
     return stack->top == 0;
 }
 
-void initState(State *t, float4 origin, float4 dir, IntersectionType exclType,
+void initState(State *t, float4 origin, float4 dir, float4 throughput,
+        bool lightsSampled, bool dispersed, IntersectionType exclType,
         int exclID) {
     t->origin = origin;
     t->dir = dir;
+    t->throughput = throughput;
+    t->guideBin = -1;
+    t->lightsSampled = lightsSampled;
+    t->dispersed = dispersed;
     t->exclType = exclType;
     t->exclID = exclID;
     t->stage = 0;
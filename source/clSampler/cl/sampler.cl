@@ -20,48 +20,500 @@
  * THE SOFTWARE.
  */
 
+#include "accum.cl"
+#include "camera.cl"
+#include "counters.cl"
 #include "radiance.cl"
 #include "random.cl"
+#include "tonemap.cl"
+#ifdef PacketTracing
+#include "packet.cl"
+#endif
+#ifdef RaySorting
+#include "sort.cl"
+#endif
+#ifdef Denoise
+#include "denoise.cl"
+#endif
+#ifdef Bidirectional
+#include "bidir.cl"
+#endif
+#ifdef Sppm
+#include "sppm.cl"
+#endif
+
+/**
+ * Adds the color of this pass to the HDR accumulator of the pixel. The
+ * accumulator is converted to the output image by tonemap().
+ * @param width Width of the image.
+ * @param pass Index of the pass. The accumulator is reset on pass 0.
+ */
+void accumulate(__global AccumPixel *accum, int2 coord, int width,
+        float4 color, uint pass);
+
+void accumulate(__global AccumPixel *accum, int2 coord, int width,
+        float4 color, uint pass) {
+    accumAdd(accum, coord.y * width + coord.x, color, pass);
+}
 
 /**
  * Samples a ray from origin through direction.
+ * @param camera Viewpoint of the render.
+ * @param size Width and height of the image.
+ * @param globalCounters Global statistics of the kernel, as pairs of low and
+ * high words. Only updated if KernelCounters is defined.
+ * @param accum HDR accumulator of the passes, in the format selected by the
+ * Accum* defines.
+ * @param pass Index of the progressive pass.
+ * @param aovFB AOV framebuffer, with a plane per channel of the enabled
+ * AOVs. Not used if no AOV is enabled.
+ * @param guideTrain Path guiding training counters. Not used if PathGuiding
+ * isn't defined.
+ * @param guideCdf Path guiding distributions of the cells. Not used if
+ * PathGuiding isn't defined.
+ * @param guidePhase GuidePhase of the pass.
  */
-__kernel void sample(__constant float4 *camera, __constant float4 *topLeft,
-        __constant float4 *up, __constant float4 *right, uint2 seed,
-        __write_only image2d_t out)
+__kernel void sample(Camera camera, uint2 seed, int2 size,
+        __global uint *globalCounters, __global AccumPixel *accum,
+        uint pass, __global AovValue *aovFB, __global uint *guideTrain,
+        __global const float *guideCdf, uint guidePhase)
 {
     int2 coord = (int2) (get_global_id(0), get_global_id(1));
-    float4 origin = *camera;
+    float4 origin = camera.origin;
+    float4 topLeft = camera.topLeft, up = camera.up, right = camera.right;
     float4 color = (float4) (0.0f);
+    Counters counters;
+    Aovs aovs;
+    Guide guide;
+
+    countersInit(&counters);
+    aovsInit(&aovs);
+    guideInit(&guide, guideTrain, guideCdf, origin, guidePhase);
 
     // Init the PRNG seed.
     seed.x += get_global_size(0) * coord.y + coord.x;
     seed.y += get_global_size(0) * coord.y + coord.x;
 
     // First get the pixel position.
-    float4 pixelPos = *topLeft + (*right * (coord.x * PixelWidth))
-        - (*up * (coord.y * PixelHeight));
+    float4 pixelPos = topLeft + (right * (coord.x * camera.pixelWidth))
+        - (up * (coord.y * camera.pixelHeight));
 
-    float hPart = PixelHeight / AALevel;
-    float wPart = PixelWidth / AALevel;
+    float hPart = camera.pixelHeight / AALevel;
+    float wPart = camera.pixelWidth / AALevel;
     for(int i = 0; i < AALevel; ++i) {
         for(int j = 0; j < AALevel; ++j) {
             for(int k = 0; k < NumSamples; ++k) {
                 // Get  the position of the subpixel.
-                float4 point = pixelPos + *up * i * hPart + *right * j * wPart;
+                float4 point = pixelPos + up * i * hPart + right * j * wPart;
 
                 // Get the position at the inside of the subpixel.
-                point += *up * (randf(&seed) * hPart)
-                    + *right * (randf(&seed) * wPart);
+                point += up * (randf(&seed) * hPart)
+                    + right * (randf(&seed) * wPart);
+
+                // A thin lens sends the ray from a point of the aperture
+                // through the point of the focal plane behind the subpixel.
+                float4 rayOrigin = origin;
+#ifdef ThinLens
+                point = origin + (point - origin) * camera.focusScale;
+                rayOrigin = randcircle(origin, right, up, camera.lensRadius,
+                        &seed);
+#endif
 
                 // Now make it a direction vector.
-                float4 dir = normalize(point - origin);
+                float4 dir = normalize(point - rayOrigin);
 
-                color += radiance(&origin, &dir, &seed);
+                float time = sampleShutter(&seed);
+                float4 wavelengths = sampleWavelengths(&seed);
+                float4 sample = radiance(&rayOrigin, &dir, 0, &seed,
+                        &counters, &aovs, &guide, wavelengths, time);
+                sample = spectrumToRgb(sample, wavelengths);
+                aovsRecordPath(&aovs, sample);
+                color += sample;
             }
         }
     }
     color /= AALevel * AALevel * NumSamples;
 
-    write_imagef(out, coord, color);
+    accumulate(accum, coord, size.x, color, pass);
+    aovsFlush(&aovs, aovFB, coord, size, AALevel * AALevel * NumSamples,
+            pass);
+    countersFlush(&counters, globalCounters);
+}
+
+#ifdef PacketTracing
+/**
+ * Same as sample(), but each work item samples a block of 2x2 pixels, tracing
+ * the primary rays of the 4 pixels together as a packet.
+ */
+__kernel void samplePackets(Camera camera, uint2 seed, int2 size,
+        __global uint *globalCounters, __global AccumPixel *accum,
+        uint pass, __global AovValue *aovFB, __global uint *guideTrain,
+        __global const float *guideCdf, uint guidePhase)
+{
+    int2 block = 2 * (int2) (get_global_id(0), get_global_id(1));
+    float4 origin = camera.origin;
+    float4 topLeft = camera.topLeft, up = camera.up, right = camera.right;
+    float4 colors[PacketSize];
+    float4 dirs[PacketSize];
+    Hit hits[PacketSize];
+    Counters counters;
+    Aovs aovs[PacketSize];
+    Guide guide;
+
+    countersInit(&counters);
+    guideInit(&guide, guideTrain, guideCdf, origin, guidePhase);
+
+    for(int lane = 0; lane < PacketSize; ++lane) {
+        colors[lane] = (float4) (0.0f);
+        aovsInit(&aovs[lane]);
+    }
+
+    // Init the PRNG seed.
+    seed.x += get_global_size(0) * get_global_id(1) + get_global_id(0);
+    seed.y += get_global_size(0) * get_global_id(1) + get_global_id(0);
+
+    // The subpixels of pixel (x, y) go from row y up to row y - 1.
+    float4 top = up * ((1 - block.y) * camera.pixelHeight);
+    float4 bottom = up * (-(block.y + 1) * camera.pixelHeight);
+    float4 left = right * (block.x * camera.pixelWidth);
+    float4 rightSide = right * ((block.x + 2) * camera.pixelWidth);
+    Frustum frustum = makeFrustum(origin, topLeft + left + top,
+            topLeft + rightSide + top, topLeft + rightSide + bottom,
+            topLeft + left + bottom);
+
+    float hPart = camera.pixelHeight / AALevel;
+    float wPart = camera.pixelWidth / AALevel;
+    for(int i = 0; i < AALevel; ++i) {
+        for(int j = 0; j < AALevel; ++j) {
+            for(int k = 0; k < NumSamples; ++k) {
+                for(int lane = 0; lane < PacketSize; ++lane) {
+                    int2 coord = block + (int2) (lane % 2, lane / 2);
+                    float4 point = topLeft
+                        + (right * (coord.x * camera.pixelWidth))
+                        - (up * (coord.y * camera.pixelHeight))
+                        + up * i * hPart + right * j * wPart;
+
+                    point += up * (randf(&seed) * hPart)
+                        + right * (randf(&seed) * wPart);
+
+                    dirs[lane] = normalize(point - origin);
+                }
+
+                tracePacket(&frustum, dirs, hits);
+                counters.rays += PacketSize;
+
+                // Continue each path on its own after the first hit, in RGB
+                // as -packet can't be used with -spectral.
+                for(int lane = 0; lane < PacketSize; ++lane) {
+                    float4 sample = radiance(&origin, &dirs[lane],
+                            &hits[lane], &seed, &counters, &aovs[lane],
+                            &guide, (float4) (0.0f), 0.0f);
+                    aovsRecordPath(&aovs[lane], sample);
+                    colors[lane] += sample;
+                }
+            }
+        }
+    }
+
+    for(int lane = 0; lane < PacketSize; ++lane) {
+        int2 coord = block + (int2) (lane % 2, lane / 2);
+        if(coord.x < size.x && coord.y < size.y) {
+            accumulate(accum, coord, size.x,
+                    colors[lane] / (AALevel * AALevel * NumSamples), pass);
+            aovsFlush(&aovs[lane], aovFB, coord, size,
+                    AALevel * AALevel * NumSamples, pass);
+        }
+    }
+    countersFlush(&counters, globalCounters);
+}
+#endif
+
+#ifdef RaySorting
+/**
+ * Same as sample(), but the paths of the work group advance one bounce at a
+ * time and are sorted by material, lobe and direction between the trace and
+ * the shading, so neighbouring work items take the same branches. Paths are
+ * exchanged between work items, so every work item adds the contribution of
+ * the path it holds to the pixel that owns it.
+ * @param globalCounters Global statistics of the kernel, as in sample().
+ * @param accum HDR sum of the colors of all the passes, as in sample().
+ * @param pass Index of the progressive pass.
+ * @param aovFB AOV framebuffer, as in sample().
+ * @param guideTrain Not used, as path guiding doesn't support sorting.
+ * @param guideCdf Not used.
+ * @param guidePhase Not used.
+ * @param stats Counters of the lane utilization, as active lanes, lanes used
+ * without sorting and lanes used after sorting. Measured on the first sample.
+ */
+__kernel __attribute__((reqd_work_group_size(SortGroupWidth, SortGroupWidth, 1)))
+void sampleSorted(Camera camera, uint2 seed, int2 size,
+        __global uint *globalCounters, __global AccumPixel *accum,
+        uint pass, __global AovValue *aovFB, __global uint *guideTrain,
+        __global const float *guideCdf, uint guidePhase, __global uint *stats)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    int lid = get_local_id(1) * SortGroupWidth + get_local_id(0);
+    float4 origin = camera.origin;
+    float4 topLeft = camera.topLeft, up = camera.up, right = camera.right;
+    Counters counters;
+    Aovs aovs;
+
+    countersInit(&counters);
+    aovsInit(&aovs);
+
+    // Path state exchanged when sorting.
+    __local float4 pathOrigins[SortGroupSize], pathDirs[SortGroupSize];
+    __local float4 pathWeights[SortGroupSize];
+    __local float pathRoulettes[SortGroupSize];
+    __local int pathDepths[SortGroupSize];
+    __local int pathOwners[SortGroupSize], pathExclIDs[SortGroupSize];
+    __local int pathExclTypes[SortGroupSize];
+    __local Hit pathHits[SortGroupSize];
+    __local int pathMaterials[SortGroupSize], pathLobes[SortGroupSize];
+
+    __local uint keys[SortGroupSize];
+    __local int indices[SortGroupSize], scan[SortGroupSize];
+    __local float4 colors[SortGroupSize];
+    __local int numAlive;
+
+    // Init the PRNG seed.
+    seed.x += get_global_size(0) * coord.y + coord.x;
+    seed.y += get_global_size(0) * coord.y + coord.x;
+
+    colors[lid] = (float4) (0.0f);
+    if(lid == 0)
+        numAlive = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // First get the pixel position.
+    float4 pixelPos = topLeft + (right * (coord.x * camera.pixelWidth))
+        - (up * (coord.y * camera.pixelHeight));
+
+    float hPart = camera.pixelHeight / AALevel;
+    float wPart = camera.pixelWidth / AALevel;
+    for(int s = 0; s < AALevel * AALevel * NumSamples; ++s) {
+        int i = s / (AALevel * NumSamples);
+        int j = (s / NumSamples) % AALevel;
+
+        // The colors were last written before a barrier of the previous
+        // sample, so the path of this sample is what it adds to the pixel.
+        float4 sampleStart = colors[lid];
+
+        // Start a new path from this work item's pixel.
+        float4 point = pixelPos + up * i * hPart + right * j * wPart;
+        point += up * (randf(&seed) * hPart)
+            + right * (randf(&seed) * wPart);
+
+        float4 pathOrigin = origin, pathDir = normalize(point - origin);
+        float4 pathWeight = (float4) (1.0f);
+        float rr = 1.0f;
+        int depth = 0, owner = lid, exclID = -1;
+        IntersectionType exclType = NoIntersection;
+        bool alive = true;
+
+        for(int bounce = 0; bounce < STACK_SIZE; ++bounce) {
+            Hit hit;
+            int matID = 0, texID;
+            TextureType texType;
+            Lobe lobe = NoLobe;
+
+            // Extend the path.
+            if(alive) {
+                hit.type = trace(pathOrigin, pathDir, exclType, exclID, 0,
+                        &hit.id, &hit.position, &hit.normal, &hit.inside,
+                        0.0f);
+                ++counters.rays;
+
+                // Paths are only exchanged after the first hit, so it is
+                // still in the work item of its pixel.
+                if(bounce == 0)
+                    recordFirstHit(&aovs, hit.type, hit.id, hit.position,
+                            hit.normal, pathOrigin, 0.0f);
+
+                if(hit.type == NoIntersection) {
+                    alive = false;
+                }
+                else if(hit.type == SphereIntersection && sphereEmits(hit.id)) {
+                    colors[owner] += pathWeight * spheres[hit.id].emission;
+                    alive = false;
+                }
+                else {
+                    getObjectIDs(hit.type, hit.id, &matID, &texType, &texID);
+#ifdef PrimaryRaysOnly
+                    colors[owner] += getTextureColor(texType, texID,
+                            hit.position);
+                    alive = false;
+#else
+                    rr = rouletteProbability(pathWeight, depth);
+                    if(randf(&seed) < rr) { // Russian roulette.
+                        lobe = brdfChooseLobe(matID, randf(&seed));
+                    }
+                    else {
+                        alive = false;
+                        ++counters.terminations;
+                    }
+#endif
+                }
+            }
+
+            // Sort the paths by the branches they will take.
+            keys[lid] = alive ? sortKey(matID, lobe, pathDir) : SortDeadKey;
+            pathOrigins[lid] = pathOrigin;
+            pathDirs[lid] = pathDir;
+            pathWeights[lid] = pathWeight;
+            pathRoulettes[lid] = rr;
+            pathDepths[lid] = depth;
+            pathOwners[lid] = owner;
+            pathExclIDs[lid] = exclID;
+            pathExclTypes[lid] = exclType;
+            pathHits[lid] = hit;
+            pathMaterials[lid] = matID;
+            pathLobes[lid] = lobe;
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            if(s == 0)
+                countLaneUtilization(keys, &stats[0], &stats[1]);
+            sortPaths(keys, indices, scan);
+            if(s == 0)
+                countLaneUtilization(keys, &stats[2], &stats[3]);
+
+            // Take the path that was sorted to this work item.
+            int src = indices[lid];
+            alive = keys[lid] != SortDeadKey;
+            pathOrigin = pathOrigins[src];
+            pathDir = pathDirs[src];
+            pathWeight = pathWeights[src];
+            rr = pathRoulettes[src];
+            depth = pathDepths[src];
+            owner = pathOwners[src];
+            exclID = pathExclIDs[src];
+            exclType = (IntersectionType) pathExclTypes[src];
+            hit = pathHits[src];
+            matID = pathMaterials[src];
+            lobe = (Lobe) pathLobes[src];
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            // Shade the hit and generate the next ray. If the material has no
+            // contribution on the chosen lobe the ray is traced again.
+            if(alive && lobe != NoLobe) {
+                float4 newDir, f, color;
+                float pdf;
+
+                getObjectIDs(hit.type, hit.id, &matID, &texType, &texID);
+                color = getTextureColor(texType, texID, hit.position);
+                if(brdfSampleLobe(lobe, pathDir, hit.normal, color, matID,
+                            hit.inside, &seed, &newDir, &f, &pdf)) {
+                    pathWeight *= f / (pdf * rr);
+                    pathOrigin = hit.position;
+                    pathDir = newDir;
+                    exclType = hit.type;
+                    exclID = hit.id;
+                    ++depth;
+                    ++counters.bounces;
+                }
+            }
+
+            // Stop when all the paths of the group are done.
+            if(alive)
+                atomic_inc(&numAlive);
+            barrier(CLK_LOCAL_MEM_FENCE);
+            int groupAlive = numAlive;
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if(lid == 0)
+                numAlive = 0;
+            if(!groupAlive)
+                break;
+        }
+
+        aovsRecordPath(&aovs, colors[lid] - sampleStart);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if(coord.x < size.x && coord.y < size.y) {
+        accumulate(accum, coord, size.x,
+                colors[lid] / (AALevel * AALevel * NumSamples), pass);
+        aovsFlush(&aovs, aovFB, coord, size, AALevel * AALevel * NumSamples,
+                pass);
+    }
+    countersFlush(&counters, globalCounters);
+}
+#endif
+
+#ifdef Bidirectional
+/**
+ * Same as sample(), but with bidirectional path tracing (see bidir.cl). The
+ * light tracing of the paths reaches any pixel, so the colors are summed on
+ * the film and added to the accumulator by resolveFilm() after the pass.
+ * The variance AOV only sees the strategies that end on the camera subpath.
+ * @param guideTrain Not used, as path guiding doesn't support it.
+ * @param guideCdf Not used.
+ * @param guidePhase Not used.
+ * @param film Sums of the colors of the pass, as 4 floats per pixel.
+ */
+__kernel void sampleBidirectional(Camera camera, uint2 seed, int2 size,
+        __global uint *globalCounters, __global AccumPixel *accum,
+        uint pass, __global AovValue *aovFB, __global uint *guideTrain,
+        __global const float *guideCdf, uint guidePhase,
+        __global float *film)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    float4 origin = camera.origin;
+    float4 topLeft = camera.topLeft, up = camera.up, right = camera.right;
+    float4 color = (float4) (0.0f);
+    Counters counters;
+    Aovs aovs;
+
+    countersInit(&counters);
+    aovsInit(&aovs);
+
+    // Init the PRNG seed.
+    seed.x += get_global_size(0) * coord.y + coord.x;
+    seed.y += get_global_size(0) * coord.y + coord.x;
+
+    // First get the pixel position.
+    float4 pixelPos = topLeft + (right * (coord.x * camera.pixelWidth))
+        - (up * (coord.y * camera.pixelHeight));
+
+    float hPart = camera.pixelHeight / AALevel;
+    float wPart = camera.pixelWidth / AALevel;
+    for(int i = 0; i < AALevel; ++i) {
+        for(int j = 0; j < AALevel; ++j) {
+            for(int k = 0; k < NumSamples; ++k) {
+                float4 point = pixelPos + up * i * hPart + right * j * wPart;
+                point += up * (randf(&seed) * hPart)
+                    + right * (randf(&seed) * wPart);
+                float4 dir = normalize(point - origin);
+
+                float4 sample = bidirectional(&camera, size, dir, &seed,
+                        &counters, &aovs, film);
+                aovsRecordPath(&aovs, sample);
+                color += sample;
+            }
+        }
+    }
+
+    filmAdd(film, coord, size.x, color);
+    aovsFlush(&aovs, aovFB, coord, size, AALevel * AALevel * NumSamples,
+            pass);
+    countersFlush(&counters, globalCounters);
+}
+
+/**
+ * Adds the film of a pass of sampleBidirectional() to the accumulator and
+ * clears it for the next pass.
+ * @param film Sums of the colors of the pass, as 4 floats per pixel.
+ * @param accum HDR accumulator of the passes, as in sample().
+ * @param size Width and height of the image.
+ * @param pass Index of the progressive pass.
+ */
+__kernel void resolveFilm(__global float *film, __global AccumPixel *accum,
+        int2 size, uint pass)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    int i = coord.y * size.x + coord.x;
+
+    float4 color = vload4(i, film) / (AALevel * AALevel * NumSamples);
+    accumulate(accum, coord, size.x, color, pass);
+    vstore4((float4) (0.0f), i, film);
 }
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SORT_CL
+#define SORT_CL
+
+#include "brdf.cl"
+
+/// Number of work items in a sorting work group.
+#define SortGroupSize (SortGroupWidth * SortGroupWidth)
+
+/// Number of lanes assumed to execute together when measuring utilization.
+#define SortSimdWidth (8)
+
+/// Bits of the sort key: dead flag, material, lobe (3 bits), octant (3 bits).
+#define SortKeyBits (SortMaterialBits + 7)
+
+/// Key of paths that were terminated. Sorted after all the others.
+#define SortDeadKey ((1u << SortKeyBits) - 1)
+
+/**
+ * Returns the sort key of a path that will shade the given lobe of the given
+ * material. Paths with the same key take the same branches when shaded.
+ */
+uint sortKey(int materialID, Lobe lobe, float4 dir);
+
+/**
+ * Sorts the keys of the work group with a stable LSD radix sort. Must be
+ * called by all the work items of the group.
+ * @param keys Keys to sort, one per work item.
+ * @param indices Set to the index of the work item that had each key.
+ * @param scan Scratch space, one per work item.
+ */
+void sortPaths(__local uint *keys, __local int *indices, __local int *scan);
+
+/**
+ * Adds the lane utilization of the keys to the counters. Each group of
+ * SortSimdWidth work items executes every distinct branch with the other lanes
+ * masked, so the useful fraction of the lanes is active / (width * branches).
+ * Must be called by all the work items of the group.
+ * @param keys Keys, in execution order.
+ * @param activeLanes Incremented by the number of paths that are shaded.
+ * @param usedLanes Incremented by the number of lanes spent shading them.
+ */
+void countLaneUtilization(__local uint *keys, __global uint *activeLanes,
+        __global uint *usedLanes);
+
+uint sortKey(int materialID, Lobe lobe, float4 dir) {
+    uint octant = (dir.x < 0.0f ? 1 : 0) | (dir.y < 0.0f ? 2 : 0)
+        | (dir.z < 0.0f ? 4 : 0);
+
+    return ((uint) materialID << 6) | ((uint) lobe << 3) | octant;
+}
+
+void sortPaths(__local uint *keys, __local int *indices, __local int *scan) {
+    int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+
+    indices[lid] = lid;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int bit = 0; bit < SortKeyBits; ++bit) {
+        uint key = keys[lid];
+        int index = indices[lid];
+        int isZero = ((key >> bit) & 1) ? 0 : 1;
+
+        // Inclusive prefix sum of the zeros.
+        scan[lid] = isZero;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for(int offset = 1; offset < SortGroupSize; offset *= 2) {
+            int val = lid >= offset ? scan[lid - offset] : 0;
+            barrier(CLK_LOCAL_MEM_FENCE);
+            scan[lid] += val;
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+
+        // Zeros go first, then the ones, keeping their order.
+        int zeros = scan[SortGroupSize - 1];
+        int dst = isZero ? scan[lid] - 1 : zeros + lid - scan[lid];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        keys[dst] = key;
+        indices[dst] = index;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+void countLaneUtilization(__local uint *keys, __global uint *activeLanes,
+        __global uint *usedLanes) {
+    int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+
+    if(lid % SortSimdWidth == 0) {
+        uint active = 0, branches = 0;
+
+        // The octant doesn't change the branches taken when shading.
+        for(int i = lid; i < lid + SortSimdWidth; ++i) {
+            if(keys[i] == SortDeadKey)
+                continue;
+
+            bool seen = false;
+            for(int j = lid; j < i; ++j)
+                seen |= keys[j] != SortDeadKey && keys[j] >> 3 == keys[i] >> 3;
+
+            ++active;
+            if(!seen)
+                ++branches;
+        }
+
+        if(active) {
+            atomic_add(activeLanes, active);
+            atomic_add(usedLanes, branches * SortSimdWidth);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+#endif // !SORT_CL
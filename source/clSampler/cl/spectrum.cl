@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SPECTRUM_CL
+#define SPECTRUM_CL
+
+#include "random.cl"
+
+/*
+ * Hero wavelength spectral rendering (Wilkie et al. 2014). With Spectral
+ * defined, the 4 lanes of the colors of a path hold its radiance at 4
+ * wavelengths instead of RGB: a hero wavelength, uniform in the visible
+ * range, and 3 more at even offsets from it, wrapped around the range. The
+ * RGB colors of the textures and the emitters are upsampled to the
+ * wavelengths of the path where they are read, and the samples are turned
+ * back into RGB by the CIE matching functions before they are accumulated.
+ * The lanes are the ones of the RGB colors, so a path costs about the same.
+ *
+ * Without Spectral, the functions below leave the colors as RGB.
+ */
+
+/// Visible range of the wavelengths, in nm.
+#define SpectrumMin (380.0f)
+#define SpectrumMax (780.0f)
+
+/// Integral of the CIE Y matching function.
+#define CieYIntegral (106.856895f)
+
+/**
+ * Samples the wavelengths of a path, in nm. The first lane is the hero
+ * wavelength. Returns 0 without Spectral, without using the seed.
+ */
+float4 sampleWavelengths(uint2 *seed);
+
+/**
+ * Upsamples the RGB color to the wavelengths. Each primary is a smooth step
+ * over its part of the spectrum, and the 3 of them sum to 1 at every
+ * wavelength, so gray colors are flat spectra.
+ */
+float4 spectrumSample(float4 rgb, float4 wavelengths);
+
+/// Converts the samples of the path at the wavelengths to linear sRGB.
+float4 spectrumToRgb(float4 samples, float4 wavelengths);
+
+/// Returns the luminance of the color or the average of the samples.
+float spectrumLuminance(float4 color);
+
+/**
+ * Piecewise Gaussian of the fit of the CIE 1931 matching functions by
+ * Wyman et al. (2013), with a deviation on each side of the mean.
+ */
+float4 cieGaussian(float4 wavelengths, float mean, float sigmaLow,
+        float sigmaHigh);
+
+float4 sampleWavelengths(uint2 *seed) {
+#ifdef Spectral
+    float range = SpectrumMax - SpectrumMin;
+    float4 offset = (randf(seed) + (float4) (0.0f, 0.25f, 0.5f, 0.75f))
+        * range;
+    offset = select(offset, offset - range, offset >= range);
+    return SpectrumMin + offset;
+#else
+    return (float4) (0.0f);
+#endif
+}
+
+float4 spectrumSample(float4 rgb, float4 wavelengths) {
+#ifdef Spectral
+    float4 red = smoothstep(560.0f, 600.0f, wavelengths);
+    float4 blue = 1.0f - smoothstep(470.0f, 510.0f, wavelengths);
+    return rgb.x * red + rgb.y * (1.0f - red - blue) + rgb.z * blue;
+#else
+    return rgb;
+#endif
+}
+
+float4 spectrumToRgb(float4 samples, float4 wavelengths) {
+#ifdef Spectral
+    float4 x = 1.056f * cieGaussian(wavelengths, 599.8f, 37.9f, 31.0f)
+        + 0.362f * cieGaussian(wavelengths, 442.0f, 16.0f, 26.7f)
+        - 0.065f * cieGaussian(wavelengths, 501.1f, 20.4f, 26.2f);
+    float4 y = 0.821f * cieGaussian(wavelengths, 568.8f, 46.9f, 40.5f)
+        + 0.286f * cieGaussian(wavelengths, 530.9f, 16.3f, 31.1f);
+    float4 z = 1.217f * cieGaussian(wavelengths, 437.0f, 11.8f, 36.0f)
+        + 0.681f * cieGaussian(wavelengths, 459.0f, 26.0f, 13.8f);
+
+    // Each lane estimates the integral over the range with a uniform
+    // density, so a flat spectrum of 1 has a Y of 1.
+    float scale = (SpectrumMax - SpectrumMin) / (4.0f * CieYIntegral);
+    float3 xyz = (float3) (dot(samples, x), dot(samples, y),
+            dot(samples, z)) * scale;
+
+    // XYZ to linear sRGB, with each row divided by its sum so that a flat
+    // spectrum is white, as the upsampling of white is.
+    float3 rgb = (float3) (
+            dot((float3) (3.2404542f, -1.5371385f, -0.4985314f), xyz),
+            dot((float3) (-0.9692660f, 1.8760108f, 0.0415560f), xyz),
+            dot((float3) (0.0556434f, -0.2040259f, 1.0572252f), xyz));
+    return (float4) (rgb / (float3) (1.2047843f, 0.9483008f, 0.9088427f),
+            0.0f);
+#else
+    return samples;
+#endif
+}
+
+float spectrumLuminance(float4 color) {
+#ifdef Spectral
+    return dot(color, (float4) (0.25f));
+#else
+    return dot(color.xyz, (float3) (0.2126f, 0.7152f, 0.0722f));
+#endif
+}
+
+float4 cieGaussian(float4 wavelengths, float mean, float sigmaLow,
+        float sigmaHigh) {
+    float4 t = (wavelengths - mean) / select((float4) (sigmaHigh),
+            (float4) (sigmaLow), wavelengths < mean);
+    return exp(-0.5f * t * t);
+}
+
+#endif // !SPECTRUM_CL
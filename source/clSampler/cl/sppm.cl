@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SPPM_CL
+#define SPPM_CL
+
+#include "accum.cl"
+#include "aov.cl"
+#include "brdf.cl"
+#include "camera.cl"
+#include "counters.cl"
+#include "intersection.cl"
+#include "lights.cl"
+#include "object.cl"
+#include "radiance.cl"
+#include "random.cl"
+
+/*
+ * Stochastic progressive photon mapping (Hachisuka and Jensen), with the
+ * radius reduction of PBRT. Each pass follows a camera path per pixel
+ * through the specular and transmission lobes to its first diffuse bounce,
+ * the visible point of the pixel, and then traces SppmPhotons photons from
+ * the emitters. The photons that land within the radius of a visible point
+ * add their flux to its pixel, and the radius of the pixel shrinks with
+ * the photons it gathers, so that the estimate converges over the passes.
+ *
+ * The photons find the visible points through a hash grid rebuilt at each
+ * pass by a counting sort of the points by their cell: sppmCount() counts
+ * the points of each cell, sppmScan() turns the counts into the ranges of
+ * the cells and sppmScatter() writes each point to the range of its cell.
+ * The cells are as large as the largest radius, so each photon looks in
+ * the 27 cells around it. The memory doesn't grow with the passes: each
+ * pixel has a single visible point and the grid has SppmGridCells cells.
+ */
+
+/// Fraction of the new photons kept by the radius reduction.
+#define SppmAlpha (2.0f / 3.0f)
+
+/// Initial radius of the pixels, in pixels at their first visible point.
+#define SppmRadiusPixels (2.0f)
+
+/**
+ * State of a pixel, kept over the passes. Must have SppmPixelVectors fields.
+ */
+typedef struct SppmPixel {
+    float4 position; /// Visible point of the pass.
+    float4 normal;   /// Normal of the visible point, toward the camera.
+    float4 beta;     /// Weight of the photons at the visible point, or 0.
+    float4 tau;      /// Flux gathered within the radius so far.
+    float4 direct;   /// Sum of the emission seen by the camera paths.
+    float4 estimate; /// Radiance given to the accumulator at the last pass.
+    float4 stats;    /// Radius and photon count of the pixel.
+} SppmPixel;
+
+/// Cell of the hash grid that holds the position.
+int4 sppmCell(float4 position, float cellSize);
+
+/// Index of the cell in the hash grid, by the hash of Teschner et al.
+uint sppmHash(int4 cell);
+
+/// Whether the pixel has a visible point in this pass.
+bool sppmVisible(__global const SppmPixel *pixel);
+
+/**
+ * Adds the flux of a photon to the visible points within their radius.
+ * @param dir Direction of the photon.
+ * @param beta Flux of the photon.
+ * @param cellSize Size of the cells of the grid.
+ */
+void sppmDeposit(float4 position, float4 dir, float4 beta, float cellSize,
+        __global const SppmPixel *pixels, __global const uint *gridStarts,
+        __global const uint *gridEnds, __global const int *gridEntries,
+        __global float *photonFlux, __global uint *photonCounts);
+
+/**
+ * Finds the visible points of the pass. The arguments up to guidePhase are
+ * those of sample(), so the host sets them the same way.
+ * @param pixels State of the pixels, reset on pass 0.
+ * @param maxRadius Bits of the largest radius of the visible points, which
+ * sizes the cells of the grid. Must be 0 at the start of the pass.
+ */
+__kernel void sppmCamera(Camera camera, uint2 seed, int2 size,
+        __global uint *globalCounters, __global AccumPixel *accum,
+        uint pass, __global AovValue *aovFB, __global uint *guideTrain,
+        __global const float *guideCdf, uint guidePhase,
+        __global SppmPixel *pixels, __global uint *maxRadius)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    int index = coord.y * size.x + coord.x;
+    SppmPixel pixel = pixels[index];
+    Counters counters;
+    Aovs aovs;
+
+    countersInit(&counters);
+    aovsInit(&aovs);
+
+    if(pass == 0) {
+        pixel.tau = pixel.direct = pixel.estimate = (float4) (0.0f);
+        pixel.stats = (float4) (0.0f);
+    }
+    pixel.beta = (float4) (0.0f);
+
+    // Init the PRNG seed.
+    seed.x += get_global_size(0) * coord.y + coord.x;
+    seed.y += get_global_size(0) * coord.y + coord.x;
+
+    // A single jittered ray, since the photons average the pixel anyway.
+    float4 origin = camera.origin;
+    float4 point = camera.topLeft
+        + camera.right * ((coord.x + randf(&seed)) * camera.pixelWidth)
+        - camera.up * ((coord.y - randf(&seed)) * camera.pixelHeight);
+    float4 dir = normalize(point - origin);
+    float pixelAngle = camera.pixelHeight
+        / length((camera.topLeft - origin).xyz);
+
+    float4 beta = (float4) (1.0f), direct = (float4) (0.0f);
+    float distance = 0.0f;
+    IntersectionType exclType = NoIntersection;
+    int exclID = -1;
+    for(int bounce = 0; bounce < MaxDepth; ++bounce) {
+        float4 position, normal;
+        IntersectionType iType;
+        int id;
+        bool inside;
+
+        iType = trace(origin, dir, exclType, exclID, 0, &id, &position,
+                &normal, &inside, 0.0f);
+        ++counters.rays;
+        if(bounce == 0)
+            recordFirstHit(&aovs, iType, id, position, normal, origin,
+                    0.0f);
+        if(iType == NoIntersection)
+            break;
+        distance += length((position - origin).xyz);
+
+        // As in radiance(), the emitters don't reflect.
+        if(iType == SphereIntersection && sphereEmits(id)) {
+            direct += beta * spheres[id].emission;
+            break;
+        }
+
+        int matID, texID;
+        TextureType texType;
+        getObjectIDs(iType, id, &matID, &texType, &texID);
+        float4 albedo = getTextureColor(texType, texID, position);
+
+        // As in radiance(), the bounce is sampled again if the chosen lobe
+        // can't scatter the ray.
+        float4 newDir, f;
+        float pdf, rr;
+        Lobe lobe = NoLobe;
+        bool scattered = false;
+        while(!scattered) {
+            rr = rouletteProbability(beta, bounce);
+            if(randf(&seed) >= rr) {
+                lobe = NoLobe;
+                break;
+            }
+
+            lobe = brdfChooseLobe(matID, randf(&seed));
+            if(lobe == DiffuseLobe)
+                break;
+            scattered = brdfSampleLobe(lobe, dir, normal, albedo, matID,
+                    inside, &seed, &newDir, &f, &pdf);
+        }
+
+        // The diffuse bounce is left to the photons.
+        if(lobe == DiffuseLobe) {
+            pixel.position = position;
+            pixel.normal = normal;
+            pixel.beta = beta * albedo * (materialLobeWeight[matID].x / rr);
+            if(pixel.stats.x == 0.0f)
+                pixel.stats.x = SppmRadiusPixels * pixelAngle * distance;
+            atomic_max(maxRadius, as_uint(pixel.stats.x));
+            break;
+        }
+        if(!scattered) {
+            ++counters.terminations;
+            break;
+        }
+        ++counters.bounces;
+
+        beta *= f / (pdf * rr);
+        origin = position;
+        dir = newDir;
+        exclType = iType;
+        exclID = id;
+    }
+
+    pixel.direct += direct;
+    pixels[index] = pixel;
+
+    aovsRecordPath(&aovs, direct);
+    aovsFlush(&aovs, aovFB, coord, size, 1, pass);
+    countersFlush(&counters, globalCounters);
+}
+
+/**
+ * Counts the visible points of each cell of the grid, with a work item per
+ * pixel.
+ * @param gridCounts Number of points of each cell, 0 at the start.
+ */
+__kernel void sppmCount(__global const SppmPixel *pixels,
+        __global const uint *maxRadius, __global uint *gridCounts)
+{
+    int i = get_global_id(0);
+    if(!sppmVisible(&pixels[i]))
+        return;
+
+    float cellSize = as_float(*maxRadius);
+    atomic_inc(&gridCounts[sppmHash(sppmCell(pixels[i].position, cellSize))]);
+}
+
+/**
+ * Exclusive prefix sum of the counts of the cells, with a single work group.
+ * Each work item sums a chunk of the cells, the sums of the chunks are
+ * scanned in local memory and then each work item writes the offsets of its
+ * chunk.
+ * @param gridCounts Number of points of each cell. Cleared for the next
+ * pass.
+ * @param gridStarts Set to the first entry of each cell.
+ * @param gridEnds Set to the first entry of each cell, which sppmScatter()
+ * moves to the end.
+ */
+__kernel __attribute__((reqd_work_group_size(SppmScanGroupSize, 1, 1)))
+void sppmScan(__global uint *gridCounts, __global uint *gridStarts,
+        __global uint *gridEnds)
+{
+    __local uint sums[SppmScanGroupSize];
+    const int chunk = SppmGridCells / SppmScanGroupSize;
+    int lid = get_local_id(0);
+    int first = lid * chunk;
+
+    uint sum = 0;
+    for(int i = first; i < first + chunk; ++i)
+        sum += gridCounts[i];
+    sums[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // The group is small, so a single work item scans the sums.
+    if(lid == 0) {
+        uint total = 0;
+        for(int i = 0; i < SppmScanGroupSize; ++i) {
+            uint count = sums[i];
+            sums[i] = total;
+            total += count;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    uint start = sums[lid];
+    for(int i = first; i < first + chunk; ++i) {
+        uint count = gridCounts[i];
+        gridStarts[i] = gridEnds[i] = start;
+        gridCounts[i] = 0;
+        start += count;
+    }
+}
+
+/**
+ * Writes each visible point to the range of its cell, with a work item per
+ * pixel. The order of the points inside a cell is arbitrary.
+ * @param gridEntries Set to the indices of the pixels, sorted by cell.
+ */
+__kernel void sppmScatter(__global const SppmPixel *pixels,
+        __global const uint *maxRadius, __global uint *gridEnds,
+        __global int *gridEntries)
+{
+    int i = get_global_id(0);
+    if(!sppmVisible(&pixels[i]))
+        return;
+
+    float cellSize = as_float(*maxRadius);
+    uint cell = sppmHash(sppmCell(pixels[i].position, cellSize));
+    gridEntries[atomic_inc(&gridEnds[cell])] = i;
+}
+
+/**
+ * Traces a photon per work item and adds it to the visible points it lands
+ * near. The photons bounce like the paths of radiance().
+ * @param photonFlux Flux gathered by each pixel in the pass, as 4 floats.
+ * @param photonCounts Photons gathered by each pixel in the pass.
+ */
+__kernel void sppmPhotons(uint2 seed, __global uint *globalCounters,
+        __global const SppmPixel *pixels, __global const uint *maxRadius,
+        __global const uint *gridStarts, __global const uint *gridEnds,
+        __global const int *gridEntries, __global float *photonFlux,
+        __global uint *photonCounts)
+{
+    float cellSize = as_float(*maxRadius);
+    if(NumLights == 0 || cellSize <= 0.0f)
+        return;
+
+    Counters counters;
+    countersInit(&counters);
+
+    // Init the PRNG seed.
+    seed.x += get_global_id(0);
+    seed.y += get_global_id(0);
+
+    // The cosine of the emission cancels with its density.
+    float4 origin, normal;
+    float pdf;
+    int id = sampleEmitterPoint(&seed, &origin, &normal, &pdf);
+    float4 dir = sampleCosine(normal, &seed);
+    float4 beta = spheres[id].emission * (M_PI_F / pdf);
+
+    // The roulette follows the throughput of the bounces, as in radiance().
+    float4 throughput = (float4) (1.0f);
+    IntersectionType exclType = SphereIntersection;
+    int exclID = id;
+    for(int bounce = 0; bounce < MaxDepth; ++bounce) {
+        float4 position;
+        IntersectionType iType;
+        bool inside;
+
+        iType = trace(origin, dir, exclType, exclID, 0, &id, &position,
+                &normal, &inside, 0.0f);
+        ++counters.rays;
+        if(iType == NoIntersection
+                || (iType == SphereIntersection && sphereEmits(id)))
+            break;
+
+        sppmDeposit(position, dir, beta, cellSize, pixels, gridStarts,
+                gridEnds, gridEntries, photonFlux, photonCounts);
+
+        int matID, texID;
+        TextureType texType;
+        getObjectIDs(iType, id, &matID, &texType, &texID);
+        float4 albedo = getTextureColor(texType, texID, position);
+
+        float4 newDir, f;
+        float rr;
+        bool scattered = false;
+        while(!scattered) {
+            rr = rouletteProbability(throughput, bounce);
+            if(randf(&seed) >= rr)
+                break;
+            scattered = brdf(dir, normal, albedo, matID, inside, &seed,
+                    &newDir, &f, &pdf);
+        }
+        if(!scattered) {
+            ++counters.terminations;
+            break;
+        }
+        ++counters.bounces;
+
+        throughput *= f / (pdf * rr);
+        beta *= f / (pdf * rr);
+        origin = position;
+        dir = newDir;
+        exclType = iType;
+        exclID = id;
+    }
+
+    countersFlush(&counters, globalCounters);
+}
+
+/**
+ * Shrinks the radius of each pixel with the photons of the pass and adds the
+ * new estimate of the pixel to the accumulator. The arguments up to pass
+ * match those of resolveFilm().
+ * @param accum HDR accumulator of the passes, as in sample().
+ * @param pass Index of the progressive pass.
+ * @param photonFlux Cleared for the next pass.
+ * @param photonCounts Cleared for the next pass.
+ * @param maxRadius Cleared for the next pass.
+ */
+__kernel void sppmResolve(__global SppmPixel *pixels,
+        __global AccumPixel *accum, int2 size, uint pass,
+        __global float *photonFlux, __global uint *photonCounts,
+        __global uint *maxRadius)
+{
+    int i = get_global_id(1) * size.x + get_global_id(0);
+    SppmPixel pixel = pixels[i];
+
+    uint photons = photonCounts[i];
+    if(photons) {
+        float radius = pixel.stats.x, count = pixel.stats.y;
+        float newCount = count + SppmAlpha * photons;
+        float newRadius = radius * sqrt(newCount / (count + photons));
+        float4 flux = pixel.beta * vload4(i, photonFlux);
+        pixel.tau = (pixel.tau + flux) * (newRadius * newRadius
+                / (radius * radius));
+        pixel.stats.x = newRadius;
+        pixel.stats.y = newCount;
+
+        vstore4((float4) (0.0f), i, photonFlux);
+        photonCounts[i] = 0;
+    }
+
+    // The accumulator averages the passes, so each pass adds the difference
+    // that turns the average into the new estimate.
+    float numPasses = pass + 1;
+    float4 estimate = pixel.direct / numPasses;
+    if(pixel.stats.x > 0.0f)
+        estimate += pixel.tau / (numPasses * SppmPhotons * M_PI_F
+                * pixel.stats.x * pixel.stats.x);
+    accumAdd(accum, i, estimate * numPasses - pixel.estimate * pass, pass);
+    pixel.estimate = estimate;
+    pixels[i] = pixel;
+
+    if(i == 0)
+        *maxRadius = 0;
+}
+
+int4 sppmCell(float4 position, float cellSize) {
+    return convert_int4_rtn(position / cellSize);
+}
+
+uint sppmHash(int4 cell) {
+    return ((uint) cell.x * 73856093u ^ (uint) cell.y * 19349663u
+            ^ (uint) cell.z * 83492791u) & (SppmGridCells - 1);
+}
+
+bool sppmVisible(__global const SppmPixel *pixel) {
+    return any(pixel->beta.xyz != (float3) (0.0f));
+}
+
+void sppmDeposit(float4 position, float4 dir, float4 beta, float cellSize,
+        __global const SppmPixel *pixels, __global const uint *gridStarts,
+        __global const uint *gridEnds, __global const int *gridEntries,
+        __global float *photonFlux, __global uint *photonCounts) {
+    int4 center = sppmCell(position, cellSize);
+    for(int z = -1; z <= 1; ++z) {
+        for(int y = -1; y <= 1; ++y) {
+            for(int x = -1; x <= 1; ++x) {
+                int4 cell = center + (int4) (x, y, z, 0);
+                uint hash = sppmHash(cell);
+                for(uint e = gridStarts[hash]; e < gridEnds[hash]; ++e) {
+                    int j = gridEntries[e];
+                    __global const SppmPixel *pixel = &pixels[j];
+
+                    // Other cells can have the same hash. Their points are
+                    // skipped here, so that each point is seen once.
+                    if(any(sppmCell(pixel->position, cellSize).xyz
+                                != cell.xyz))
+                        continue;
+
+                    float4 d = pixel->position - position;
+                    float radius = pixel->stats.x;
+                    if(dot(d.xyz, d.xyz) > radius * radius
+                            || dot(pixel->normal, dir) >= 0.0f)
+                        continue;
+
+                    __global float *flux = photonFlux + 4 * j;
+                    atomicAddFloat(&flux[0], beta.x);
+                    atomicAddFloat(&flux[1], beta.y);
+                    atomicAddFloat(&flux[2], beta.z);
+                    atomic_inc(&photonCounts[j]);
+                }
+            }
+        }
+    }
+}
+
+#endif // !SPPM_CL
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TONEMAP_CL
+#define TONEMAP_CL
+
+#include "accum.cl"
+
+/**
+ * Maps the HDR color to [0, 1] with the operator selected by the Tonemap*
+ * defines. Without any of them the color is only clamped.
+ */
+float3 tonemapOperator(float3 color);
+
+/// Converts the linear color to sRGB.
+float3 srgbEncode(float3 color);
+
+/// Filmic curve of Uncharted 2 (John Hable).
+float3 hableCurve(float3 x);
+
+/**
+ * Converts the average of the passes of the HDR accumulator to 8 bit RGB with
+ * no padding between rows, applying the exposure, the tonemapping operator,
+ * the sRGB transfer function and blue noise dithering.
+ * @param accum HDR accumulator of the passes.
+ * @param size Width and height of the image.
+ * @param numPasses Number of passes in the accumulator.
+ * @param exposure Scale applied to the color before the operator.
+ * @param blueNoise BlueNoiseSize x BlueNoiseSize blue noise dither mask.
+ * @param out The 8 bit RGB image.
+ */
+__kernel void tonemap(__global const AccumPixel *accum, int2 size,
+        uint numPasses, float exposure, __global const uchar *blueNoise,
+        __global uchar *out)
+{
+    int2 coord = (int2) (get_global_id(0), get_global_id(1));
+    if(coord.x >= size.x || coord.y >= size.y)
+        return;
+
+    int i = coord.y * size.x + coord.x;
+    float3 color = accumRead(accum, i, numPasses).xyz * exposure;
+    color = tonemapOperator(max(color, (float3) (0.0f)));
+#ifndef TonemapClamp
+    color = srgbEncode(color);
+#endif
+
+    // Offset the quantization by up to half a step so banding turns into
+    // noise without low frequencies.
+    uchar mask = blueNoise[(coord.y % BlueNoiseSize) * BlueNoiseSize
+        + coord.x % BlueNoiseSize];
+    float dither = (mask + 0.5f) / 256.0f - 0.5f;
+    vstore3(convert_uchar3_sat(color * 255.0f + (0.5f + dither)), i, out);
+}
+
+float3 tonemapOperator(float3 color) {
+#if defined(TonemapReinhard)
+    return color / (1.0f + color);
+#elif defined(TonemapACES)
+    // Fit of the ACES reference rendering transform by Krzysztof Narkowicz.
+    return clamp((color * (2.51f * color + 0.03f))
+            / (color * (2.43f * color + 0.59f) + 0.14f), 0.0f, 1.0f);
+#elif defined(TonemapFilmic)
+    const float whitePoint = 11.2f;
+    return clamp(hableCurve(2.0f * color)
+            / hableCurve((float3) (whitePoint)), 0.0f, 1.0f);
+#else
+    return clamp(color, 0.0f, 1.0f);
+#endif
+}
+
+float3 srgbEncode(float3 color) {
+    float3 low = color * 12.92f;
+    float3 high = 1.055f * pow(color, (float3) (1.0f / 2.4f)) - 0.055f;
+    return select(high, low, isless(color, (float3) (0.0031308f)));
+}
+
+float3 hableCurve(float3 x) {
+    const float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f;
+    const float f = 0.30f;
+    return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - e / f;
+}
+
+#endif // !TONEMAP_CL
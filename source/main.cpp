@@ -20,24 +20,63 @@
  * THE SOFTWARE.
  */
 
+#include "BatchFile.hpp"
 #include "CmdArgs.hpp"
+#include "FrameWriter.hpp"
 #include "PPMImage.hpp"
+#include "Profiler.hpp"
 #include "Screen.hpp"
 #include "Sampler.hpp"
 #include "World.hpp"
+#include "preview/PreviewServer.hpp"
 #include <iostream>
+#include <memory>
 
 int main(int argc, char **argv) {
     std::ios_base::sync_with_stdio(false);
 
     CmdArgs args{argc, argv};
+    if(args.tracing())
+        Profiler::instance().enable();
+
     Screen screen{args};
     World world{args};
 
     Sampler sampler{world, screen, args};
-    auto image = sampler.sample();
 
-    image->writeTo(args.outputFilename());
+    if(args.batch()) {
+        BatchFile batch{args};
+        FrameWriter writer{screen.width(), screen.height()};
+
+        sampler.renderBatch(batch.frames(),
+                [&writer](const BatchFrame &frame, std::vector<uint8_t> &rgb) {
+                    writer.write(frame.output, rgb);
+                });
+    }
+    else {
+        std::unique_ptr<PreviewServer> preview;
+        if(args.previewPort()) {
+            preview = std::make_unique<PreviewServer>(args.previewPort(),
+                    screen.width(), screen.height());
+            sampler.setPassCallback([&preview](const uint8_t *rgb, int pass) {
+                preview->publish(rgb, pass);
+            });
+        }
+
+        if(args.resume() && !sampler.resume(args.checkpointFilename()))
+            std::cout << "No checkpoint to resume from, starting a new render."
+                << std::endl;
+
+        auto image = sampler.sample();
+
+        PPMImage::write(args.outputFilename(), image.data(), screen.width(),
+                screen.height());
+        if(args.aovs())
+            sampler.writeAovs(args.aovFilename());
+    }
+
+    if(args.tracing())
+        Profiler::instance().writeTo(args.traceFilename());
 
     return 0;
 }
@@ -229,7 +229,7 @@ inline Vector operator*(const float &left, Vector right) {
 
 /// / operator for scaling vectors.
 inline Vector operator/(Vector left, const float &right) {
-    left *= right;
+    left /= right;
     return left;
 }
 
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "PreviewServer.hpp"
+#include "../error.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+typedef PreviewServer::Socket Socket;
+
+/*
+ * The few socket calls that differ between Winsock and BSD sockets.
+ */
+#ifdef _WIN32
+const int SendFlags = 0;
+
+bool validSocket(Socket sock) {
+    return sock != INVALID_SOCKET;
+}
+
+void closeSocket(Socket sock) {
+    closesocket(sock);
+}
+
+/// Returns if the socket can be read before the timeout, in milliseconds.
+bool waitSocket(Socket sock, int timeout) {
+    WSAPOLLFD fd;
+    fd.fd = sock;
+    fd.events = POLLRDNORM;
+    fd.revents = 0;
+    return WSAPoll(&fd, 1, timeout) > 0;
+}
+
+void setSendTimeout(Socket sock, int timeout) {
+    DWORD value = timeout;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *) &value,
+            sizeof(value));
+}
+#else
+const int SendFlags = MSG_NOSIGNAL; // Broken clients don't raise SIGPIPE.
+
+bool validSocket(Socket sock) {
+    return sock >= 0;
+}
+
+void closeSocket(Socket sock) {
+    close(sock);
+}
+
+/// Returns if the socket can be read before the timeout, in milliseconds.
+bool waitSocket(Socket sock, int timeout) {
+    pollfd fd;
+    fd.fd = sock;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    return poll(&fd, 1, timeout) > 0;
+}
+
+void setSendTimeout(Socket sock, int timeout) {
+    timeval value;
+    value.tv_sec = timeout / 1000;
+    value.tv_usec = (timeout % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &value, sizeof(value));
+}
+#endif
+
+/// Milliseconds a client has to send its request line and to take each part
+/// of the response, so that a stalled client can't block the server.
+const int ClientTimeout = 2000;
+
+/// Largest request line read from a client.
+const size_t MaxRequestSize = 8192;
+
+/// Page that polls the server and draws the changed tiles.
+const char *PreviewPage = R"(<!DOCTYPE html>
+<html><head><title>clTracer preview</title></head>
+<body style="background:#222;color:#ccc;font-family:sans-serif">
+<p id="status">Waiting for the first pass...</p>
+<canvas id="canvas" width="0" height="0"></canvas>
+<script>
+var canvas = document.getElementById('canvas');
+var ctx = canvas.getContext('2d');
+var version = 0;
+function poll() {
+    fetch('/tiles?since=' + version).then(function(r) {
+        return r.arrayBuffer();
+    }).then(function(buffer) {
+        var view = new DataView(buffer), pos = 20;
+        var numTiles = view.getUint32(16, true);
+        version = view.getUint32(0, true);
+        if(canvas.width != view.getUint32(8, true)) {
+            canvas.width = view.getUint32(8, true);
+            canvas.height = view.getUint32(12, true);
+        }
+        for(var t = 0; t < numTiles; ++t) {
+            var x = view.getUint16(pos, true), y = view.getUint16(pos + 2, true);
+            var w = view.getUint16(pos + 4, true), h = view.getUint16(pos + 6, true);
+            var end = pos + 12 + view.getUint32(pos + 8, true);
+            var image = ctx.createImageData(w, h), p = 0;
+            for(pos += 12; pos < end;) {
+                var header = view.getUint8(pos++);
+                var count = header < 128 ? header + 1 : header - 126;
+                for(var i = 0; i < count; ++i, p += 4) {
+                    image.data[p] = view.getUint8(pos);
+                    image.data[p + 1] = view.getUint8(pos + 1);
+                    image.data[p + 2] = view.getUint8(pos + 2);
+                    image.data[p + 3] = 255;
+                    if(header < 128)
+                        pos += 3;
+                }
+                if(header >= 128)
+                    pos += 3;
+            }
+            ctx.putImageData(image, x, y);
+        }
+        document.getElementById('status').textContent =
+            'Pass ' + view.getUint32(4, true) + ' (' + numTiles + ' tiles changed)';
+    }).catch(function() {}).then(function() {
+        setTimeout(poll, 100);
+    });
+}
+poll();
+</script>
+</body></html>
+)";
+
+void putU16(std::string &out, uint32_t val) {
+    out += (char) (val & 0xFF);
+    out += (char) ((val >> 8) & 0xFF);
+}
+
+void putU32(std::string &out, uint32_t val) {
+    putU16(out, val & 0xFFFF);
+    putU16(out, val >> 16);
+}
+
+/// Sends everything, returning false if the client went away.
+bool sendAll(Socket client, const std::string &data) {
+    const size_t MaxChunk = 1 << 20;
+    size_t sent = 0;
+    while(sent < data.size()) {
+        int ret = (int) send(client, data.data() + sent,
+                (int) std::min(data.size() - sent, MaxChunk), SendFlags);
+        if(ret <= 0)
+            return false;
+        sent += ret;
+    }
+    return true;
+}
+
+void sendResponse(Socket client, const char *status, const char *type,
+        const std::string &body) {
+    std::stringstream header;
+    header << "HTTP/1.1 " << status << "\r\n"
+        << "Content-Type: " << type << "\r\n"
+        << "Content-Length: " << body.size() << "\r\n"
+        << "Cache-Control: no-store\r\n"
+        << "Connection: close\r\n\r\n";
+
+    if(sendAll(client, header.str()))
+        sendAll(client, body);
+}
+
+} // namespace
+
+PreviewServer::PreviewServer(int port, int width, int height)
+        : _width{width}, _height{height}, _running{true}, _pendingPass{0},
+        _hasPending{false}, _version{0}, _pass{0} {
+    // Split the image in tiles.
+    for(int y = 0; y < _height; y += TileSize) {
+        for(int x = 0; x < _width; x += TileSize) {
+            Tile tile;
+            tile.x = x;
+            tile.y = y;
+            tile.width = std::min(TileSize, _width - x);
+            tile.height = std::min(TileSize, _height - y);
+            tile.version = 0;
+            _tiles.push_back(tile);
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    stop_if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0,
+            "failed to initialize Winsock.");
+#endif
+
+    _socket = socket(AF_INET, SOCK_STREAM, 0);
+    stop_if(!validSocket(_socket), "failed to create the preview socket.");
+
+    int reuse = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, (const char *) &reuse,
+            sizeof(reuse));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    stop_if(bind(_socket, (sockaddr *) &addr, sizeof(addr)) < 0,
+            "failed to bind the preview to port %d.", port);
+    stop_if(listen(_socket, 8) < 0, "failed to listen on port %d.", port);
+
+    _encoder = std::thread{&PreviewServer::encodeLoop, this};
+    _server = std::thread{&PreviewServer::serveLoop, this};
+
+    std::cout << "Preview at http://localhost:" << port << "/" << std::endl;
+}
+
+PreviewServer::~PreviewServer() {
+    {
+        std::lock_guard<std::mutex> lock{_pendingMutex};
+        _running = false;
+    }
+    _pendingReady.notify_one();
+
+    _encoder.join();
+    _server.join();
+    closeSocket(_socket);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void PreviewServer::publish(const uint8_t *rgb, int pass) {
+    {
+        std::lock_guard<std::mutex> lock{_pendingMutex};
+        _pending.assign(rgb, rgb + 3 * _width * _height);
+        _pendingPass = pass;
+        _hasPending = true;
+    }
+    _pendingReady.notify_one();
+}
+
+void PreviewServer::encodeLoop() {
+    std::vector<uint8_t> frame;
+    std::vector<std::vector<uint8_t>> encoded(_tiles.size());
+    std::vector<bool> changed(_tiles.size());
+
+    while(true) {
+        int pass;
+        {
+            std::unique_lock<std::mutex> lock{_pendingMutex};
+            _pendingReady.wait(lock, [this] {
+                return _hasPending || !_running;
+            });
+            if(!_running)
+                return;
+
+            frame.swap(_pending);
+            pass = _pendingPass;
+            _hasPending = false;
+        }
+
+        // Only the tiles that changed are compressed.
+        for(size_t i = 0; i < _tiles.size(); ++i) {
+            changed[i] = _published.empty() || tileChanged(frame, _tiles[i]);
+            if(changed[i])
+                encoded[i] = encodeTile(frame, _tiles[i]);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{_tilesMutex};
+            ++_version;
+            _pass = pass;
+            for(size_t i = 0; i < _tiles.size(); ++i) {
+                if(changed[i]) {
+                    _tiles[i].data.swap(encoded[i]);
+                    _tiles[i].version = _version;
+                }
+            }
+        }
+
+        _published.swap(frame);
+    }
+}
+
+bool PreviewServer::tileChanged(const std::vector<uint8_t> &frame,
+        const Tile &tile) const {
+    for(int y = tile.y; y < tile.y + tile.height; ++y) {
+        size_t row = 3 * ((size_t) _width * y + tile.x);
+        if(memcmp(&frame[row], &_published[row], 3 * tile.width))
+            return true;
+    }
+    return false;
+}
+
+std::vector<uint8_t> PreviewServer::encodeTile(
+        const std::vector<uint8_t> &frame, const Tile &tile) const {
+    std::vector<uint32_t> pixels;
+    for(int y = tile.y; y < tile.y + tile.height; ++y) {
+        for(int x = tile.x; x < tile.x + tile.width; ++x) {
+            const uint8_t *p = &frame[3 * ((size_t) _width * y + x)];
+            pixels.push_back(p[0] | (p[1] << 8) | (p[2] << 16));
+        }
+    }
+
+    std::vector<uint8_t> out;
+    auto putPixel = [&out](uint32_t pixel) {
+        out.push_back(pixel & 0xFF);
+        out.push_back((pixel >> 8) & 0xFF);
+        out.push_back((pixel >> 16) & 0xFF);
+    };
+
+    size_t i = 0;
+    while(i < pixels.size()) {
+        // Repeat run.
+        size_t run = 1;
+        while(i + run < pixels.size() && run < 129
+                && pixels[i + run] == pixels[i])
+            ++run;
+        if(run >= 2) {
+            out.push_back(run + 126);
+            putPixel(pixels[i]);
+            i += run;
+            continue;
+        }
+
+        // Literal run, until the next repeat or 128 pixels.
+        size_t literal = 1;
+        while(i + literal < pixels.size() && literal < 128
+                && !(i + literal + 1 < pixels.size()
+                    && pixels[i + literal] == pixels[i + literal + 1]))
+            ++literal;
+        out.push_back(literal - 1);
+        for(size_t j = 0; j < literal; ++j)
+            putPixel(pixels[i + j]);
+        i += literal;
+    }
+
+    return out;
+}
+
+std::string PreviewServer::changedTiles(uint32_t since) {
+    std::lock_guard<std::mutex> lock{_tilesMutex};
+    std::string tiles;
+    uint32_t numTiles = 0;
+
+    for(const Tile &tile : _tiles) {
+        if(tile.version <= since)
+            continue;
+
+        putU16(tiles, tile.x);
+        putU16(tiles, tile.y);
+        putU16(tiles, tile.width);
+        putU16(tiles, tile.height);
+        putU32(tiles, tile.data.size());
+        tiles.append(tile.data.begin(), tile.data.end());
+        ++numTiles;
+    }
+
+    std::string out;
+    putU32(out, _version);
+    putU32(out, _pass);
+    putU32(out, _width);
+    putU32(out, _height);
+    putU32(out, numTiles);
+    return out + tiles;
+}
+
+void PreviewServer::serveLoop() {
+    while(_running) {
+        // Wake up from time to time to see if the server was stopped.
+        if(!waitSocket(_socket, 100))
+            continue;
+
+        Socket client = accept(_socket, NULL, NULL);
+        if(!validSocket(client))
+            continue;
+
+        setSendTimeout(client, ClientTimeout);
+        handleClient(client);
+        closeSocket(client);
+    }
+}
+
+void PreviewServer::handleClient(Socket client) {
+    // Only the request line matters.
+    std::string request;
+    char buffer[1024];
+    auto deadline = std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(ClientTimeout);
+    while(request.find("\r\n") == std::string::npos
+            && request.size() < MaxRequestSize) {
+        // Give up on clients that stall, or when the server is stopped.
+        if(!_running || std::chrono::steady_clock::now() > deadline)
+            return;
+        if(!waitSocket(client, 100))
+            continue;
+
+        int ret = (int) recv(client, buffer, sizeof(buffer), 0);
+        if(ret <= 0)
+            return;
+        request.append(buffer, ret);
+    }
+
+    std::string method, path;
+    std::stringstream{request} >> method >> path;
+
+    if(method != "GET")
+        sendResponse(client, "405 Method Not Allowed", "text/plain", "");
+    else if(path == "/")
+        sendResponse(client, "200 OK", "text/html", PreviewPage);
+    else if(path.compare(0, 13, "/tiles?since=") == 0)
+        sendResponse(client, "200 OK", "application/octet-stream",
+                changedTiles(strtoul(path.c_str() + 13, NULL, 10)));
+    else
+        sendResponse(client, "404 Not Found", "text/plain", "");
+}
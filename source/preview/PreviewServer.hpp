@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2015 Renato Utsch <renatoutsch@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREVIEWSERVER_HPP
+#define PREVIEWSERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Publishes the frames of a progressive render to a local HTTP endpoint.
+ * Opening http://localhost:<port>/ shows a page that polls the server and
+ * receives only the tiles that changed since the last frame it got.
+ * Publishing only copies the frame; comparing and compressing the tiles is
+ * done by an encoder thread and the clients are served by another thread, so
+ * the preview never stalls the sampling.
+ */
+class PreviewServer {
+public:
+    /// Width and height of the tiles.
+    static const int TileSize = 32;
+
+#ifdef _WIN32
+    typedef uintptr_t Socket;   /// SOCKET of Winsock.
+#else
+    typedef int Socket;         /// File descriptor of a BSD socket.
+#endif
+
+private:
+    /// Last version of a tile, compressed with run length encoding.
+    struct Tile {
+        int x, y, width, height;
+        uint32_t version;
+        std::vector<uint8_t> data;
+    };
+
+    int _width, _height;
+    Socket _socket;
+    std::atomic<bool> _running;
+
+    // Frame waiting to be encoded.
+    std::mutex _pendingMutex;
+    std::condition_variable _pendingReady;
+    std::vector<uint8_t> _pending;
+    int _pendingPass;
+    bool _hasPending;
+
+    // Encoded tiles served to the clients.
+    std::mutex _tilesMutex;
+    std::vector<Tile> _tiles;
+    uint32_t _version;
+    int _pass;
+
+    std::vector<uint8_t> _published; /// Last encoded frame, in RGB.
+
+    std::thread _encoder, _server;
+
+    /// Encodes the published frames.
+    void encodeLoop();
+
+    /// Accepts and answers the clients.
+    void serveLoop();
+
+    /// Answers one HTTP request.
+    void handleClient(Socket client);
+
+    /// Returns the tiles that changed after the given version.
+    std::string changedTiles(uint32_t since);
+
+    /// Returns true if the tile is different in both frames.
+    bool tileChanged(const std::vector<uint8_t> &frame, const Tile &tile) const;
+
+    /**
+     * Compresses the RGB values of the tile with PackBits: a header h < 128
+     * is followed by h + 1 literal pixels, and a header h >= 128 is followed
+     * by one pixel that is repeated h - 126 times.
+     */
+    std::vector<uint8_t> encodeTile(const std::vector<uint8_t> &frame,
+            const Tile &tile) const;
+
+public:
+    PreviewServer() = delete;
+    PreviewServer(const PreviewServer &) = delete;
+    PreviewServer &operator=(const PreviewServer &) = delete;
+
+    /**
+     * Starts serving the preview of an image of the given size on
+     * localhost:port. Stops the program if the port can't be used.
+     */
+    PreviewServer(int port, int width, int height);
+
+    /// Stops serving.
+    ~PreviewServer();
+
+    /**
+     * Publishes a frame of the render. Frames that are published while the
+     * previous one is still being encoded replace it.
+     * @param rgb Image with 3 bytes per pixel and no padding between rows.
+     * @param pass Number of passes accumulated in the frame.
+     */
+    void publish(const uint8_t *rgb, int pass);
+};
+
+#endif // !PREVIEWSERVER_HPP
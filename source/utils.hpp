@@ -25,13 +25,16 @@
 
 #include <chrono>
 
-/// Time type.
-typedef std::chrono::milliseconds::rep Time;
+/// Time type, in milliseconds.
+typedef double Time;
 
-/// Gets the time since epoch in milliseconds.
+/**
+ * Gets the time in milliseconds from a monotonic clock, with sub millisecond
+ * resolution. Only differences between two calls are meaningful.
+ */
 inline Time getTime() {
-    return std::chrono::duration_cast<std::chrono::milliseconds>
-        (std::chrono::system_clock::now().time_since_epoch()).count();
+    return std::chrono::duration<Time, std::milli>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 #endif // !UTILS_HPP